@@ -25,6 +25,10 @@ extern          "C" {
     void            Decoder_Interface_Decode(void *state,
 					     const unsigned char *in,
 					     short *out, int bfi);
+    int             Decoder_Interface_DecodeFrames(void *state,
+						   const unsigned char *toc,
+						   const unsigned char *data,
+						   int nframes, short *out);
 
 #ifdef __cplusplus
 }
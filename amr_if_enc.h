@@ -13,18 +13,37 @@
  * ------------------------------------------------------------------- 
  */
 
-#ifndef SUDA_AMRNB_INTERF_DEC_H
-#define SUDA_AMRNB_INTERF_DEC_H
+#ifndef SUDA_AMRNB_INTERF_ENC_H
+#define SUDA_AMRNB_INTERF_ENC_H
+
+#include <xdc/std.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+
+/*
+ * Most frames one Encoder_Interface_EncodeFrames() call takes 
+ */
+#define AMRNB_MAX_FRAMES_PER_CALL 10
 
 #ifdef __cplusplus
 extern          "C" {
 #endif
 
-    void           *Decoder_Interface_init(void);
-    void            Decoder_Interface_exit(void *state);
-    void            Decoder_Interface_Decode(void *state,
-					     const unsigned char *in,
-					     short *out, int bfi);
+    void           *Encoder_Interface_init(int dtx, int mode);
+    void            Encoder_Interface_exit(void *state);
+    void            Encoder_Interface_ctrl(void *state, int dtx, int mode);
+    int             Encoder_Interface_Encode(void *state,
+					     const short *speech,
+					     unsigned char *out);
+    int             Encoder_Interface_setFrames(void *state, int nframes);
+    int             Encoder_Interface_EncodeFrames(void *state,
+						   const short *speech,
+						   int nframes,
+						   unsigned char *out);
+    unsigned char  *Encoder_Interface_getInBuf(void *state);
+    int             Encoder_Interface_EncodeInBuf(void *state, int nframes,
+						  Buffer_Handle hOutBuf,
+						  unsigned char *out);
 
 #ifdef __cplusplus
 }
@@ -28,6 +28,8 @@
 #include "amr_if_dec.h"
 #include "amr_if_enc.h"
 #include "Senc1.h"
+#include "engine_mgr.h"
+#include "codec_pool.h"
 
 
 static short    amrnb_suda_AMRNB_NOCRC_Flen[16] = {
@@ -41,6 +43,7 @@ struct decoder_state {
     SPHDEC1_DynamicParams decDynParams;
     Buffer_Handle   hInBuf;
     Buffer_Handle   hOutBuf;
+    int             batch;	/* codec decodes several frames per call */
 };
 
 /*
@@ -50,18 +53,33 @@ void           *
 Decoder_Interface_init(void)
 {
     Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+    CodecPool_Instance inst;
     struct decoder_state *state =
 	(struct decoder_state *) malloc(sizeof(struct decoder_state));
-    CERuntime_init();
-    Dmai_init();
     if (state == NULL) {
 	fprintf(stderr,
 		"Error to malloc memory for AMR-NB decoder state variable\n");
 	return (void *) state;
     }
+    state->decParams = Sdec1_Params_DEFAULT;
+    state->decDynParams = Sdec1_DynamicParams_DEFAULT;
+    state->decParams.packingType = 0;
+    state->decParams.bitRate = 7;
+    state->batch = 1;
+
+    if (CodecPool_get(CodecPool_Type_SDEC1, "amrnbdec", &(state->decParams),
+		      sizeof(state->decParams), &(state->decDynParams),
+		      &inst)) {
+	state->hEngine = inst.hEngine;
+	state->hSd1 = (Sdec1_Handle) inst.hCodec;
+	state->hInBuf = inst.hInBuf;
+	state->hOutBuf = inst.hOutBuf;
+	return (void *) state;
+    }
+
     fprintf(stderr, "Engine opening in AMR decoder init......\n");
 
-    if ((state->hEngine = Engine_open("encodedecode", NULL, NULL)) == NULL) {
+    if ((state->hEngine = EngineMgr_acquire()) == NULL) {
 	fprintf(stderr, "Engine open error in AMR decoder init\n");
 	free(state);
 	state = NULL;
@@ -69,26 +87,25 @@ Decoder_Interface_init(void)
     }
     fprintf(stderr, "Engine opened in AMR decoder init......\n");
 
-    state->decParams = Sdec1_Params_DEFAULT;
-    state->decDynParams = Sdec1_DynamicParams_DEFAULT;
-    state->decParams.packingType = 0;
-    state->decParams.bitRate = 7;
-
-    if ((state->hSd1 =
-	 Sdec1_create(state->hEngine, "amrnbdec", &(state->decParams),
-		      &(state->decDynParams)))
-	== NULL) {
+    EngineMgr_lock(state->hEngine);
+    state->hSd1 =
+	Sdec1_create(state->hEngine, "amrnbdec", &(state->decParams),
+		     &(state->decDynParams));
+    EngineMgr_unlock(state->hEngine);
+    if (state->hSd1 == NULL) {
 	fprintf(stderr, "Create AMR-NB decoder handle error\n");
-	Engine_close(state->hEngine);
+	EngineMgr_release(state->hEngine);
 	free(state);
 	state = NULL;
 	return (void *) state;
     }
 
     state->hInBuf =
-	Buffer_create(Sdec1_getInBufSize(state->hSd1), &bAttrs);
+	Buffer_create(Sdec1_getInBufSize(state->hSd1) * AMRNB_MAX_FRAMES_PER_CALL,
+		      &bAttrs);
     state->hOutBuf =
-	Buffer_create(Sdec1_getOutBufSize(state->hSd1) * 2, &bAttrs);
+	Buffer_create(Sdec1_getOutBufSize(state->hSd1) * AMRNB_MAX_FRAMES_PER_CALL,
+		      &bAttrs);
 
     if ((state->hInBuf == NULL) || (state->hOutBuf == NULL)) {
 	fprintf(stderr,
@@ -100,10 +117,12 @@ Decoder_Interface_init(void)
 	    Buffer_delete(state->hOutBuf);
 	}
 	if (state->hSd1) {
+	    EngineMgr_lock(state->hEngine);
 	    Sdec1_delete(state->hSd1);
+	    EngineMgr_unlock(state->hEngine);
 	}
 	if (state->hEngine) {
-	    Engine_close(state->hEngine);
+	    EngineMgr_release(state->hEngine);
 	}
 	free(state);
 	state = NULL;
@@ -117,18 +136,18 @@ void
 Decoder_Interface_exit(void *s)
 {
     struct decoder_state *state = (struct decoder_state *) s;
-    if (state->hInBuf) {
-	Buffer_delete(state->hInBuf);
-    }
-    if (state->hOutBuf) {
-	Buffer_delete(state->hOutBuf);
-    }
-    if (state->hSd1) {
-	Sdec1_delete(state->hSd1);
-    }
-    if (state->hEngine) {
-	Engine_close(state->hEngine);
-    }
+    CodecPool_Instance inst;
+
+    /*
+     * Park the codec and its buffers for the next call 
+     */
+    inst.hEngine = state->hEngine;
+    inst.hCodec = state->hSd1;
+    inst.hInBuf = state->hInBuf;
+    inst.hOutBuf = state->hOutBuf;
+    inst.hBufTab = NULL;
+    CodecPool_put(CodecPool_Type_SDEC1, "amrnbdec", &(state->decParams),
+		  sizeof(state->decParams), &(state->decDynParams), &inst);
     free(state);
 }
 
@@ -144,17 +163,105 @@ Decoder_Interface_Decode(void *s, const unsigned char *in, short *out,
 	(unsigned char *) Buffer_getUserPtr(state->hInBuf);
     unsigned char  *pOut =
 	(unsigned char *) Buffer_getUserPtr(state->hOutBuf);
+    Int             ret;
 
     memcpy(pIn, in, len);
     Buffer_setNumBytesUsed(state->hInBuf, len);
 
-    if (Sdec1_process(state->hSd1, state->hInBuf, state->hOutBuf) < 0) {
+    EngineMgr_lock(state->hEngine);
+    ret = Sdec1_process(state->hSd1, state->hInBuf, state->hOutBuf);
+    EngineMgr_unlock(state->hEngine);
+    if (ret < 0) {
 	fprintf(stderr, "AMR-NB Failed to decode speech buffer\n");
     }
 
     memcpy((unsigned char *) out, pOut, 160 * 2);
 }
 
+/*
+ * Decode the nframes frames of an RTP payload: toc[] holds their TOC
+ * entries, data the frames themselves, back to back.  The frames are
+ * staged once, with their header byte, in the DSP input buffer and
+ * handed to the codec in as few calls as it takes: a codec that stops
+ * after the first frame is given one frame per call from then on.
+ * Returns the number of Sdec1_process() calls made.
+ */
+int
+Decoder_Interface_DecodeFrames(void *s, const unsigned char *toc,
+			       const unsigned char *data, int nframes,
+			       short *out)
+{
+    struct decoder_state *state = (struct decoder_state *) s;
+    unsigned char  *pIn =
+	(unsigned char *) Buffer_getUserPtr(state->hInBuf);
+    unsigned char  *pOut =
+	(unsigned char *) Buffer_getUserPtr(state->hOutBuf);
+    int             lens[AMRNB_MAX_FRAMES_PER_CALL];
+    int             used = 0;
+    int             done = 0;
+    int             calls = 0;
+    int             given,
+                    got,
+                    len,
+                    i;
+    Int             ret;
+
+    if (nframes < 1 || nframes > AMRNB_MAX_FRAMES_PER_CALL) {
+	fprintf(stderr, "AMR-NB cannot decode %d frames in one call\n",
+		nframes);
+	return 0;
+    }
+
+    for (i = 0; i < nframes; i++) {
+	len = amrnb_suda_AMRNB_NOCRC_Flen[(toc[i] >> 3) & 0x0f];
+	if (len < 1)
+	    len = 1;
+	pIn[used] = toc[i] & 0x7f;
+	memcpy(pIn + used + 1, data, len - 1);
+	data += len - 1;
+	used += len;
+	lens[i] = len;
+    }
+
+    EngineMgr_lock(state->hEngine);
+    while (done < nframes) {
+	given = state->batch ? nframes - done : 1;
+	for (len = 0, i = done; i < done + given; i++)
+	    len += lens[i];
+	Buffer_setNumBytesUsed(state->hInBuf, len);
+
+	ret = Sdec1_process(state->hSd1, state->hInBuf, state->hOutBuf);
+	calls++;
+	got = Buffer_getNumBytesUsed(state->hOutBuf) / (160 * 2);
+	if (ret < 0 || got < 1) {
+	    if (given > 1) {
+		state->batch = 0;
+		continue;
+	    }
+	    fprintf(stderr, "AMR-NB Failed to decode speech buffer\n");
+	    got = 1;
+	} else if (got > given) {
+	    got = given;
+	} else if (got < given) {
+	    state->batch = 0;
+	}
+
+	memcpy((unsigned char *) (out + done * 160), pOut, got * 160 * 2);
+
+	/*
+	 * Move what is left to the start of the input buffer 
+	 */
+	for (len = 0, i = done; i < done + got; i++)
+	    len += lens[i];
+	used -= len;
+	memmove(pIn, pIn + len, used);
+	done += got;
+    }
+    EngineMgr_unlock(state->hEngine);
+
+    return calls;
+}
+
 struct encoder_state {
     Engine_Handle   hEngine;
     Senc1_Handle    hSe1;
@@ -162,6 +269,7 @@ struct encoder_state {
     SPHENC1_DynamicParams encDynParams;
     Buffer_Handle   hInBuf;
     Buffer_Handle   hOutBuf;
+    int             frames;	/* per Senc1_process() call */
 };
 
 /*
@@ -171,11 +279,10 @@ void           *
 Encoder_Interface_init(int dtx, int mode)
 {
     Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+    CodecPool_Instance inst;
     struct encoder_state *state =
 	(struct encoder_state *) malloc(sizeof(struct encoder_state));
 
-    CERuntime_init();
-    Dmai_init();
     fprintf(stderr, "Encoder_Interface_init init..................\n");
     if (state == NULL) {
 	fprintf(stderr,
@@ -183,15 +290,6 @@ Encoder_Interface_init(int dtx, int mode)
 	return (void *) state;
     }
 
-    if ((state->hEngine = Engine_open("encodedecode", NULL, NULL)) == NULL) {
-	fprintf(stderr, "Engine open error in AMR encoder init\n");
-	free(state);
-	state = NULL;
-	return (void *) state;
-    }
-    fprintf(stderr,
-	    "Engine opened in AMR encoder init..................\n");
-
     state->encParams = Senc1_Params_DEFAULT;
     state->encDynParams = Senc1_DynamicParams_DEFAULT;
     state->encParams.vadSelection = dtx;
@@ -199,22 +297,46 @@ Encoder_Interface_init(int dtx, int mode)
     state->encParams.bitRate = mode;
     state->encDynParams.vadFlag = dtx;
     state->encDynParams.bitRate = mode;
+    state->frames = 1;
+
+    if (CodecPool_get(CodecPool_Type_SENC1, "amrnbenc", &(state->encParams),
+		      sizeof(state->encParams), &(state->encDynParams),
+		      &inst)) {
+	state->hEngine = inst.hEngine;
+	state->hSe1 = (Senc1_Handle) inst.hCodec;
+	state->hInBuf = inst.hInBuf;
+	state->hOutBuf = inst.hOutBuf;
+	return (void *) state;
+    }
 
-    if ((state->hSe1 =
-	 Senc1_create(state->hEngine, "amrnbenc", &(state->encParams),
-		      &(state->encDynParams)))
-	== NULL) {
+    if ((state->hEngine = EngineMgr_acquire()) == NULL) {
+	fprintf(stderr, "Engine open error in AMR encoder init\n");
+	free(state);
+	state = NULL;
+	return (void *) state;
+    }
+    fprintf(stderr,
+	    "Engine opened in AMR encoder init..................\n");
+
+    EngineMgr_lock(state->hEngine);
+    state->hSe1 =
+	Senc1_create(state->hEngine, "amrnbenc", &(state->encParams),
+		     &(state->encDynParams));
+    EngineMgr_unlock(state->hEngine);
+    if (state->hSe1 == NULL) {
 	fprintf(stderr, "Create AMR-NB encoder handle error\n");
-	Engine_close(state->hEngine);
+	EngineMgr_release(state->hEngine);
 	free(state);
 	state = NULL;
 	return (void *) state;
     }
 
     state->hInBuf =
-	Buffer_create(Senc1_getInBufSize(state->hSe1) * 2, &bAttrs);
+	Buffer_create(Senc1_getInBufSize(state->hSe1) * AMRNB_MAX_FRAMES_PER_CALL,
+		      &bAttrs);
     state->hOutBuf =
-	Buffer_create(Senc1_getOutBufSize(state->hSe1), &bAttrs);
+	Buffer_create(Senc1_getOutBufSize(state->hSe1) * AMRNB_MAX_FRAMES_PER_CALL,
+		      &bAttrs);
 
     if ((state->hInBuf == NULL) || (state->hOutBuf == NULL)) {
 	fprintf(stderr,
@@ -226,10 +348,12 @@ Encoder_Interface_init(int dtx, int mode)
 	    Buffer_delete(state->hOutBuf);
 	}
 	if (state->hSe1) {
+	    EngineMgr_lock(state->hEngine);
 	    Senc1_delete(state->hSe1);
+	    EngineMgr_unlock(state->hEngine);
 	}
 	if (state->hEngine) {
-	    Engine_close(state->hEngine);
+	    EngineMgr_release(state->hEngine);
 	}
 	free(state);
 	state = NULL;
@@ -243,18 +367,18 @@ void
 Encoder_Interface_exit(void *s)
 {
     struct encoder_state *state = (struct encoder_state *) s;
-    if (state->hInBuf) {
-	Buffer_delete(state->hInBuf);
-    }
-    if (state->hOutBuf) {
-	Buffer_delete(state->hOutBuf);
-    }
-    if (state->hSe1) {
-	Senc1_delete(state->hSe1);
-    }
-    if (state->hEngine) {
-	Engine_close(state->hEngine);
-    }
+    CodecPool_Instance inst;
+
+    /*
+     * Park the codec and its buffers for the next call 
+     */
+    inst.hEngine = state->hEngine;
+    inst.hCodec = state->hSe1;
+    inst.hInBuf = state->hInBuf;
+    inst.hOutBuf = state->hOutBuf;
+    inst.hBufTab = NULL;
+    CodecPool_put(CodecPool_Type_SENC1, "amrnbenc", &(state->encParams),
+		  sizeof(state->encParams), &(state->encDynParams), &inst);
     free(state);
 }
 
@@ -274,9 +398,11 @@ Encoder_Interface_ctrl(void *s, int dtx, int mode)
     encStatus.size = sizeof(SPHENC1_Status);
     encStatus.data.buf = NULL;
     hEncode = Senc1_getVisaHandle(state->hSe1);
+    EngineMgr_lock(state->hEngine);
     status =
 	SPHENC1_control(hEncode, XDM_SETPARAMS, &(state->encDynParams),
 			&encStatus);
+    EngineMgr_unlock(state->hEngine);
     if (status != SPHENC1_EOK) {
 	fprintf(stderr, "AMR-NB encoder error to set parameters\n");
     }
@@ -293,11 +419,15 @@ Encoder_Interface_Encode(void *s, const short *speech, unsigned char *out)
 	(unsigned char *) Buffer_getUserPtr(state->hOutBuf);
 
     int             len;
+    Int             ret;
 
     memcpy(pIn, (unsigned char *) speech, 160 * 2);
     Buffer_setNumBytesUsed(state->hInBuf, 160 * 2);
 
-    if (Senc1_process(state->hSe1, state->hInBuf, state->hOutBuf) < 0) {
+    EngineMgr_lock(state->hEngine);
+    ret = Senc1_process(state->hSe1, state->hInBuf, state->hOutBuf);
+    EngineMgr_unlock(state->hEngine);
+    if (ret < 0) {
 	fprintf(stderr, "AMR-NB failed to encode one frame of speech\n");
     }
 
@@ -306,3 +436,141 @@ Encoder_Interface_Encode(void *s, const short *speech, unsigned char *out)
 
     return len;
 }
+
+/*
+ * Have the codec take nframes frames per Senc1_process() call, through
+ * the frameSize dynamic param, so that a packet worth of speech costs a
+ * single DSP round trip.  The codec tells with XDM_GETBUFINFO whether it
+ * took it; if not it is left at one frame per call.  Returns the number
+ * of frames Encoder_Interface_EncodeFrames() must now be given.
+ */
+int
+Encoder_Interface_setFrames(void *s, int nframes)
+{
+    struct encoder_state *state = (struct encoder_state *) s;
+    SPHENC1_DynamicParams dynParams;
+    SPHENC1_Status  encStatus;
+    XDAS_Int32      status;
+    SPHENC1_Handle  hEncode;
+
+    if (state == NULL)
+	return 0;
+    if (nframes < 1)
+	nframes = 1;
+    if (nframes > AMRNB_MAX_FRAMES_PER_CALL)
+	nframes = AMRNB_MAX_FRAMES_PER_CALL;
+    if (nframes == state->frames)
+	return state->frames;
+
+    dynParams = state->encDynParams;
+    dynParams.frameSize = nframes > 1 ? nframes * 160 : 0;
+    encStatus.size = sizeof(SPHENC1_Status);
+    encStatus.data.buf = NULL;
+    hEncode = Senc1_getVisaHandle(state->hSe1);
+    EngineMgr_lock(state->hEngine);
+    status = SPHENC1_control(hEncode, XDM_SETPARAMS, &dynParams, &encStatus);
+    if (status == SPHENC1_EOK)
+	status =
+	    SPHENC1_control(hEncode, XDM_GETBUFINFO, &dynParams, &encStatus);
+    if (status == SPHENC1_EOK
+	&& (encStatus.bufInfo.minInBufSize[0] != nframes * 160 * 2
+	    || encStatus.bufInfo.minOutBufSize[0] >
+	    Buffer_getSize(state->hOutBuf)))
+	status = SPHENC1_EFAIL;
+    if (status != SPHENC1_EOK)
+	SPHENC1_control(hEncode, XDM_SETPARAMS, &(state->encDynParams),
+			&encStatus);
+    EngineMgr_unlock(state->hEngine);
+
+    if (status != SPHENC1_EOK) {
+	fprintf(stderr, "AMR-NB encoder cannot take %d frames per call\n",
+		nframes);
+	return state->frames;
+    }
+    state->encDynParams = dynParams;
+    state->frames = nframes;
+    return state->frames;
+}
+
+/*
+ * The DSP input buffer, room for the frames of one call: the caller can
+ * write the speech there instead of handing it to
+ * Encoder_Interface_EncodeFrames()
+ */
+unsigned char  *
+Encoder_Interface_getInBuf(void *s)
+{
+    struct encoder_state *state = (struct encoder_state *) s;
+
+    return (unsigned char *) Buffer_getUserPtr(state->hInBuf);
+}
+
+/*
+ * Encode the nframes frames of speech already written to the input
+ * buffer into hOutBuf, a contiguous buffer the DSP writes to directly,
+ * or without hOutBuf into the encoder's own buffer and then to out.
+ * Returns the number of bytes of frames, or -1.
+ */
+int
+Encoder_Interface_EncodeInBuf(void *s, int nframes, Buffer_Handle hOutBuf,
+			      unsigned char *out)
+{
+    struct encoder_state *state = (struct encoder_state *) s;
+    Buffer_Handle   hBuf = hOutBuf != NULL ? hOutBuf : state->hOutBuf;
+    unsigned char  *pOut = (unsigned char *) Buffer_getUserPtr(hBuf);
+    int             outSize = Buffer_getSize(hBuf);
+    int             len = 0,
+		    flen,
+		    i;
+    Int             ret;
+
+    if (nframes != state->frames) {
+	fprintf(stderr, "AMR-NB encoder set for %d frames per call, not %d\n",
+		state->frames, nframes);
+	return -1;
+    }
+
+    Buffer_setNumBytesUsed(state->hInBuf, nframes * 160 * 2);
+
+    EngineMgr_lock(state->hEngine);
+    ret = Senc1_process(state->hSe1, state->hInBuf, hBuf);
+    EngineMgr_unlock(state->hEngine);
+    if (ret < 0) {
+	fprintf(stderr, "AMR-NB failed to encode %d frames of speech\n",
+		nframes);
+	return -1;
+    }
+
+    for (i = 0; i < nframes; i++) {
+	flen = amrnb_suda_AMRNB_NOCRC_Flen[(pOut[len] >> 3) & 0x0f];
+	if (flen == 0 || len + flen > outSize) {
+	    fprintf(stderr, "AMR-NB encoder output frame %d is invalid\n", i);
+	    return -1;
+	}
+	len += flen;
+    }
+    Buffer_setNumBytesUsed(hBuf, len);
+    if (hOutBuf == NULL)
+	memcpy(out, pOut, len);
+
+    return len;
+}
+
+/*
+ * Encode the nframes frames of speech, nframes as returned by
+ * Encoder_Interface_setFrames(), in one DSP call.  The frames are
+ * written back to back to out, each with its header byte.  Returns the
+ * number of bytes written, or -1.
+ */
+int
+Encoder_Interface_EncodeFrames(void *s, const short *speech,
+			       int nframes, unsigned char *out)
+{
+    struct encoder_state *state = (struct encoder_state *) s;
+
+    if (nframes == state->frames)
+	memcpy(Buffer_getUserPtr(state->hInBuf), speech,
+	       nframes * 160 * 2);
+
+    return Encoder_Interface_EncodeInBuf(s, nframes, NULL, out);
+}
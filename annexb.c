@@ -0,0 +1,116 @@
+/*
+ * Annex B byte stream splitting for the SDH264Enc filter.
+ *
+ * Two consecutive zero bytes always cover byte 1 or byte 3 of an aligned
+ * 4 byte word, whatever the alignment of the start code: only the words
+ * holding a zero byte need a closer look, and the usual
+ * (x - 0x01010101) & ~x & 0x80808080 test finds those without a branch
+ * per byte.  Emulation prevention keeps 00 00 out of the slice data, so
+ * most words of a frame are skipped at once.
+ */
+
+#include <stdint.h>
+
+#include "mediastreamer2/msqueue.h"
+
+#include "annexb.h"
+
+#define ONES    0x01010101U
+#define HIGHS   0x80808080U
+
+/*
+ * Words are read straight out of byte buffers 
+ */
+typedef uint32_t __attribute__ ((__may_alias__)) word_t;
+
+#define IS_START_CODE(p)        ((p)[0] == 0 && (p)[1] == 0 && (p)[2] == 1)
+
+/*
+ * Returns the first 00 00 01 at or after p, end if there is none 
+ */
+const uint8_t  *
+AnnexB_findStartCode(const uint8_t * p, const uint8_t * end)
+{
+    const uint8_t  *last;
+    uint32_t        x;
+
+    if (end - p < 3)
+	return end;
+    last = end - 3;		/* last position a start code can begin */
+
+    /*
+     * Byte by byte up to the first aligned word 
+     */
+    while (((uintptr_t) p & 3) != 0) {
+	if (p > last)
+	    return end;
+	if (IS_START_CODE(p))
+	    return p;
+	p++;
+    }
+
+    /*
+     * p + 5 is the furthest byte the candidates of a word look at 
+     */
+    while (p + 5 < end) {
+	x = *(const word_t *) p;
+	if (((x - ONES) & ~x & HIGHS) != 0) {
+	    if (p[1] == 0) {
+		if (p[0] == 0 && p[2] == 1)
+		    return p;
+		if (p[2] == 0 && p[3] == 1)
+		    return p + 1;
+	    }
+	    if (p[3] == 0) {
+		if (p[2] == 0 && p[4] == 1)
+		    return p + 2;
+		if (p[4] == 0 && p[5] == 1)
+		    return p + 3;
+	    }
+	}
+	p += 4;
+    }
+
+    for (; p <= last; p++) {
+	if (IS_START_CODE(p))
+	    return p;
+    }
+    return end;
+}
+
+/*
+ * Queues the NAL units of frame on nalus and frees frame, returns the
+ * number of NAL units queued.  Bytes before the first start code and the
+ * zero bytes that end a NAL unit (the leading byte of a 4 byte start
+ * code, trailing_zero_8bits) are left out. 
+ */
+int
+AnnexB_split(mblk_t * frame, MSQueue * nalus)
+{
+    const uint8_t  *end = frame->b_wptr;
+    const uint8_t  *nal,
+		   *next,
+		   *nal_end;
+    mblk_t         *m;
+    int             count = 0;
+
+    nal = AnnexB_findStartCode(frame->b_rptr, end);
+    while (nal < end) {
+	nal += 3;
+	next = AnnexB_findStartCode(nal, end);
+	nal_end = next;
+	while (nal_end > nal && nal_end[-1] == 0)
+	    nal_end--;
+	if (nal_end > nal) {
+	    m = dupb(frame);
+	    m->b_rptr = (uint8_t *) nal;
+	    m->b_wptr = (uint8_t *) nal_end;
+	    ms_queue_put(nalus, m);
+	    count++;
+	}
+	nal = next;
+    }
+    freemsg(frame);
+
+    return count;
+}
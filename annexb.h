@@ -0,0 +1,30 @@
+/*
+ * Annex B byte stream splitting for the SDH264Enc filter.
+ *
+ * The DSP encoder writes a whole access unit into one buffer, its NAL
+ * units separated by 3 or 4 byte start codes (00 00 01, 00 00 00 01).
+ * AnnexB_findStartCode() looks for them a machine word at a time rather
+ * than byte by byte.  AnnexB_split() cuts a frame held in a single mblk
+ * into its NAL units with dupb(), so no payload byte is copied and every
+ * NAL unit is exactly its own size.
+ */
+
+#ifndef SDCODEC_ANNEXB_H
+#define SDCODEC_ANNEXB_H
+
+#include <stdint.h>
+
+#include "mediastreamer2/msqueue.h"
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    const uint8_t  *AnnexB_findStartCode(const uint8_t * p,
+					 const uint8_t * end);
+    int             AnnexB_split(mblk_t * frame, MSQueue * nalus);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,293 @@
+/*
+ * nalbench - micro-benchmark of the H.264 encoder output splitting.
+ *
+ * Synthetic access units of typical I and P frame sizes, laid out like
+ * the DSP encoder output (4 byte start code before the first NAL unit,
+ * 3 byte ones between the slices of a picture), are split into NAL
+ * units over and over by:
+ *
+ *  - legacy: the byte by byte loop the SDH264Enc filter used to run,
+ *    which copies every NAL unit into a block the size of the frame;
+ *  - bytewise: a plain byte by byte start code search slicing the frame
+ *    mblk, the reference the result of AnnexB_split() is checked against;
+ *  - annexb: AnnexB_split() as used by the filter.
+ *
+ * It reports nanoseconds per frame and MB/s for each of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "mediastreamer2/msqueue.h"
+
+#include "annexb.h"
+
+typedef struct FrameCase {
+    const char     *name;
+    int             size;	/* bytes, start codes included */
+    int             nslices;
+    int             idr;	/* starts with SPS and PPS */
+} FrameCase;
+
+static const FrameCase frame_cases[] = {
+    {"I 480x320", 24000, 1, 1},
+    {"I 720x480 4 slices", 64000, 4, 1},
+    {"P 480x320", 3000, 1, 0},
+    {"P 720x480 4 slices", 9000, 4, 0},
+};
+
+#define NB_CASES (sizeof(frame_cases) / sizeof(frame_cases[0]))
+
+typedef int     (*SplitFunc) (mblk_t * frame, MSQueue * nalus);
+
+static double
+now_usecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * Appends a NAL unit of len bytes (header included) with random,
+ * emulation prevented payload
+ */
+static uint8_t *
+put_nalu(uint8_t * p, int sc_len, uint8_t header, int len,
+	 unsigned int *seed)
+{
+    uint8_t        *start;
+    int             zeros = 0;
+    uint8_t         c;
+
+    if (sc_len == 4)
+	*p++ = 0;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 1;
+    start = p;
+    *p++ = header;
+    while (p - start < len - 1) {
+	c = rand_r(seed) & 0xff;
+	if (zeros >= 2 && c <= 3) {
+	    *p++ = 3;
+	    zeros = 0;
+	    continue;
+	}
+	zeros = c == 0 ? zeros + 1 : 0;
+	*p++ = c;
+    }
+    *p++ = 0x80;		/* rbsp_stop_one_bit */
+    return p;
+}
+
+static mblk_t  *
+make_frame(const FrameCase * fc)
+{
+    mblk_t         *m = allocb(fc->size + 64, 0);
+    unsigned int    seed = fc->size;
+    uint8_t        *p = m->b_wptr;
+    int             slice_len,
+		    i;
+
+    slice_len = fc->size;
+    if (fc->idr) {
+	p = put_nalu(p, 4, 0x67, 10, &seed);
+	p = put_nalu(p, 4, 0x68, 4, &seed);
+	slice_len -= 22;
+    }
+    slice_len = slice_len / fc->nslices - 4;
+    for (i = 0; i < fc->nslices; i++)
+	p = put_nalu(p, i == 0 ? 4 : 3, fc->idr ? 0x65 : 0x41, slice_len,
+		     &seed);
+    m->b_wptr = p;
+    return m;
+}
+
+/*
+ * The loop SDH264Enc used before AnnexB_split(), kept as it was
+ */
+static int
+split_legacy(mblk_t * frame, MSQueue * nalus)
+{
+    mblk_t         *m;
+    uint8_t        *src,
+		   *end;
+    int             len = frame->b_wptr - frame->b_rptr;
+    int             count = 0;
+
+    src = frame->b_rptr + 4;
+    end = src + len - 4;
+    while (src < (end - 4)) {
+	m = allocb(len - 4, 0);
+	while (!(src[0] == 0 && src[1] == 0 && src[2] == 0 && src[3] == 1)
+	       && src < (end - 4)) {
+	    *(m->b_wptr)++ = *src++;
+	}
+	if (src[0] == 0 && src[1] == 0 && src[2] == 0 && src[3] == 1) {
+	    src += 4;
+	} else {
+	    *(m->b_wptr)++ = *src++;
+	    *(m->b_wptr)++ = *src++;
+	    *(m->b_wptr)++ = *src++;
+	    *(m->b_wptr)++ = *src++;
+	}
+	ms_queue_put(nalus, m);
+	count++;
+    }
+    freemsg(frame);
+    return count;
+}
+
+static const uint8_t *
+find_start_code_bytewise(const uint8_t * p, const uint8_t * end)
+{
+    for (; p + 3 <= end; p++)
+	if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+	    return p;
+    return end;
+}
+
+static int
+split_bytewise(mblk_t * frame, MSQueue * nalus)
+{
+    const uint8_t  *end = frame->b_wptr;
+    const uint8_t  *nal,
+		   *next,
+		   *nal_end;
+    mblk_t         *m;
+    int             count = 0;
+
+    nal = find_start_code_bytewise(frame->b_rptr, end);
+    while (nal < end) {
+	nal += 3;
+	next = find_start_code_bytewise(nal, end);
+	for (nal_end = next; nal_end > nal && nal_end[-1] == 0; nal_end--);
+	if (nal_end > nal) {
+	    m = dupb(frame);
+	    m->b_rptr = (uint8_t *) nal;
+	    m->b_wptr = (uint8_t *) nal_end;
+	    ms_queue_put(nalus, m);
+	    count++;
+	}
+	nal = next;
+    }
+    freemsg(frame);
+    return count;
+}
+
+/*
+ * AnnexB_split() must give the very same NAL units as the reference
+ */
+static int
+check_split(mblk_t * frame, int expected)
+{
+    MSQueue         ref,
+		    res;
+    mblk_t         *a,
+		   *b;
+    int             n,
+		    ok;
+
+    ms_queue_init(&ref);
+    ms_queue_init(&res);
+    n = split_bytewise(dupb(frame), &ref);
+    ok = n == expected && AnnexB_split(dupb(frame), &res) == n;
+    while (ok && (a = ms_queue_get(&ref)) != NULL) {
+	b = ms_queue_get(&res);
+	ok = b != NULL && a->b_rptr == b->b_rptr && a->b_wptr == b->b_wptr;
+	freemsg(a);
+	if (b != NULL)
+	    freemsg(b);
+    }
+    ms_queue_flush(&ref);
+    ms_queue_flush(&res);
+    return ok;
+}
+
+static double
+time_split(SplitFunc split, mblk_t * frame, int iterations)
+{
+    MSQueue         nalus;
+    double          t0;
+    int             i;
+
+    ms_queue_init(&nalus);
+    t0 = now_usecs();
+    for (i = 0; i < iterations; i++) {
+	split(dupb(frame), &nalus);
+	ms_queue_flush(&nalus);
+    }
+    return (now_usecs() - t0) * 1000.0 / iterations;
+}
+
+static void
+usage(const char *prog)
+{
+    fprintf(stderr,
+	    "usage: %s [options]\n"
+	    "  -n N            splits per frame and splitter (default 2000)\n",
+	    prog);
+    exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const struct {
+	const char     *name;
+	SplitFunc       split;
+    } splitters[] = {
+	{"legacy", split_legacy},
+	{"bytewise", split_bytewise},
+	{"annexb", AnnexB_split},
+    };
+    int             iterations = 2000;
+    unsigned int    i,
+		    j;
+    int             c;
+
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+	switch (c) {
+	case 'n':
+	    iterations = atoi(optarg);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (iterations <= 0)
+	usage(argv[0]);
+
+    printf("%-20s %7s %5s", "frame", "bytes", "nals");
+    for (j = 0; j < sizeof(splitters) / sizeof(splitters[0]); j++)
+	printf(" %10s(ns) %7s", splitters[j].name, "MB/s");
+    printf("\n");
+
+    for (i = 0; i < NB_CASES; i++) {
+	const FrameCase *fc = &frame_cases[i];
+	mblk_t         *frame = make_frame(fc);
+	int             len = frame->b_wptr - frame->b_rptr;
+	int             nals = fc->nslices + (fc->idr ? 2 : 0);
+
+	if (!check_split(frame, nals)) {
+	    fprintf(stderr, "nalbench: %s: AnnexB_split() result differs "
+		    "from the reference\n", fc->name);
+	    return 1;
+	}
+
+	printf("%-20s %7d %5d", fc->name, len, nals);
+	for (j = 0; j < sizeof(splitters) / sizeof(splitters[0]); j++) {
+	    double          ns = time_split(splitters[j].split, frame,
+					    iterations);
+	    printf(" %14.0f %7.0f", ns, len * 1000.0 / ns);
+	}
+	printf("\n");
+	freemsg(frame);
+    }
+
+    return 0;
+}
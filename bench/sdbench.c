@@ -0,0 +1,1070 @@
+/*
+ * sdbench - benchmark for the filters of the sdcodecdspbundle plugin.
+ *
+ * Each selected filter is instantiated on its own and driven directly
+ * (init, preprocess, one process() per input frame or packet, postprocess)
+ * as fast as it goes, so the figures measure the filter and the codec,
+ * not a ticker.  Inputs are:
+ *
+ *  - SDH264Enc: I420 frames from -y FILE (memory-mapped), or a synthetic
+ *    moving pattern;
+ *  - HJLAmrEnc, HJLG729Enc: 8 kHz 16-bit mono PCM from -p FILE
+ *    (memory-mapped), or a synthetic tone;
+ *  - decoders: the RTP payloads of an rtpdump capture given with -r, or
+ *    else the output of the matching encoder.  H.264 packets are fed one
+ *    access unit (same RTP timestamp) per process() call.
+ *
+ * For every filter it reports the process() latency percentiles, frames
+ * per second, bytes copied per frame and DSP calls per frame output, the
+ * last two taken from the SD_FILTER_GET_STATS counters of the filter.  -o json and
+ * -o csv print the same figures in a form meant to be diffed between
+ * releases.
+ *
+ * With -a N the video filters run their DSP calls on a worker thread, N
+ * frames deep (SD_FILTER_SET_ASYNC).  process() latency is then what the
+ * ticker would see; the codec time and the time the ticker still stalled
+ * on the DSP are reported besides.  Frames still in flight after the last
+ * input are drained with empty process() calls, which are not timed.
+ * Running flat out, an async encoder stalls as soon as its ring is full;
+ * -t paces process() calls at the frame rate like a real ticker would.
+ *
+ * With -z the frames fed to SDH264Enc are taken from its frame pool
+ * (SD_FILTER_GET_FRAME_POOL), as a capture filter would, so the encoder
+ * does not copy them.  -k N keeps the last N frames of a video decoder
+ * alive, as a display would, before freeing them.  -S BYTES has
+ * SDH264Enc cut frames into slices of at most BYTES
+ * (SD_FILTER_SET_SLICE_SIZE); the JSON and CSV output count the packets
+ * sent and how many of them are FU-A fragments.
+ *
+ * -P MS sets the ptime of the speech filters (MS_FILTER_ADD_FMTP), which
+ * the encoders turn into frames per DSP call: comparing codec/frm and
+ * dsp/frm with -P 10 or 20 and with -P 60 gives the per-frame cost of
+ * the DSP round trip.  AMR goes in RFC 4867 bandwidth-efficient mode,
+ * or octet-aligned mode with -A; bytes_out tells the difference.
+ *
+ * -L turns on the load shedding of SDH264Dec (SD_FILTER_SET_LOAD_SHEDDING),
+ * whose dropped pictures are counted in skipped_load.
+ *
+ * -l PERCENT drops that share of the decoder input packets, at random
+ * but the same ones from run to run, to measure how a decoder recovers
+ * from losses.  Packets keep the RTP sequence number they were captured
+ * with, so the decoder sees the gaps.
+ *
+ * -V SDH264Enc keeps an H.264 encoder busy on a thread of its own, paced
+ * at its frame rate and async with -a, while the selected filters are
+ * measured, as in a call where audio and video share the DSP.  The
+ * stall/frm of the speech filters should not follow the encode time of
+ * the video (HOSTCE_LATENCY venc=...), which is reported besides.
+ * -V SDH264Dec does the same with a decoder, fed over and over with the
+ * packets of one SDH264Enc run (HOSTCE_LATENCY vdec=...).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msticker.h"
+#include "mediastreamer2/msvideo.h"
+
+#include "sdcodecdspbundle.h"
+
+#define BENCH_VERSION           1
+#define SYNTH_VIDEO_FRAMES      8
+#define SYNTH_AUDIO_SAMPLES     8000
+#define DRAIN_TIMEOUT_USECS     5000000
+#define MAX_KEPT_FRAMES         16
+#define LOSS_SEED               4242
+
+typedef enum {
+    MEDIA_VIDEO,
+    MEDIA_AUDIO
+} BenchMedia;
+
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_JSON,
+    FORMAT_CSV
+} BenchFormat;
+
+typedef struct BenchFilter {
+    const char     *name;
+    const char     *encoder;	/* filter producing our input, if decoder */
+    BenchMedia      media;
+    int             nsamples;	/* samples per frame of speech encoders */
+} BenchFilter;
+
+static const BenchFilter bench_filters[] = {
+    {"SDH264Enc", NULL, MEDIA_VIDEO, 0},
+    {"SDH264Dec", "SDH264Enc", MEDIA_VIDEO, 0},
+    {"HJLAmrEnc", NULL, MEDIA_AUDIO, 160},
+    {"HJLAmrDec", "HJLAmrEnc", MEDIA_AUDIO, 0},
+    {"HJLG729Enc", NULL, MEDIA_AUDIO, 80},
+    {"HJLG729Dec", "HJLG729Enc", MEDIA_AUDIO, 0},
+};
+
+#define NB_FILTERS (sizeof(bench_filters) / sizeof(bench_filters[0]))
+
+/*
+ * Packets in arrival order, cut into units: the packets of one unit are
+ * handed to the filter in one process() call.
+ */
+typedef struct PacketList {
+    mblk_t        **pkts;
+    int            *unit_start;
+    int             npkts;
+    int             nunits;
+    int             cap_pkts;
+    int             cap_units;
+} PacketList;
+
+typedef struct BenchResult {
+    const char     *name;
+    int             units;
+    double         *lat;	/* usecs per process() call */
+    double          total_usecs;
+    double          setup_usecs;
+    uint64_t        bytes_out;
+    uint64_t        packets_out;
+    uint64_t        fu_a_out;	/* H.264 FU-A fragments among them */
+    SDCodecStats    stats;
+    bool_t          has_stats;
+} BenchResult;
+
+/*
+ * A video filter run on a thread of its own while the others are
+ * measured (-V) 
+ */
+typedef struct Background {
+    int             idx;	/* in bench_filters, -1: none */
+    volatile bool_t quit;
+    pthread_t       thread;
+    int             units;	/* process() calls made */
+    SDCodecStats    stats;
+    PacketList      in;		/* of a decoder, replayed in a loop */
+} Background;
+
+typedef struct Bench {
+    int             nframes;
+    MSVideoSize     vsize;
+    int             bitrate;
+    int             async;
+    bool_t          paced;
+    bool_t          zero_copy;
+    int             keep;
+    int             slice_size;
+    int             loss;	/* percent of decoder input dropped */
+    int             ptime;	/* of the speech filters, 0: default */
+    bool_t          octet_align;	/* AMR in octet-aligned mode */
+    bool_t          shed_load;	/* decoder load shedding on */
+    Background      background;
+    mblk_t         *kept[MAX_KEPT_FRAMES];
+    int             nkept;
+    const uint8_t  *yuv;
+    size_t          yuv_size;
+    const uint8_t  *pcm;
+    size_t          pcm_size;
+    const char     *rtp_file;
+    PacketList      captured[NB_FILTERS];
+    bool_t          selected[NB_FILTERS];
+    BenchResult     results[NB_FILTERS];
+    int             nresults;
+} Bench;
+
+static double
+now_usecs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+packet_list_add(PacketList * l, mblk_t * m, bool_t new_unit)
+{
+    if (l->npkts == l->cap_pkts) {
+	l->cap_pkts = l->cap_pkts ? l->cap_pkts * 2 : 256;
+	l->pkts = ms_realloc(l->pkts, l->cap_pkts * sizeof(mblk_t *));
+    }
+    if (new_unit || l->nunits == 0) {
+	if (l->nunits == l->cap_units) {
+	    l->cap_units = l->cap_units ? l->cap_units * 2 : 256;
+	    l->unit_start =
+		ms_realloc(l->unit_start, l->cap_units * sizeof(int));
+	}
+	l->unit_start[l->nunits++] = l->npkts;
+    }
+    l->pkts[l->npkts++] = m;
+}
+
+/*
+ * Add an encoder output packet, one unit per RTP timestamp 
+ */
+static void
+packet_list_capture(PacketList * l, mblk_t * m)
+{
+    /*
+     * Keep a packet in one block, as the network would deliver it, and
+     * give the encoder back the buffer it points to
+     */
+    if (m->b_cont != NULL)
+	msgpullup(m, -1);
+    mblk_set_cseq(m, (uint16_t) l->npkts);
+    packet_list_add(l, m, l->npkts == 0
+		    || mblk_get_timestamp_info(m) !=
+		    mblk_get_timestamp_info(l->pkts[l->npkts - 1]));
+}
+
+static int
+packet_list_unit_end(PacketList * l, int unit)
+{
+    return unit + 1 < l->nunits ? l->unit_start[unit + 1] : l->npkts;
+}
+
+static void
+packet_list_clear(PacketList * l)
+{
+    int             i;
+    for (i = 0; i < l->npkts; i++)
+	if (l->pkts[i])
+	    freemsg(l->pkts[i]);
+    ms_free(l->pkts);
+    ms_free(l->unit_start);
+    memset(l, 0, sizeof(*l));
+}
+
+static const uint8_t *
+map_file(const char *path, size_t * size)
+{
+    struct stat     st;
+    void           *p;
+    int             fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+	fprintf(stderr, "sdbench: cannot read %s: %s\n", path,
+		fd < 0 ? strerror(errno) : "empty file");
+	exit(1);
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "sdbench: cannot map %s: %s\n", path,
+		strerror(errno));
+	exit(1);
+    }
+    *size = st.st_size;
+    return p;
+}
+
+/*
+ * Load the RTP packets of an rtpdump (rtpplay 1.0) capture.  RTCP
+ * records and packets of another payload type than the first one are
+ * skipped.
+ */
+static void
+load_rtpdump(const char *path, PacketList * l)
+{
+    size_t          size;
+    const uint8_t  *p = map_file(path, &size);
+    const uint8_t  *end = p + size;
+    const uint8_t  *nl;
+    int             pt = -1;
+    uint32_t        last_ts = 0;
+
+    nl = memchr(p, '\n', size);
+    if (size < 12 || memcmp(p, "#!rtpplay1.0", 12) != 0 || nl == NULL
+	|| nl + 1 + 16 > end) {
+	fprintf(stderr, "sdbench: %s is not an rtpdump file\n", path);
+	exit(1);
+    }
+    p = nl + 1 + 16;		/* text line and binary file header */
+
+    while (p + 8 <= end) {
+	int             len = (p[0] << 8) | p[1];
+	int             plen = (p[2] << 8) | p[3];
+	const uint8_t  *rtp = p + 8;
+	int             hdr, padding = 0;
+	uint32_t        ts;
+	mblk_t         *m;
+
+	if (len < 8 || p + len > end)
+	    break;
+	p += len;
+	if (plen < 12 || plen > len - 8 || (rtp[0] >> 6) != 2)
+	    continue;
+	if (pt == -1)
+	    pt = rtp[1] & 0x7f;
+	if ((rtp[1] & 0x7f) != pt)
+	    continue;
+	hdr = 12 + 4 * (rtp[0] & 0x0f);
+	if ((rtp[0] & 0x10) && hdr + 4 <= plen)
+	    hdr += 4 + 4 * ((rtp[hdr + 2] << 8) | rtp[hdr + 3]);
+	if (rtp[0] & 0x20)
+	    padding = rtp[plen - 1];
+	if (hdr + padding >= plen)
+	    continue;
+
+	ts = (rtp[4] << 24) | (rtp[5] << 16) | (rtp[6] << 8) | rtp[7];
+	m = allocb(plen - hdr - padding, 0);
+	memcpy(m->b_wptr, rtp + hdr, plen - hdr - padding);
+	m->b_wptr += plen - hdr - padding;
+	mblk_set_timestamp_info(m, ts);
+	mblk_set_marker_info(m, rtp[1] >> 7);
+	mblk_set_cseq(m, (rtp[2] << 8) | rtp[3]);
+	packet_list_add(l, m, l->npkts == 0 || ts != last_ts);
+	last_ts = ts;
+    }
+    if (l->npkts == 0) {
+	fprintf(stderr, "sdbench: no RTP packet in %s\n", path);
+	exit(1);
+    }
+}
+
+static mblk_t  *
+make_video_frame(Bench * b, int i, FramePool_Handle pool)
+{
+    int             ysize = b->vsize.width * b->vsize.height;
+    int             size = ysize * 3 / 2;
+    mblk_t         *m = NULL;
+    int             x, y;
+
+    if (pool != NULL)
+	m = FramePool_getFrame(pool);
+    if (m == NULL)
+	m = allocb(size, 0);
+
+    if (b->yuv != NULL) {
+	size_t          nb = b->yuv_size / size;
+	memcpy(m->b_wptr, b->yuv + (i % nb) * size, size);
+    } else {
+	/*
+	 * A diagonal gradient moving by 4 pixels per frame, over a few
+	 * distinct frames
+	 */
+	int             shift = (i % SYNTH_VIDEO_FRAMES) * 4;
+	for (y = 0; y < b->vsize.height; y++)
+	    for (x = 0; x < b->vsize.width; x++)
+		m->b_wptr[y * b->vsize.width + x] = (x + y + shift) & 0xff;
+	memset(m->b_wptr + ysize, 128, ysize / 2);
+    }
+    m->b_wptr += size;
+    return m;
+}
+
+static mblk_t  *
+make_audio_frame(Bench * b, int i, int nsamples)
+{
+    int             size = nsamples * 2;
+    mblk_t         *m = allocb(size, 0);
+    int16_t        *s = (int16_t *) m->b_wptr;
+    int             n;
+
+    if (b->pcm != NULL) {
+	size_t          nb = b->pcm_size / size;
+	memcpy(m->b_wptr, b->pcm + (i % nb) * size, size);
+    } else {
+	for (n = 0; n < nsamples; n++) {
+	    int             t = (i * nsamples + n) % SYNTH_AUDIO_SAMPLES;
+	    s[n] = (int16_t) (8000 * sin(2 * M_PI * 440 * t / 8000.0));
+	}
+    }
+    m->b_wptr += size;
+    return m;
+}
+
+static int
+filter_index(const char *name)
+{
+    unsigned int    i;
+    for (i = 0; i < NB_FILTERS; i++)
+	if (strcasecmp(bench_filters[i].name, name) == 0)
+	    return i;
+    return -1;
+}
+
+static void     run_filter(Bench * b, int idx, BenchResult * r);
+
+/*
+ * Input packets for a decoder: the capture, or what the matching encoder
+ * produced (running it now if it was not selected).
+ */
+/*
+ * Drop b->loss percent of the packets, with a fixed seed 
+ */
+static void
+packet_list_lose(Bench * b, PacketList * l)
+{
+    unsigned int    seed = LOSS_SEED;
+    int             i;
+
+    for (i = 0; i < l->npkts; i++) {
+	if (rand_r(&seed) % 100 < (unsigned int) b->loss) {
+	    freemsg(l->pkts[i]);
+	    l->pkts[i] = NULL;
+	}
+    }
+}
+
+static void
+decoder_input(Bench * b, int idx, PacketList * in)
+{
+    int             enc = filter_index(bench_filters[idx].encoder);
+
+    if (b->rtp_file != NULL) {
+	load_rtpdump(b->rtp_file, in);
+    } else {
+	if (b->captured[enc].npkts == 0)
+	    run_filter(b, enc, NULL);
+	*in = b->captured[enc];
+	memset(&b->captured[enc], 0, sizeof(PacketList));
+    }
+    if (b->loss > 0)
+	packet_list_lose(b, in);
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    double          x = *(const double *) a,
+	y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Keep the last b->keep decoded frames, freeing the oldest one 
+ */
+static void
+keep_frame(Bench * b, mblk_t * m)
+{
+    if (b->keep == 0) {
+	freemsg(m);
+	return;
+    }
+    if (b->nkept == b->keep) {
+	freemsg(b->kept[0]);
+	memmove(b->kept, b->kept + 1, (b->keep - 1) * sizeof(mblk_t *));
+	b->nkept--;
+    }
+    b->kept[b->nkept++] = m;
+}
+
+static void
+collect_output(Bench * b, const BenchFilter * bf, MSQueue * outq,
+	       PacketList * capture, BenchResult * r)
+{
+    mblk_t         *m;
+
+    while ((m = ms_queue_get(outq)) != NULL) {
+	if (r != NULL) {
+	    r->bytes_out += msgdsize(m);
+	    r->packets_out++;
+	    if (bf->encoder == NULL && bf->media == MEDIA_VIDEO
+		&& m->b_wptr > m->b_rptr && (m->b_rptr[0] & 0x1f) == 28)
+		r->fu_a_out++;
+	}
+	if (bf->encoder == NULL)
+	    packet_list_capture(capture, m);
+	else if (bf->media == MEDIA_VIDEO)
+	    keep_frame(b, m);
+	else
+	    freemsg(m);
+    }
+}
+
+/*
+ * Run one filter over its input.  With r == NULL the run only produces
+ * the input of a decoder and is not measured.
+ */
+static void
+run_filter(Bench * b, int idx, BenchResult * r)
+{
+    const BenchFilter *bf = &bench_filters[idx];
+    PacketList      in;
+    PacketList     *capture = &b->captured[idx];
+    MSTicker        ticker;
+    MSQueue         inq,
+		    outq;
+    MSFilter       *f;
+    FramePool_Handle pool = NULL;
+    float           fps = 30;
+    double          t0,
+		    drain_end,
+		    run_start;
+    int             nunits,
+		    u,
+		    i;
+
+    memset(&in, 0, sizeof(in));
+    if (bf->encoder != NULL)
+	decoder_input(b, idx, &in);
+
+    t0 = now_usecs();
+    f = ms_filter_new_from_name(bf->name);
+    if (f == NULL) {
+	fprintf(stderr, "sdbench: filter %s is not registered\n", bf->name);
+	exit(1);
+    }
+    memset(&ticker, 0, sizeof(ticker));
+    ms_queue_init(&inq);
+    ms_queue_init(&outq);
+    f->inputs[0] = &inq;
+    f->outputs[0] = &outq;
+    f->ticker = &ticker;
+
+    if (bf->encoder == NULL && bf->media == MEDIA_VIDEO) {
+	if (b->bitrate > 0)
+	    ms_filter_call_method(f, MS_FILTER_SET_BITRATE, &b->bitrate);
+	ms_filter_call_method(f, MS_FILTER_SET_VIDEO_SIZE, &b->vsize);
+	ms_filter_call_method(f, MS_FILTER_GET_FPS, &fps);
+    }
+    if (b->async > 0 && bf->media == MEDIA_VIDEO)
+	ms_filter_call_method(f, SD_FILTER_SET_ASYNC, &b->async);
+    if (b->slice_size > 0 && bf->encoder == NULL && bf->media == MEDIA_VIDEO)
+	ms_filter_call_method(f, SD_FILTER_SET_SLICE_SIZE, &b->slice_size);
+    if (b->ptime > 0 && bf->media == MEDIA_AUDIO) {
+	char            fmtp[32];
+	snprintf(fmtp, sizeof(fmtp), "ptime=%d", b->ptime);
+	ms_filter_call_method(f, MS_FILTER_ADD_FMTP, fmtp);
+    }
+    if (b->shed_load && bf->encoder != NULL && bf->media == MEDIA_VIDEO) {
+	int             on = 1;
+	ms_filter_call_method(f, SD_FILTER_SET_LOAD_SHEDDING, &on);
+    }
+    if (b->octet_align && bf->media == MEDIA_AUDIO)
+	ms_filter_call_method(f, MS_FILTER_ADD_FMTP, "octet-align=1");
+    if (f->desc->preprocess)
+	f->desc->preprocess(f);
+    if (b->zero_copy && bf->encoder == NULL && bf->media == MEDIA_VIDEO
+	&& ms_filter_call_method(f, SD_FILTER_GET_FRAME_POOL, &pool) != 0)
+	pool = NULL;
+    if (r != NULL) {
+	r->setup_usecs = now_usecs() - t0;
+	ms_filter_call_method_noarg(f, SD_FILTER_RESET_STATS);
+    }
+
+    nunits = bf->encoder != NULL ? in.nunits : b->nframes;
+    if (r != NULL) {
+	r->name = bf->name;
+	r->lat = ms_new0(double, nunits > 0 ? nunits : 1);
+    }
+
+    run_start = now_usecs();
+    for (u = 0; u < nunits; u++) {
+	double          start,
+			lat;
+
+	if (bf->encoder != NULL) {
+	    for (i = in.unit_start[u]; i < packet_list_unit_end(&in, u);
+		 i++) {
+		if (in.pkts[i] == NULL)
+		    continue;
+		ms_queue_put(&inq, in.pkts[i]);
+		in.pkts[i] = NULL;
+	    }
+	} else if (bf->media == MEDIA_VIDEO) {
+	    ms_queue_put(&inq, make_video_frame(b, u, pool));
+	} else {
+	    ms_queue_put(&inq, make_audio_frame(b, u, bf->nsamples));
+	}
+	ticker.time = (uint64_t) (u * 1000 / fps);
+	ticker.ticks = u;
+	if (b->paced) {
+	    double          wait =
+		run_start + ticker.time * 1000.0 - now_usecs();
+	    if (wait > 0)
+		usleep((useconds_t) wait);
+	}
+
+	start = now_usecs();
+	f->desc->process(f);
+	lat = now_usecs() - start;
+
+	collect_output(b, bf, &outq, capture, r);
+	ms_queue_flush(&inq);
+
+	if (r != NULL) {
+	    r->lat[u] = lat;
+	    r->total_usecs += lat;
+	    r->units++;
+	}
+    }
+
+    /*
+     * Drain the frames an async filter still has in flight 
+     */
+    if (b->async > 0 && bf->media == MEDIA_VIDEO) {
+	int             pending;
+	drain_end = now_usecs() + DRAIN_TIMEOUT_USECS;
+	while (ms_filter_call_method(f, SD_FILTER_GET_PENDING, &pending) == 0
+	       && pending > 0 && now_usecs() < drain_end) {
+	    usleep(1000);
+	    f->desc->process(f);
+	    collect_output(b, bf, &outq, capture, r);
+	}
+    }
+
+    if (r != NULL)
+	r->has_stats =
+	    ms_filter_call_method(f, SD_FILTER_GET_STATS, &r->stats) == 0;
+    if (f->desc->postprocess)
+	f->desc->postprocess(f);
+    ms_filter_destroy(f);
+    if (pool != NULL)
+	FramePool_release(pool);
+    ms_queue_flush(&outq);
+    packet_list_clear(&in);
+    while (b->nkept > 0)
+	freemsg(b->kept[--b->nkept]);
+}
+
+/*
+ * Queue the input of the background filter for its unit-th process()
+ * call.  A decoder replays its packets from the start when it is through
+ * them, with sequence numbers and timestamps following on, so that each
+ * pass looks like the rest of the same stream.
+ */
+static void
+background_input(Bench * b, MSQueue * q, int unit)
+{
+    Background     *bg = &b->background;
+    PacketList     *in = &bg->in;
+    uint32_t        span;
+    int             pass,
+		    u,
+		    i;
+
+    if (bench_filters[bg->idx].encoder == NULL) {
+	ms_queue_put(q, make_video_frame(b, unit, NULL));
+	return;
+    }
+    pass = unit / in->nunits;
+    u = unit % in->nunits;
+    span = mblk_get_timestamp_info(in->pkts[in->npkts - 1])
+	- mblk_get_timestamp_info(in->pkts[0]) + 90000 / 30;
+    for (i = in->unit_start[u]; i < packet_list_unit_end(in, u); i++) {
+	mblk_t         *m = copymsg(in->pkts[i]);
+	mblk_set_cseq(m, (uint16_t) (pass * in->npkts + i));
+	mblk_set_timestamp_info(m, mblk_get_timestamp_info(m) + pass * span);
+	ms_queue_put(q, m);
+    }
+}
+
+/*
+ * Run the background filter until told to quit, at its frame rate 
+ */
+static void    *
+background_thread(void *arg)
+{
+    Bench          *b = (Bench *) arg;
+    Background     *bg = &b->background;
+    const BenchFilter *bf = &bench_filters[bg->idx];
+    MSTicker        ticker;
+    MSQueue         inq,
+		    outq;
+    MSFilter       *f;
+    float           fps = 30;
+    double          start,
+		    wait;
+
+    f = ms_filter_new_from_name(bf->name);
+    memset(&ticker, 0, sizeof(ticker));
+    ms_queue_init(&inq);
+    ms_queue_init(&outq);
+    f->inputs[0] = &inq;
+    f->outputs[0] = &outq;
+    f->ticker = &ticker;
+    if (bf->encoder == NULL) {
+	if (b->bitrate > 0)
+	    ms_filter_call_method(f, MS_FILTER_SET_BITRATE, &b->bitrate);
+	ms_filter_call_method(f, MS_FILTER_SET_VIDEO_SIZE, &b->vsize);
+	ms_filter_call_method(f, MS_FILTER_GET_FPS, &fps);
+    }
+    if (b->async > 0)
+	ms_filter_call_method(f, SD_FILTER_SET_ASYNC, &b->async);
+    if (f->desc->preprocess)
+	f->desc->preprocess(f);
+    ms_filter_call_method_noarg(f, SD_FILTER_RESET_STATS);
+
+    start = now_usecs();
+    for (bg->units = 0; !bg->quit; bg->units++) {
+	background_input(b, &inq, bg->units);
+	ticker.time = (uint64_t) (bg->units * 1000 / fps);
+	ticker.ticks = bg->units;
+	wait = start + ticker.time * 1000.0 - now_usecs();
+	if (wait > 0)
+	    usleep((useconds_t) wait);
+	f->desc->process(f);
+	ms_queue_flush(&inq);
+	ms_queue_flush(&outq);
+    }
+
+    ms_filter_call_method(f, SD_FILTER_GET_STATS, &bg->stats);
+    if (f->desc->postprocess)
+	f->desc->postprocess(f);
+    ms_filter_destroy(f);
+    ms_queue_flush(&outq);
+    return NULL;
+}
+
+static double
+percentile(const double *sorted, int n, double p)
+{
+    int             rank;
+    if (n == 0)
+	return 0;
+    rank = (int) ceil(p / 100.0 * n) - 1;
+    if (rank < 0)
+	rank = 0;
+    return sorted[rank];
+}
+
+static double
+per_unit(uint64_t v, int units)
+{
+    return units > 0 ? (double) v / units : 0;
+}
+
+static void
+print_results(Bench * b, BenchFormat fmt)
+{
+    const char     *profile = getenv("HOSTCE_LATENCY");
+    Background     *bg = &b->background;
+    const char     *bg_name =
+	bg->idx >= 0 ? bench_filters[bg->idx].name : "";
+    double          bg_codec = per_unit(bg->stats.codec_usecs, bg->units);
+    int             i;
+
+    if (fmt == FORMAT_JSON) {
+	printf("{\"version\":%d,\"frames\":%d,\"width\":%d,\"height\":%d,"
+	       "\"bitrate\":%d,\"loss\":%d,\"ptime\":%d,\"octet_align\":%d,"
+	       "\"input\":\"%s\",\"latency_profile\":\"%s\","
+	       "\"background\":\"%s\",\"background_units\":%d,"
+	       "\"background_codec_per_frame\":%.1f,\"filters\":[",
+	       BENCH_VERSION, b->nframes, b->vsize.width, b->vsize.height,
+	       b->bitrate, b->loss, b->ptime, b->octet_align,
+	       b->rtp_file ? "rtpdump" : (b->yuv || b->pcm) ? "file" :
+	       "synthetic", profile ? profile : "", bg_name, bg->units,
+	       bg_codec);
+    } else if (fmt == FORMAT_CSV) {
+	printf("filter,units,fps,lat_mean_us,lat_p50_us,lat_p90_us,"
+	       "lat_p99_us,lat_max_us,setup_us,frames_in,frames_out,"
+	       "bytes_out,packets_out,fu_a_out,bytes_copied,"
+	       "bytes_copied_per_frame,dsp_calls,"
+	       "dsp_calls_per_frame,codec_usecs,codec_max_usecs,"
+	       "stall_usecs,out_waits,skipped_fps,skipped_backlog,"
+	       "skipped_no_idr,first_frame_usecs,skipped_damaged,"
+	       "decode_errors,vfu_requests,skipped_load\n");
+    } else {
+	printf("%-11s %6s %9s %9s %9s %9s %9s %12s %9s %10s %10s\n",
+	       "filter", "units", "fps", "p50(us)", "p90(us)", "p99(us)",
+	       "max(us)", "copied/frm", "dsp/frm", "codec/frm", "stall/frm");
+    }
+
+    for (i = 0; i < b->nresults; i++) {
+	BenchResult    *r = &b->results[i];
+	double          fps = r->total_usecs > 0 ?
+	    r->units * 1e6 / r->total_usecs : 0;
+	double          mean = r->units > 0 ? r->total_usecs / r->units : 0;
+	double          p50,
+			p90,
+			p99,
+			max;
+	double          copied = per_unit(r->stats.bytes_copied, r->units);
+	double          calls = per_unit(r->stats.dsp_calls,
+					  (int) r->stats.frames_out);
+	double          codec = per_unit(r->stats.codec_usecs, r->units);
+	double          stall = per_unit(r->stats.stall_usecs, r->units);
+
+	qsort(r->lat, r->units, sizeof(double), compare_double);
+	p50 = percentile(r->lat, r->units, 50);
+	p90 = percentile(r->lat, r->units, 90);
+	p99 = percentile(r->lat, r->units, 99);
+	max = percentile(r->lat, r->units, 100);
+
+	if (fmt == FORMAT_JSON) {
+	    printf("%s{\"filter\":\"%s\",\"units\":%d,\"fps\":%.2f,"
+		   "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,"
+		   "\"p99\":%.1f,\"max\":%.1f},\"setup_us\":%.1f,"
+		   "\"frames_in\":%llu,\"frames_out\":%llu,"
+		   "\"bytes_out\":%llu,\"packets_out\":%llu,"
+		   "\"fu_a_out\":%llu,\"bytes_copied\":%llu,"
+		   "\"bytes_copied_per_frame\":%.1f,\"dsp_calls\":%llu,"
+		   "\"dsp_calls_per_frame\":%.3f,\"codec_usecs\":%llu,"
+		   "\"codec_max_usecs\":%llu,\"stall_usecs\":%llu,"
+		   "\"out_waits\":%llu,\"skipped_fps\":%llu,"
+		   "\"skipped_backlog\":%llu,\"skipped_no_idr\":%llu,"
+		   "\"first_frame_usecs\":%llu,\"skipped_damaged\":%llu,"
+		   "\"decode_errors\":%llu,\"vfu_requests\":%llu,"
+		   "\"skipped_load\":%llu,\"stats\":%s}",
+		   i ? "," : "", r->name, r->units, fps, mean, p50, p90,
+		   p99, max, r->setup_usecs,
+		   (unsigned long long) r->stats.frames_in,
+		   (unsigned long long) r->stats.frames_out,
+		   (unsigned long long) r->bytes_out,
+		   (unsigned long long) r->packets_out,
+		   (unsigned long long) r->fu_a_out,
+		   (unsigned long long) r->stats.bytes_copied, copied,
+		   (unsigned long long) r->stats.dsp_calls, calls,
+		   (unsigned long long) r->stats.codec_usecs,
+		   (unsigned long long) r->stats.codec_max_usecs,
+		   (unsigned long long) r->stats.stall_usecs,
+		   (unsigned long long) r->stats.out_waits,
+		   (unsigned long long) r->stats.skipped_fps,
+		   (unsigned long long) r->stats.skipped_backlog,
+		   (unsigned long long) r->stats.skipped_no_idr,
+		   (unsigned long long) r->stats.first_frame_usecs,
+		   (unsigned long long) r->stats.skipped_damaged,
+		   (unsigned long long) r->stats.decode_errors,
+		   (unsigned long long) r->stats.vfu_requests,
+		   (unsigned long long) r->stats.skipped_load,
+		   r->has_stats ? "true" : "false");
+	} else if (fmt == FORMAT_CSV) {
+	    printf("%s,%d,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%llu,%llu,"
+		   "%llu,%llu,%llu,%llu,%.1f,%llu,%.3f,%llu,%llu,%llu,%llu,"
+		   "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+		   r->name,
+		   r->units, fps, mean, p50, p90, p99, max, r->setup_usecs,
+		   (unsigned long long) r->stats.frames_in,
+		   (unsigned long long) r->stats.frames_out,
+		   (unsigned long long) r->bytes_out,
+		   (unsigned long long) r->packets_out,
+		   (unsigned long long) r->fu_a_out,
+		   (unsigned long long) r->stats.bytes_copied, copied,
+		   (unsigned long long) r->stats.dsp_calls, calls,
+		   (unsigned long long) r->stats.codec_usecs,
+		   (unsigned long long) r->stats.codec_max_usecs,
+		   (unsigned long long) r->stats.stall_usecs,
+		   (unsigned long long) r->stats.out_waits,
+		   (unsigned long long) r->stats.skipped_fps,
+		   (unsigned long long) r->stats.skipped_backlog,
+		   (unsigned long long) r->stats.skipped_no_idr,
+		   (unsigned long long) r->stats.first_frame_usecs,
+		   (unsigned long long) r->stats.skipped_damaged,
+		   (unsigned long long) r->stats.decode_errors,
+		   (unsigned long long) r->stats.vfu_requests,
+		   (unsigned long long) r->stats.skipped_load);
+	} else {
+	    printf("%-11s %6d %9.1f %9.1f %9.1f %9.1f %9.1f %12.1f %9.3f "
+		   "%10.1f %10.1f\n", r->name, r->units, fps, p50, p90, p99,
+		   max, copied, calls, codec, stall);
+	}
+    }
+    if (fmt == FORMAT_TEXT && bg->idx >= 0)
+	printf("background %s: %d frames, %.1f us codec/frm\n", bg_name,
+	       bg->units, bg_codec);
+
+    if (fmt == FORMAT_JSON)
+	printf("]}\n");
+}
+
+static void
+usage(const char *prog)
+{
+    unsigned int    i;
+
+    fprintf(stderr,
+	    "usage: %s [options]\n"
+	    "  -f NAME[,NAME]  filters to run (default: all)\n"
+	    "  -n N            frames fed to each encoder (default 300)\n"
+	    "  -s WxH          video size (default 480x320)\n"
+	    "  -b BPS          H.264 bitrate\n"
+	    "  -a N            async video codec calls, N frames deep\n"
+	    "  -t              pace process() calls at the frame rate\n"
+	    "  -z              feed SDH264Enc from its frame pool\n"
+	    "  -k N            keep the last N decoded video frames alive\n"
+	    "  -S BYTES        H.264 slices of at most BYTES\n"
+	    "  -l PERCENT      drop PERCENT of the decoder input packets\n"
+	    "  -P MS           ptime of the speech filters\n"
+	    "  -A              AMR in octet-aligned mode\n"
+	    "  -L              let SDH264Dec shed load\n"
+	    "  -V NAME         run video filter NAME meanwhile (SDH264Enc,\n"
+	    "                  SDH264Dec)\n"
+	    "  -y FILE         I420 input for SDH264Enc\n"
+	    "  -p FILE         8 kHz s16 mono PCM input for speech encoders\n"
+	    "  -r FILE         rtpdump capture for the selected decoder\n"
+	    "  -o FORMAT       text, json or csv (default text)\n"
+	    "filters:", prog);
+    for (i = 0; i < NB_FILTERS; i++)
+	fprintf(stderr, " %s", bench_filters[i].name);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+    Bench           b;
+    BenchFormat     fmt = FORMAT_TEXT;
+    const char     *filters = NULL;
+    int             ndecoders = 0;
+    unsigned int    i;
+    int             c;
+
+    memset(&b, 0, sizeof(b));
+    b.nframes = 300;
+    b.vsize = (MSVideoSize) {480, 320};
+    b.background.idx = -1;
+
+    while ((c = getopt(argc, argv, "f:n:s:b:a:tzk:S:l:P:ALV:y:p:r:o:h")) != -1) {
+	switch (c) {
+	case 'f':
+	    filters = optarg;
+	    break;
+	case 'n':
+	    b.nframes = atoi(optarg);
+	    break;
+	case 's':
+	    if (sscanf(optarg, "%dx%d", &b.vsize.width, &b.vsize.height) != 2)
+		usage(argv[0]);
+	    break;
+	case 'b':
+	    b.bitrate = atoi(optarg);
+	    break;
+	case 'a':
+	    b.async = atoi(optarg);
+	    break;
+	case 't':
+	    b.paced = TRUE;
+	    break;
+	case 'z':
+	    b.zero_copy = TRUE;
+	    break;
+	case 'k':
+	    b.keep = atoi(optarg);
+	    if (b.keep < 0 || b.keep > MAX_KEPT_FRAMES)
+		usage(argv[0]);
+	    break;
+	case 'S':
+	    b.slice_size = atoi(optarg);
+	    break;
+	case 'P':
+	    b.ptime = atoi(optarg);
+	    break;
+	case 'A':
+	    b.octet_align = TRUE;
+	    break;
+	case 'L':
+	    b.shed_load = TRUE;
+	    break;
+	case 'V':
+	    b.background.idx = filter_index(optarg);
+	    if (b.background.idx < 0
+		|| bench_filters[b.background.idx].media != MEDIA_VIDEO)
+		usage(argv[0]);
+	    break;
+	case 'l':
+	    b.loss = atoi(optarg);
+	    if (b.loss < 0 || b.loss > 100)
+		usage(argv[0]);
+	    break;
+	case 'y':
+	    b.yuv = map_file(optarg, &b.yuv_size);
+	    break;
+	case 'p':
+	    b.pcm = map_file(optarg, &b.pcm_size);
+	    break;
+	case 'r':
+	    b.rtp_file = optarg;
+	    break;
+	case 'o':
+	    if (strcmp(optarg, "json") == 0)
+		fmt = FORMAT_JSON;
+	    else if (strcmp(optarg, "csv") == 0)
+		fmt = FORMAT_CSV;
+	    else if (strcmp(optarg, "text") == 0)
+		fmt = FORMAT_TEXT;
+	    else
+		usage(argv[0]);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (b.nframes <= 0 || b.vsize.width <= 0 || b.vsize.height <= 0)
+	usage(argv[0]);
+    if (b.yuv != NULL
+	&& b.yuv_size < (size_t) b.vsize.width * b.vsize.height * 3 / 2) {
+	fprintf(stderr, "sdbench: YUV file smaller than one frame\n");
+	return 1;
+    }
+
+    if (filters == NULL) {
+	for (i = 0; i < NB_FILTERS; i++)
+	    b.selected[i] = TRUE;
+    } else {
+	char           *list = strdup(filters),
+		       *save,
+		       *tok;
+	for (tok = strtok_r(list, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+	    int             idx = filter_index(tok);
+	    if (idx < 0) {
+		fprintf(stderr, "sdbench: unknown filter %s\n", tok);
+		usage(argv[0]);
+	    }
+	    b.selected[idx] = TRUE;
+	}
+	free(list);
+    }
+    for (i = 0; i < NB_FILTERS; i++)
+	if (b.selected[i] && bench_filters[i].encoder != NULL)
+	    ndecoders++;
+    if (b.rtp_file != NULL && ndecoders != 1) {
+	fprintf(stderr, "sdbench: -r needs exactly one decoder in -f\n");
+	return 1;
+    }
+
+    ms_init();
+    libsdcodecdspbundle_init();
+
+    if (b.background.idx >= 0
+	&& bench_filters[b.background.idx].encoder != NULL) {
+	int             enc =
+	    filter_index(bench_filters[b.background.idx].encoder);
+	run_filter(&b, enc, NULL);
+	b.background.in = b.captured[enc];
+	memset(&b.captured[enc], 0, sizeof(PacketList));
+	if (b.background.in.nunits == 0) {
+	    fprintf(stderr, "sdbench: no input for the background filter\n");
+	    return 1;
+	}
+    }
+    if (b.background.idx >= 0
+	&& pthread_create(&b.background.thread, NULL, background_thread,
+			  &b) != 0) {
+	fprintf(stderr, "sdbench: cannot start the background filter\n");
+	return 1;
+    }
+
+    for (i = 0; i < NB_FILTERS; i++) {
+	if (!b.selected[i])
+	    continue;
+	run_filter(&b, i, &b.results[b.nresults]);
+	b.nresults++;
+    }
+
+    if (b.background.idx >= 0) {
+	b.background.quit = TRUE;
+	pthread_join(b.background.thread, NULL);
+	packet_list_clear(&b.background.in);
+    }
+
+    print_results(&b, fmt);
+
+    for (i = 0; i < NB_FILTERS; i++) {
+	packet_list_clear(&b.captured[i]);
+	ms_free(b.results[i].lat);
+    }
+    libsdcodecdspbundle_uninit();
+    ms_exit();
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Send side bandwidth estimation for the SDH264Enc filter.
+ *
+ * Reports come every few seconds, so each one moves the estimate a
+ * single step: the decreases are sized on what the report shows, the
+ * increase is a fixed step so that a link is probed at the same pace
+ * whatever the current rate.
+ */
+
+#include <stdint.h>
+
+#include "mediastreamer2/mscommon.h"
+
+#include "bw_estimator.h"
+
+static int
+clamp_bitrate(BwEstimator * e, int bitrate)
+{
+    if (bitrate < e->min_bitrate)
+	bitrate = e->min_bitrate;
+    if (bitrate > e->max_bitrate)
+	bitrate = e->max_bitrate;
+    return bitrate;
+}
+
+void
+BwEstimator_init(BwEstimator * e, int max_bitrate)
+{
+    e->min_bitrate = BWE_MIN_BITRATE;
+    e->max_bitrate = max_bitrate;
+    e->bitrate = clamp_bitrate(e, max_bitrate);
+    e->min_rtt = -1;
+    e->last_jitter = -1;
+    e->last_decrease = 0;
+    e->decreased = FALSE;
+}
+
+void
+BwEstimator_setMaxBitrate(BwEstimator * e, int max_bitrate)
+{
+    e->max_bitrate = max_bitrate;
+    e->bitrate = clamp_bitrate(e, e->bitrate);
+}
+
+/*
+ * Whether the report shows packets queuing up on the path 
+ */
+static bool_t
+delay_congested(BwEstimator * e, const SDReceptionReport * report)
+{
+    bool_t          congested = FALSE;
+
+    if (report->rtt_ms >= 0) {
+	if (e->min_rtt < 0 || report->rtt_ms < e->min_rtt)
+	    e->min_rtt = report->rtt_ms;
+	congested = report->rtt_ms > e->min_rtt + BWE_QUEUE_DELAY;
+    }
+    if (e->last_jitter >= 0
+	&& report->jitter_ms > e->last_jitter + BWE_JITTER_RISE)
+	congested = TRUE;
+    e->last_jitter = report->jitter_ms;
+    return congested;
+}
+
+/*
+ * Returns the new estimate, in bps 
+ */
+int
+BwEstimator_update(BwEstimator * e, const SDReceptionReport * report,
+		   uint64_t now)
+{
+    int             lost = report->fraction_lost;
+    int             bitrate = e->bitrate;
+    bool_t          congested = delay_congested(e, report);
+
+    if (lost > BWE_LOSS_HIGH) {
+	/*
+	 * rate * (1 - loss / 2) 
+	 */
+	bitrate = (int) ((int64_t) bitrate * (512 - lost) / 512);
+    } else if (congested) {
+	bitrate = bitrate * (100 - BWE_DELAY_DECREASE) / 100;
+    } else if (lost < BWE_LOSS_LOW
+	       && (!e->decreased || now - e->last_decrease >= BWE_HOLD_TIME)) {
+	bitrate += BWE_INCREASE_STEP;
+    }
+
+    if (bitrate < e->bitrate) {
+	e->last_decrease = now;
+	e->decreased = TRUE;
+    }
+    bitrate = clamp_bitrate(e, bitrate);
+    if (bitrate != e->bitrate)
+	ms_message("BwEstimator: %i bps (lost %i/256, jitter %i ms, "
+		   "rtt %i ms)", bitrate, lost, report->jitter_ms,
+		   report->rtt_ms);
+    e->bitrate = bitrate;
+    return bitrate;
+}
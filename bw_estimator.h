@@ -0,0 +1,62 @@
+/*
+ * Send side bandwidth estimation for the SDH264Enc filter.
+ *
+ * A BwEstimator turns the reception reports of the far end (RTCP RR:
+ * fraction lost, interarrival jitter, round trip time) into a target
+ * bit rate for the encoder.  It combines two signals:
+ *
+ *  - loss: above BWE_LOSS_HIGH the rate is cut in proportion to the
+ *    loss, below BWE_LOSS_LOW it grows by BWE_INCREASE_STEP per report
+ *    (additive increase, multiplicative decrease); in between it holds;
+ *  - delay: a round trip time BWE_QUEUE_DELAY ms over the lowest one
+ *    seen, or jitter rising by BWE_JITTER_RISE ms between two reports,
+ *    means packets queue up on the path.  The rate is then cut by
+ *    BWE_DELAY_DECREASE before losses show up.
+ *
+ * After a decrease the rate does not grow again for BWE_HOLD_TIME ms,
+ * so that the reports still describing the congested interval do not
+ * undo it.  The estimate stays within min_bitrate and max_bitrate, the
+ * latter being the bit rate the application asked for.
+ */
+
+#ifndef SDCODEC_BW_ESTIMATOR_H
+#define SDCODEC_BW_ESTIMATOR_H
+
+#include <stdint.h>
+
+#include "sdcodecdspbundle.h"
+
+#define BWE_MIN_BITRATE         32000
+#define BWE_LOSS_LOW            5	/* fraction lost, in 1/256 (2%) */
+#define BWE_LOSS_HIGH           26	/* 10% */
+#define BWE_INCREASE_STEP       32000	/* bps per report */
+#define BWE_DELAY_DECREASE      15	/* percent */
+#define BWE_QUEUE_DELAY         100	/* ms of round trip over the lowest */
+#define BWE_JITTER_RISE         30	/* ms */
+#define BWE_HOLD_TIME           3000	/* ms */
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct BwEstimator {
+	int             bitrate;	/* current estimate, bps */
+	int             min_bitrate;
+	int             max_bitrate;
+	int             min_rtt;	/* ms, -1 until a report has one */
+	int             last_jitter;	/* ms, -1 before the first report */
+	uint64_t        last_decrease;	/* ms */
+	bool_t          decreased;	/* last_decrease is set */
+    } BwEstimator;
+
+    void            BwEstimator_init(BwEstimator * e, int max_bitrate);
+    void            BwEstimator_setMaxBitrate(BwEstimator * e,
+					      int max_bitrate);
+    int             BwEstimator_update(BwEstimator * e,
+				       const SDReceptionReport * report,
+				       uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,347 @@
+/*
+ * Warm pool of codec instances for the sdcodecdspbundle plugin.
+ *
+ * Creating a codec costs a DSP round trip for the create itself, two more
+ * for XDM_SETPARAMS and XDM_GETBUFINFO, and several CMEM allocations.
+ * Parked instances only cost the XDM_RESET/XDM_SETPARAMS pair.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mediastreamer2/mscommon.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufTab.h>
+#include <ti/sdo/dmai/ce/Venc1.h>
+#include <ti/sdo/dmai/ce/Vdec2.h>
+#include <ti/sdo/dmai/ce/Sdec1.h>
+
+#include "Senc1.h"
+#include "engine_mgr.h"
+#include "codec_pool.h"
+
+#define CODEC_NAME_LEN          32
+#define CODEC_PARAMS_LEN        128
+
+typedef struct CodecPool_Entry {
+    Bool            used;
+    Bool            reserved;	/* by a put resetting its instance */
+    CodecPool_Type  type;
+    Char            name[CODEC_NAME_LEN];
+    Int             paramsSize;
+    UInt8           params[CODEC_PARAMS_LEN];
+    Int             dynParamsSize;
+    UInt8           dynParams[CODEC_PARAMS_LEN];
+    CodecPool_Instance inst;
+} CodecPool_Entry;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CodecPool_Entry entries[CODEC_POOL_MAX_ENTRIES];
+static Int      max_instances = -1;
+static CodecPool_Stats stats;
+
+static void
+pool_configure(void)
+{
+    const char     *env;
+
+    if (max_instances >= 0)
+	return;
+
+    max_instances = CODEC_POOL_DEFAULT_SIZE;
+    env = getenv("SDCODEC_POOL_SIZE");
+    if (env != NULL)
+	max_instances = atoi(env);
+    if (max_instances < 0)
+	max_instances = 0;
+    if (max_instances > CODEC_POOL_MAX_ENTRIES)
+	max_instances = CODEC_POOL_MAX_ENTRIES;
+    stats.maxInstances = max_instances;
+}
+
+static Int
+dyn_params_size(CodecPool_Type type, Ptr dynParams)
+{
+    if (dynParams == NULL)
+	return 0;
+    if (type == CodecPool_Type_SENC1 || type == CodecPool_Type_SDEC1)
+	return *(XDAS_Int16 *) dynParams;
+    return *(XDAS_Int32 *) dynParams;
+}
+
+/*
+ * Apply a set of dynamic params, optionally resetting the codec first.
+ * Must be called with the lock of the engine handle of the codec held.
+ */
+static Bool
+codec_control(CodecPool_Type type, Ptr hCodec, Ptr dynParams,
+	      Bool reset)
+{
+    XDAS_Int32      status = 0;
+
+    switch (type) {
+    case CodecPool_Type_VENC1:{
+	    VIDENC1_Status  st;
+	    VIDENC1_Handle  h = Venc1_getVisaHandle((Venc1_Handle) hCodec);
+	    st.size = sizeof(st);
+	    st.data.buf = NULL;
+	    if (reset)
+		status = VIDENC1_control(h, XDM_RESET, dynParams, &st);
+	    if (status == VIDENC1_EOK)
+		status = VIDENC1_control(h, XDM_SETPARAMS, dynParams, &st);
+	    return status == VIDENC1_EOK;
+	}
+    case CodecPool_Type_VDEC2:{
+	    VIDDEC2_Status  st;
+	    VIDDEC2_Handle  h = Vdec2_getVisaHandle((Vdec2_Handle) hCodec);
+	    st.size = sizeof(st);
+	    st.data.buf = NULL;
+	    if (reset)
+		status = VIDDEC2_control(h, XDM_RESET, dynParams, &st);
+	    if (status == VIDDEC2_EOK)
+		status = VIDDEC2_control(h, XDM_SETPARAMS, dynParams, &st);
+	    return status == VIDDEC2_EOK;
+	}
+    case CodecPool_Type_SENC1:{
+	    SPHENC1_Status  st;
+	    SPHENC1_Handle  h = Senc1_getVisaHandle((Senc1_Handle) hCodec);
+	    st.size = sizeof(st);
+	    st.data.buf = NULL;
+	    if (reset)
+		status = SPHENC1_control(h, XDM_RESET, dynParams, &st);
+	    if (status == SPHENC1_EOK)
+		status = SPHENC1_control(h, XDM_SETPARAMS, dynParams, &st);
+	    return status == SPHENC1_EOK;
+	}
+    case CodecPool_Type_SDEC1:{
+	    SPHDEC1_Status  st;
+	    SPHDEC1_Handle  h = Sdec1_getVisaHandle((Sdec1_Handle) hCodec);
+	    st.size = sizeof(st);
+	    st.data.buf = NULL;
+	    if (reset)
+		status = SPHDEC1_control(h, XDM_RESET, dynParams, &st);
+	    if (status == SPHDEC1_EOK)
+		status = SPHDEC1_control(h, XDM_SETPARAMS, dynParams, &st);
+	    return status == SPHDEC1_EOK;
+	}
+    }
+    return FALSE;
+}
+
+static CodecPool_Entry *
+find_entry(CodecPool_Type type, Char * name, Ptr params, Int paramsSize)
+{
+    Int             i;
+
+    for (i = 0; i < CODEC_POOL_MAX_ENTRIES; i++) {
+	CodecPool_Entry *e = &entries[i];
+	if (e->used && e->type == type && e->paramsSize == paramsSize
+	    && strcmp(e->name, name) == 0
+	    && memcmp(e->params, params, paramsSize) == 0)
+	    return e;
+    }
+    return NULL;
+}
+
+Void
+CodecPool_deleteInstance(CodecPool_Type type, CodecPool_Instance * inst)
+{
+    if (inst->hCodec) {
+	EngineMgr_lock(inst->hEngine);
+	switch (type) {
+	case CodecPool_Type_VENC1:
+	    Venc1_delete((Venc1_Handle) inst->hCodec);
+	    break;
+	case CodecPool_Type_VDEC2:
+	    Vdec2_delete((Vdec2_Handle) inst->hCodec);
+	    break;
+	case CodecPool_Type_SENC1:
+	    Senc1_delete((Senc1_Handle) inst->hCodec);
+	    break;
+	case CodecPool_Type_SDEC1:
+	    Sdec1_delete((Sdec1_Handle) inst->hCodec);
+	    break;
+	}
+	EngineMgr_unlock(inst->hEngine);
+    }
+    if (inst->hBufTab)
+	BufTab_delete(inst->hBufTab);
+    if (inst->hInBuf)
+	Buffer_delete(inst->hInBuf);
+    if (inst->hOutBuf)
+	Buffer_delete(inst->hOutBuf);
+    EngineMgr_release(inst->hEngine);
+    memset(inst, 0, sizeof(*inst));
+}
+
+Bool
+CodecPool_get(CodecPool_Type type, Char * name, Ptr params,
+	      Int paramsSize, Ptr dynParams, CodecPool_Instance * inst)
+{
+    CodecPool_Entry *e;
+    Int             dynSize = dyn_params_size(type, dynParams);
+    Bool            changed;
+    Bool            ok = TRUE;
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_configure();
+    e = find_entry(type, name, params, paramsSize);
+    if (e == NULL) {
+	stats.misses++;
+	pthread_mutex_unlock(&pool_mutex);
+	ms_message("CodecPool: miss for %s (%u hits, %u misses)", name,
+		   stats.hits, stats.misses);
+	return FALSE;
+    }
+    *inst = e->inst;
+    /*
+     * The instance was parked with the dynamic params of its previous
+     * user; only talk to the DSP if this user wants different ones.
+     */
+    changed = dynSize != e->dynParamsSize
+	|| memcmp(e->dynParams, dynParams, dynSize) != 0;
+    e->used = FALSE;
+    stats.parked--;
+    pthread_mutex_unlock(&pool_mutex);
+
+    /*
+     * The instance is out of the pool: the pool is not kept locked over
+     * the DSP round trip 
+     */
+    if (changed) {
+	EngineMgr_lock(inst->hEngine);
+	ok = codec_control(type, inst->hCodec, dynParams, FALSE);
+	EngineMgr_unlock(inst->hEngine);
+    }
+    /*
+     * An instance that cannot take the new params is no hit: the caller
+     * creates one all the same 
+     */
+    pthread_mutex_lock(&pool_mutex);
+    if (ok)
+	stats.hits++;
+    else
+	stats.misses++;
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (!ok) {
+	ms_warning("CodecPool: %s rejected new dynamic params, "
+		   "creating a fresh instance", name);
+	CodecPool_deleteInstance(type, inst);
+	return FALSE;
+    }
+    ms_message("CodecPool: hit for %s (%u hits, %u misses)", name,
+	       stats.hits, stats.misses);
+    return TRUE;
+}
+
+Void
+CodecPool_put(CodecPool_Type type, Char * name, Ptr params,
+	      Int paramsSize, Ptr dynParams, CodecPool_Instance * inst)
+{
+    CodecPool_Entry *e = NULL;
+    Int             dynSize = dyn_params_size(type, dynParams);
+    Int             i;
+    Bool            ok;
+
+    if (inst->hCodec == NULL) {
+	CodecPool_deleteInstance(type, inst);
+	return;
+    }
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_configure();
+    if (stats.parked < (UInt32) max_instances
+	&& paramsSize <= CODEC_PARAMS_LEN && dynSize <= CODEC_PARAMS_LEN
+	&& strlen(name) < CODEC_NAME_LEN) {
+	for (i = 0; i < CODEC_POOL_MAX_ENTRIES; i++) {
+	    if (!entries[i].used && !entries[i].reserved) {
+		e = &entries[i];
+		break;
+	    }
+	}
+    }
+    if (e == NULL) {
+	stats.evictions++;
+	pthread_mutex_unlock(&pool_mutex);
+	CodecPool_deleteInstance(type, inst);
+	return;
+    }
+
+    /*
+     * Hold the entry, and its place under the limit, while the codec is
+     * reset without the pool locked 
+     */
+    e->reserved = TRUE;
+    stats.parked++;
+    pthread_mutex_unlock(&pool_mutex);
+
+    EngineMgr_lock(inst->hEngine);
+    ok = codec_control(type, inst->hCodec, dynParams, TRUE);
+    EngineMgr_unlock(inst->hEngine);
+    if (ok && inst->hBufTab)
+	BufTab_freeAll(inst->hBufTab);
+
+    pthread_mutex_lock(&pool_mutex);
+    e->reserved = FALSE;
+    if (!ok) {
+	stats.parked--;
+	stats.evictions++;
+	pthread_mutex_unlock(&pool_mutex);
+	ms_warning("CodecPool: failed to reset %s, deleting it", name);
+	CodecPool_deleteInstance(type, inst);
+	return;
+    }
+    e->used = TRUE;
+    e->type = type;
+    strcpy(e->name, name);
+    e->paramsSize = paramsSize;
+    memcpy(e->params, params, paramsSize);
+    e->dynParamsSize = dynSize;
+    memcpy(e->dynParams, dynParams, dynSize);
+    e->inst = *inst;
+    pthread_mutex_unlock(&pool_mutex);
+
+    memset(inst, 0, sizeof(*inst));
+}
+
+/*
+ * Delete the parked instances, releasing their engine handles, so that
+ * the codec server is closed once no filter holds one any more 
+ */
+Void
+CodecPool_drain(Void)
+{
+    CodecPool_Entry drained[CODEC_POOL_MAX_ENTRIES];
+    Int             n = 0;
+    Int             i;
+
+    pthread_mutex_lock(&pool_mutex);
+    for (i = 0; i < CODEC_POOL_MAX_ENTRIES; i++) {
+	if (entries[i].used) {
+	    drained[n++] = entries[i];
+	    entries[i].used = FALSE;
+	    stats.parked--;
+	}
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    for (i = 0; i < n; i++)
+	CodecPool_deleteInstance(drained[i].type, &drained[i].inst);
+}
+
+Void
+CodecPool_getStats(CodecPool_Stats * s)
+{
+    pthread_mutex_lock(&pool_mutex);
+    pool_configure();
+    *s = stats;
+    pthread_mutex_unlock(&pool_mutex);
+}
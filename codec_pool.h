@@ -0,0 +1,79 @@
+/*
+ * Warm pool of codec instances for the sdcodecdspbundle plugin.
+ *
+ * Instead of deleting their codec and its CMEM buffers at the end of a
+ * call, the filters hand them to CodecPool_put().  The instance is reset
+ * (XDM_RESET then XDM_SETPARAMS) and parked, keyed by codec name and
+ * creation params.  The next CodecPool_get() with the same key returns
+ * it, so the call starts without any *_create() or Buffer_create().
+ *
+ * A codec is bound to the engine handle it was created from (see
+ * engine_mgr.h), so an instance carries its handle: CodecPool_put()
+ * takes it over with the codec, CodecPool_get() hands it to the new
+ * user, and CodecPool_deleteInstance() releases it.  CodecPool_drain()
+ * deletes the parked instances, at libsdcodecdspbundle_uninit().
+ *
+ * At most CODEC_POOL_DEFAULT_SIZE instances are parked; the
+ * SDCODEC_POOL_SIZE environment variable sets another limit, up to
+ * CODEC_POOL_MAX_ENTRIES (0 disables the pool).
+ */
+
+#ifndef SDCODEC_CODEC_POOL_H
+#define SDCODEC_CODEC_POOL_H
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufTab.h>
+
+#define CODEC_POOL_MAX_ENTRIES  8
+#define CODEC_POOL_DEFAULT_SIZE 4
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef enum {
+	CodecPool_Type_VENC1 = 0,
+	CodecPool_Type_VDEC2,
+	CodecPool_Type_SENC1,
+	CodecPool_Type_SDEC1
+    } CodecPool_Type;
+
+    /*
+     * A codec instance together with the buffers that were allocated for
+     * it.  Unused buffer fields are NULL.
+     */
+    typedef struct CodecPool_Instance {
+	Engine_Handle   hEngine;	/* the handle hCodec was created from */
+	Ptr             hCodec;	/* Venc1, Vdec2, Senc1 or Sdec1 handle */
+	Buffer_Handle   hInBuf;
+	Buffer_Handle   hOutBuf;
+	BufTab_Handle   hBufTab;
+    } CodecPool_Instance;
+
+    typedef struct CodecPool_Stats {
+	UInt32          hits;	/* instances handed out */
+	UInt32          misses;	/* none to reuse, or refused the params */
+	UInt32          parked;	/* instances currently in the pool */
+	UInt32          evictions;	/* instances deleted on put */
+	UInt32          maxInstances;
+    } CodecPool_Stats;
+
+    Bool            CodecPool_get(CodecPool_Type type, Char * name,
+				  Ptr params, Int paramsSize, Ptr dynParams,
+				  CodecPool_Instance * inst);
+    Void            CodecPool_put(CodecPool_Type type, Char * name,
+				  Ptr params, Int paramsSize, Ptr dynParams,
+				  CodecPool_Instance * inst);
+    Void            CodecPool_deleteInstance(CodecPool_Type type,
+					     CodecPool_Instance * inst);
+    Void            CodecPool_drain(Void);
+    Void            CodecPool_getStats(CodecPool_Stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
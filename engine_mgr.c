@@ -0,0 +1,229 @@
+/*
+ * Process-wide Codec Engine manager for the sdcodecdspbundle plugin.
+ *
+ * Opening "encodedecode" initializes DSP link and loads the codec server,
+ * which is by far the most expensive step of a call setup.  Every filter
+ * used to do it on its own; now the first user pays for it, and as long
+ * as that open is kept the handles of the others only cost a connection
+ * to the running server.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "mediastreamer2/mscommon.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/CERuntime.h>
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+
+#include "engine_mgr.h"
+
+/*
+ * A handle given out by EngineMgr_acquire(), with the lock of the codec
+ * using it
+ */
+typedef struct EngineMgr_User {
+    Engine_Handle   hEngine;
+    pthread_mutex_t lock;
+    struct EngineMgr_User *next;
+} EngineMgr_User;
+
+/*
+ * open_mutex serializes the opens and closes, mgr_mutex only guards the
+ * list of users and the stats, so that a lock is never held up by an
+ * Engine_open() 
+ */
+static pthread_mutex_t open_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mgr_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static Engine_Handle hSharedEngine = NULL;	/* keeps the server loaded */
+static EngineMgr_User *users = NULL;
+static bool_t   runtime_inited = FALSE;
+static EngineMgr_Stats stats;
+
+static unsigned long long
+now_usecs(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/*
+ * Called with mgr_mutex held 
+ */
+static EngineMgr_User *
+find_user(Engine_Handle hEngine)
+{
+    EngineMgr_User *u;
+
+    for (u = users; u != NULL; u = u->next)
+	if (u->hEngine == hEngine)
+	    return u;
+    return NULL;
+}
+
+/*
+ * Called with open_mutex held, once the last handle is closed 
+ */
+static void
+close_shared_engine(void)
+{
+    Engine_close(hSharedEngine);
+    hSharedEngine = NULL;
+    ms_message("Codec engine %s closed, %u opens for %u acquires",
+	       ENGINE_NAME, stats.opens, stats.acquires);
+}
+
+Engine_Handle
+EngineMgr_acquire(void)
+{
+    EngineMgr_User *u;
+    pthread_mutexattr_t attr;
+    unsigned long long elapsed;
+    bool_t          loaded;
+
+    pthread_mutex_lock(&open_mutex);
+    loaded = hSharedEngine != NULL;
+    if (!loaded) {
+	elapsed = now_usecs();
+	if (!runtime_inited) {
+	    /*
+	     * Initialize Codec Engine runtime and DMAI, once per process
+	     */
+	    CERuntime_init();
+	    Dmai_init();
+	    runtime_inited = TRUE;
+	}
+
+	hSharedEngine = Engine_open(ENGINE_NAME, NULL, NULL);
+	if (hSharedEngine == NULL) {
+	    ms_error("Failed to open codec engine %s", ENGINE_NAME);
+	    pthread_mutex_unlock(&open_mutex);
+	    return NULL;
+	}
+	elapsed = now_usecs() - elapsed;
+	pthread_mutex_lock(&mgr_mutex);
+	stats.opens++;
+	stats.openUsecs += elapsed;
+	pthread_mutex_unlock(&mgr_mutex);
+	ms_message("Codec engine %s opened in %llu us", ENGINE_NAME,
+		   elapsed);
+    }
+
+    u = (EngineMgr_User *) calloc(1, sizeof(EngineMgr_User));
+    elapsed = now_usecs();
+    if (u != NULL)
+	u->hEngine = Engine_open(ENGINE_NAME, NULL, NULL);
+    elapsed = now_usecs() - elapsed;
+    if (u == NULL || u->hEngine == NULL) {
+	ms_error("Failed to open a handle on codec engine %s", ENGINE_NAME);
+	free(u);
+	if (!loaded)
+	    close_shared_engine();
+	pthread_mutex_unlock(&open_mutex);
+	return NULL;
+    }
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&u->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_mutex_lock(&mgr_mutex);
+    u->next = users;
+    users = u;
+
+    stats.acquires++;
+    if (loaded) {
+	/*
+	 * Every acquire that finds the server loaded saves its load,
+	 * estimated by the average cost of the real ones, less the open
+	 * of its own handle.
+	 */
+	if (stats.openUsecs / stats.opens > elapsed)
+	    stats.savedUsecs += stats.openUsecs / stats.opens - elapsed;
+	ms_message("Codec engine %s shared (%u users), %llu us of setup "
+		   "saved so far", ENGINE_NAME, stats.refcount + 1,
+		   stats.savedUsecs);
+    }
+    stats.refcount++;
+    pthread_mutex_unlock(&mgr_mutex);
+    pthread_mutex_unlock(&open_mutex);
+
+    return u->hEngine;
+}
+
+void
+EngineMgr_release(Engine_Handle hEngine)
+{
+    EngineMgr_User *u,
+                  **pu;
+
+    if (hEngine == NULL)
+	return;
+
+    pthread_mutex_lock(&open_mutex);
+    pthread_mutex_lock(&mgr_mutex);
+    u = find_user(hEngine);
+    if (u == NULL) {
+	pthread_mutex_unlock(&mgr_mutex);
+	pthread_mutex_unlock(&open_mutex);
+	ms_warning("Releasing a codec engine handle not owned by "
+		   "EngineMgr");
+	return;
+    }
+    for (pu = &users; *pu != u; pu = &(*pu)->next);
+    *pu = u->next;
+    stats.refcount--;
+    pthread_mutex_unlock(&mgr_mutex);
+
+    /*
+     * The codecs of the handle are deleted, nobody locks it any more 
+     */
+    Engine_close(u->hEngine);
+    pthread_mutex_destroy(&u->lock);
+    free(u);
+
+    if (users == NULL)
+	close_shared_engine();
+    pthread_mutex_unlock(&open_mutex);
+}
+
+void
+EngineMgr_lock(Engine_Handle hEngine)
+{
+    EngineMgr_User *u;
+
+    pthread_mutex_lock(&mgr_mutex);
+    u = find_user(hEngine);
+    pthread_mutex_unlock(&mgr_mutex);
+    if (u != NULL)
+	pthread_mutex_lock(&u->lock);
+    else
+	ms_error("Locking a codec engine handle not owned by EngineMgr");
+}
+
+void
+EngineMgr_unlock(Engine_Handle hEngine)
+{
+    EngineMgr_User *u;
+
+    pthread_mutex_lock(&mgr_mutex);
+    u = find_user(hEngine);
+    pthread_mutex_unlock(&mgr_mutex);
+    if (u != NULL)
+	pthread_mutex_unlock(&u->lock);
+}
+
+void
+EngineMgr_getStats(EngineMgr_Stats * s)
+{
+    pthread_mutex_lock(&mgr_mutex);
+    *s = stats;
+    pthread_mutex_unlock(&mgr_mutex);
+}
@@ -0,0 +1,49 @@
+/*
+ * Process-wide Codec Engine manager for the sdcodecdspbundle plugin.
+ *
+ * All six filters of the bundle use the "encodedecode" engine.  The
+ * runtime (CERuntime_init/Dmai_init) is initialized once and the first
+ * EngineMgr_acquire() opens the engine, which loads the codec server;
+ * that open is kept until the last user calls EngineMgr_release(), so
+ * the server is loaded once however many filters come and go.
+ *
+ * A Codec Engine handle must not be used by two threads at the same
+ * time, so EngineMgr_acquire() also opens a handle of the caller's own,
+ * cheap once the server is loaded: each codec instance is created from
+ * and called through its own handle.  The VISA calls (create, control,
+ * process, delete) made on a codec are bracketed by EngineMgr_lock()
+ * and EngineMgr_unlock() on its handle, which only serializes the
+ * threads using that codec (the ticker and a worker); codecs of other
+ * handles run meanwhile.  The lock is recursive.
+ */
+
+#ifndef SDCODEC_ENGINE_MGR_H
+#define SDCODEC_ENGINE_MGR_H
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+
+#define ENGINE_NAME             "encodedecode"
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct EngineMgr_Stats {
+	UInt32          opens;	/* engine opens that loaded the server */
+	UInt32          acquires;	/* successful EngineMgr_acquire() calls */
+	UInt32          refcount;	/* handles currently open */
+	unsigned long long openUsecs;	/* time spent loading the server */
+	unsigned long long savedUsecs;	/* setup time saved by sharing */
+    } EngineMgr_Stats;
+
+    Engine_Handle   EngineMgr_acquire(void);
+    void            EngineMgr_release(Engine_Handle hEngine);
+    void            EngineMgr_lock(Engine_Handle hEngine);
+    void            EngineMgr_unlock(Engine_Handle hEngine);
+    void            EngineMgr_getStats(EngineMgr_Stats * stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
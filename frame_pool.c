@@ -0,0 +1,298 @@
+/*
+ * Pool of contiguous (CMEM) video frames handed out as mblk_t.
+ *
+ * The mblks are esballoc()'ed on the user pointer of a BufTab buffer.
+ * The free function only gets that pointer back, so the live pools are
+ * kept in a list and searched for the buffer; pools hold a handful of
+ * buffers and there are one or two pools per process.  The use-mask
+ * bits a frame clears when freed are kept per buffer.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufferGfx.h>
+#include <ti/sdo/dmai/BufTab.h>
+
+#include "frame_pool.h"
+
+typedef struct FramePool_Object {
+    BufTab_Handle   hBufTab;
+    Bool            ownsBufTab;
+    UInt16         *freeMasks;	/* bits cleared when a frame is freed */
+    Int             refs;	/* creator + consumers + frames held */
+    struct FramePool_Object *next;
+} FramePool_Object;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FramePool_Object *pools = NULL;
+
+/*
+ * Must be called with pool_mutex held 
+ */
+static Int
+find_buffer(void *userPtr, FramePool_Handle * phPool)
+{
+    FramePool_Object *pool;
+    Int             i;
+
+    for (pool = pools; pool != NULL; pool = pool->next) {
+	for (i = 0; i < BufTab_getNumBufs(pool->hBufTab); i++) {
+	    if ((void *) Buffer_getUserPtr(BufTab_getBuf(pool->hBufTab, i))
+		== userPtr) {
+		*phPool = pool;
+		return i;
+	    }
+	}
+    }
+    return -1;
+}
+
+/*
+ * Must be called with pool_mutex held 
+ */
+static void
+pool_unref(FramePool_Handle hPool)
+{
+    FramePool_Object **p;
+
+    if (--hPool->refs > 0)
+	return;
+
+    for (p = &pools; *p != NULL; p = &(*p)->next) {
+	if (*p == hPool) {
+	    *p = hPool->next;
+	    break;
+	}
+    }
+    if (hPool->ownsBufTab)
+	BufTab_delete(hPool->hBufTab);
+    free(hPool->freeMasks);
+    free(hPool);
+}
+
+static void
+frame_free(void *userPtr)
+{
+    FramePool_Handle hPool;
+    Int             idx;
+
+    pthread_mutex_lock(&pool_mutex);
+    idx = find_buffer(userPtr, &hPool);
+    if (idx >= 0) {
+	Buffer_freeUseMask(BufTab_getBuf(hPool->hBufTab, idx),
+			   hPool->freeMasks[idx]);
+	pool_unref(hPool);
+    } else {
+	ms_error("FramePool: freeing a frame of no pool");
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+static FramePool_Handle
+pool_new(BufTab_Handle hBufTab, Bool ownsBufTab)
+{
+    FramePool_Handle hPool;
+
+    hPool = (FramePool_Handle) calloc(1, sizeof(FramePool_Object));
+    if (hPool != NULL)
+	hPool->freeMasks = (UInt16 *) calloc(BufTab_getNumBufs(hBufTab),
+					     sizeof(UInt16));
+    if (hPool == NULL || hPool->freeMasks == NULL) {
+	ms_error("FramePool: failed to allocate pool");
+	free(hPool);
+	return NULL;
+    }
+    hPool->hBufTab = hBufTab;
+    hPool->ownsBufTab = ownsBufTab;
+    hPool->refs = 1;
+
+    pthread_mutex_lock(&pool_mutex);
+    hPool->next = pools;
+    pools = hPool;
+    pthread_mutex_unlock(&pool_mutex);
+
+    return hPool;
+}
+
+FramePool_Handle
+FramePool_create(Int numBufs, Int32 bufSize, BufferGfx_Attrs * gfxAttrs)
+{
+    FramePool_Handle hPool;
+    BufTab_Handle   hBufTab;
+    Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+
+    hBufTab = BufTab_create(numBufs, bufSize,
+			    gfxAttrs != NULL ?
+			    BufferGfx_getBufferAttrs(gfxAttrs) : &bAttrs);
+    if (hBufTab == NULL) {
+	ms_error("FramePool: failed to allocate %d frames of %ld bytes",
+		 numBufs, (long) bufSize);
+	return NULL;
+    }
+
+    hPool = pool_new(hBufTab, TRUE);
+    if (hPool == NULL)
+	BufTab_delete(hBufTab);
+    return hPool;
+}
+
+FramePool_Handle
+FramePool_createFromBufTab(BufTab_Handle hBufTab)
+{
+    return pool_new(hBufTab, FALSE);
+}
+
+/*
+ * Wrap a buffer already marked in use; freeing the mblk clears useMask 
+ */
+mblk_t         *
+FramePool_wrapBuffer(FramePool_Handle hPool, Buffer_Handle hBuf,
+		     UInt16 useMask)
+{
+    mblk_t         *m;
+    Int             i;
+
+    m = esballoc((uint8_t *) Buffer_getUserPtr(hBuf), Buffer_getSize(hBuf),
+		 0, frame_free);
+    if (m == NULL)
+	return NULL;
+    m->b_wptr += Buffer_getNumBytesUsed(hBuf);
+
+    pthread_mutex_lock(&pool_mutex);
+    for (i = 0; i < BufTab_getNumBufs(hPool->hBufTab); i++)
+	if (BufTab_getBuf(hPool->hBufTab, i) == hBuf)
+	    hPool->freeMasks[i] = useMask;
+    hPool->refs++;
+    pthread_mutex_unlock(&pool_mutex);
+
+    return m;
+}
+
+mblk_t         *
+FramePool_getFrame(FramePool_Handle hPool)
+{
+    Buffer_Handle   hBuf;
+    mblk_t         *m;
+
+    hBuf = FramePool_getFreeBuf(hPool);
+    if (hBuf == NULL)
+	return NULL;
+
+    if (Buffer_getType(hBuf) == Buffer_Type_GRAPHICS)
+	BufferGfx_resetDimensions(hBuf);
+    Buffer_setNumBytesUsed(hBuf, 0);
+    m = FramePool_wrapBuffer(hPool, hBuf, 0xffff);
+    if (m == NULL)
+	FramePool_freeUseMask(hPool, hBuf, 0xffff);
+    return m;
+}
+
+Buffer_Handle
+FramePool_getBuffer(mblk_t * m)
+{
+    FramePool_Handle hPool;
+    Buffer_Handle   hBuf = NULL;
+    Int             idx;
+
+    /*
+     * Only a single block starting at the beginning of the buffer can be
+     * handed to the codec as is
+     */
+    if (m->b_datap->db_freefn != frame_free || m->b_cont != NULL
+	|| m->b_rptr != m->b_datap->db_base)
+	return NULL;
+
+    pthread_mutex_lock(&pool_mutex);
+    idx = find_buffer(m->b_rptr, &hPool);
+    if (idx >= 0)
+	hBuf = BufTab_getBuf(hPool->hBufTab, idx);
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (hBuf != NULL)
+	Buffer_setNumBytesUsed(hBuf, m->b_wptr - m->b_rptr);
+    return hBuf;
+}
+
+Buffer_Handle
+FramePool_getFreeBuf(FramePool_Handle hPool)
+{
+    Buffer_Handle   hBuf;
+
+    pthread_mutex_lock(&pool_mutex);
+    hBuf = BufTab_getFreeBuf(hPool->hBufTab);
+    pthread_mutex_unlock(&pool_mutex);
+
+    return hBuf;
+}
+
+Void
+FramePool_freeUseMask(FramePool_Handle hPool, Buffer_Handle hBuf,
+		      UInt16 useMask)
+{
+    pthread_mutex_lock(&pool_mutex);
+    Buffer_freeUseMask(hBuf, useMask);
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+/*
+ * References besides the creator's; a decoder's pool is never handed out,
+ * so these are the frames still held downstream 
+ */
+Int
+FramePool_getNumHeld(FramePool_Handle hPool)
+{
+    Int             held;
+
+    pthread_mutex_lock(&pool_mutex);
+    held = hPool->refs - 1;
+    pthread_mutex_unlock(&pool_mutex);
+
+    return held;
+}
+
+/*
+ * The BufTab is deleted with the pool, once the last frame is freed 
+ */
+Void
+FramePool_adoptBufTab(FramePool_Handle hPool)
+{
+    pthread_mutex_lock(&pool_mutex);
+    hPool->ownsBufTab = TRUE;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+/*
+ * Take a reference for a consumer, dropped by FramePool_release() 
+ */
+Void
+FramePool_retain(FramePool_Handle hPool)
+{
+    pthread_mutex_lock(&pool_mutex);
+    hPool->refs++;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void
+FramePool_release(FramePool_Handle hPool)
+{
+    FramePool_delete(hPool);
+}
+
+Void
+FramePool_delete(FramePool_Handle hPool)
+{
+    if (hPool == NULL)
+	return;
+
+    pthread_mutex_lock(&pool_mutex);
+    pool_unref(hPool);
+    pthread_mutex_unlock(&pool_mutex);
+}
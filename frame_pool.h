@@ -0,0 +1,58 @@
+/*
+ * Pool of contiguous (CMEM) video frames handed out as mblk_t.
+ *
+ * FramePool_getFrame() wraps a free buffer of the pool's BufTab with
+ * esballoc(); freeing the last reference of the mblk gives the buffer
+ * back to the pool, from any thread.  A filter that receives such a
+ * frame gets its DMAI buffer with FramePool_getBuffer() and can pass it
+ * to the DSP as is instead of copying the data.  Without gfxAttrs,
+ * FramePool_create() makes a pool of plain buffers, for instance for
+ * the DSP to write coded speech to.
+ *
+ * A pool can also be laid over the BufTab of a decoder
+ * (FramePool_createFromBufTab()): FramePool_wrapBuffer() then sends a
+ * display buffer downstream as a mblk that clears its use-mask bits when
+ * freed.  Everybody touching the use-masks of such a BufTab must go
+ * through FramePool_getFreeBuf() and FramePool_freeUseMask(), which
+ * serialize with the frees coming from other threads.
+ *
+ * FramePool_delete() only drops the creator's reference: the pool goes
+ * away once the frames still held downstream are freed as well.  A pool
+ * handed to another filter is given with FramePool_retain(), and that
+ * reference is dropped by FramePool_release() (see sdcodecdspbundle.h),
+ * so the pool outlives its creator for as long as its consumer uses it.
+ */
+
+#ifndef SDCODEC_FRAME_POOL_H
+#define SDCODEC_FRAME_POOL_H
+
+#include <xdc/std.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufferGfx.h>
+#include <ti/sdo/dmai/BufTab.h>
+
+#include "sdcodecdspbundle.h"
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    FramePool_Handle FramePool_create(Int numBufs, Int32 bufSize,
+				      BufferGfx_Attrs * gfxAttrs);
+    FramePool_Handle FramePool_createFromBufTab(BufTab_Handle hBufTab);
+    Buffer_Handle   FramePool_getBuffer(mblk_t * m);
+    Buffer_Handle   FramePool_getFreeBuf(FramePool_Handle hPool);
+    Void            FramePool_freeUseMask(FramePool_Handle hPool,
+					  Buffer_Handle hBuf, UInt16 useMask);
+    mblk_t         *FramePool_wrapBuffer(FramePool_Handle hPool,
+					 Buffer_Handle hBuf, UInt16 useMask);
+    Int             FramePool_getNumHeld(FramePool_Handle hPool);
+    Void            FramePool_retain(FramePool_Handle hPool);
+    Void            FramePool_adoptBufTab(FramePool_Handle hPool);
+    Void            FramePool_delete(FramePool_Handle hPool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
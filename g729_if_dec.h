@@ -25,6 +25,12 @@ extern          "C" {
     void            G729_Decoder_Interface_Decode(void *state,
 					     const unsigned char *in,
 					     short *out, int bfi);
+    int             G729_Decoder_Interface_DecodeFrames(void *state,
+							const unsigned char
+							*toc,
+							const unsigned char
+							*data, int nframes,
+							short *out);
 
 #ifdef __cplusplus
 }
@@ -16,6 +16,15 @@
 #ifndef SUDA_G729AB_INTERF_ENC_H
 #define SUDA_G729AB_INTERF_ENC_H
 
+#include <xdc/std.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+
+/*
+ * Most frames one G729_Encoder_Interface_EncodeFrames() call takes 
+ */
+#define G729_MAX_FRAMES_PER_CALL 10
+
 #ifdef __cplusplus
 extern          "C" {
 #endif
@@ -26,6 +35,15 @@ extern          "C" {
     int             G729_Encoder_Interface_Encode(void *state,
 					     const short *speech,
 					     unsigned char *out);
+    int             G729_Encoder_Interface_setFrames(void *state, int nframes);
+    int             G729_Encoder_Interface_EncodeFrames(void *state,
+						   const short *speech,
+						   int nframes,
+						   unsigned char *out);
+    unsigned char  *G729_Encoder_Interface_getInBuf(void *state);
+    int             G729_Encoder_Interface_EncodeInBuf(void *state, int nframes,
+						       Buffer_Handle hOutBuf,
+						       unsigned char *out);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,233 @@
+/*
+ * H.264 sequence parameter set parsing for the SDH264Dec filter.
+ *
+ * Syntax of H.264 7.3.2.1.1, up to frame_crop_bottom_offset.  The bit
+ * reader drops the emulation prevention bytes as it goes and never
+ * reads past the end of the NAL unit: a truncated SPS sets the overrun
+ * flag and is rejected at the end instead of being checked field by
+ * field.
+ */
+
+#include <stdint.h>
+
+#include "mediastreamer2/mscommon.h"
+
+#include "h264_sps.h"
+
+typedef struct BitReader {
+    const uint8_t  *p;
+    const uint8_t  *end;
+    int             zeros;	/* zero bytes just read */
+    uint32_t        cache;	/* bits not read yet of the current byte */
+    int             left;	/* how many */
+    bool_t          overrun;
+} BitReader;
+
+static int
+br_get_bit(BitReader * br)
+{
+    if (br->left == 0) {
+	if (br->p >= br->end) {
+	    br->overrun = TRUE;
+	    return 0;
+	}
+	if (br->zeros >= 2 && *br->p == 3) {
+	    /*
+	     * emulation_prevention_three_byte 
+	     */
+	    br->zeros = 0;
+	    if (++br->p >= br->end) {
+		br->overrun = TRUE;
+		return 0;
+	    }
+	}
+	br->zeros = *br->p == 0 ? br->zeros + 1 : 0;
+	br->cache = *br->p++;
+	br->left = 8;
+    }
+    br->left--;
+    return (br->cache >> br->left) & 1;
+}
+
+static uint32_t
+br_get_bits(BitReader * br, int n)
+{
+    uint32_t        v = 0;
+
+    while (n-- > 0)
+	v = (v << 1) | br_get_bit(br);
+    return v;
+}
+
+/*
+ * ue(v), 9.1.  Codes over 32 bits are not valid in an SPS.
+ */
+static uint32_t
+br_get_ue(BitReader * br)
+{
+    int             zeros = 0;
+
+    while (br_get_bit(br) == 0) {
+	if (br->overrun || ++zeros > 31) {
+	    br->overrun = TRUE;
+	    return 0;
+	}
+    }
+    return ((1U << zeros) - 1) + br_get_bits(br, zeros);
+}
+
+static int32_t
+br_get_se(BitReader * br)
+{
+    uint32_t        v = br_get_ue(br);
+
+    return (v & 1) ? (int32_t) ((v + 1) / 2) : -(int32_t) (v / 2);
+}
+
+/*
+ * scaling_list(), 7.3.2.1.1.1: only the bits are skipped 
+ */
+static void
+skip_scaling_list(BitReader * br, int size)
+{
+    int             last = 8,
+		    next = 8,
+		    i;
+
+    for (i = 0; i < size && !br->overrun; i++) {
+	if (next != 0) {
+	    next = (last + br_get_se(br) + 256) % 256;
+	    if (next != 0)
+		last = next;
+	}
+    }
+}
+
+static bool_t
+has_chroma_info(int profile_idc)
+{
+    switch (profile_idc) {
+    case 100:
+    case 110:
+    case 122:
+    case 244:
+    case 44:
+    case 83:
+    case 86:
+    case 118:
+    case 128:
+    case 138:
+    case 139:
+    case 134:
+    case 135:
+	return TRUE;
+    default:
+	return FALSE;
+    }
+}
+
+bool_t
+H264Sps_parse(const uint8_t * nalu, int len, H264Sps * sps)
+{
+    BitReader       br = { nalu + 1, nalu + len, 0, 0, 0, FALSE };
+    uint32_t        width_mbs,
+		    height_units,
+		    n,
+		    i;
+    bool_t          frame_mbs_only;
+    int             crop_x = 1,
+		    crop_y = 1;
+    uint32_t        crop_left = 0,
+		    crop_right = 0,
+		    crop_top = 0,
+		    crop_bottom = 0;
+
+    if (len < 4 || (nalu[0] & 0x1f) != 7)
+	return FALSE;
+
+    sps->profile_idc = br_get_bits(&br, 8);
+    br_get_bits(&br, 8);	/* constraint_set flags */
+    sps->level_idc = br_get_bits(&br, 8);
+    br_get_ue(&br);		/* seq_parameter_set_id */
+
+    sps->chroma_format_idc = 1;
+    if (has_chroma_info(sps->profile_idc)) {
+	sps->chroma_format_idc = br_get_ue(&br);
+	if (sps->chroma_format_idc > 3)
+	    return FALSE;
+	if (sps->chroma_format_idc == 3)
+	    br_get_bit(&br);	/* separate_colour_plane_flag */
+	br_get_ue(&br);		/* bit_depth_luma_minus8 */
+	br_get_ue(&br);		/* bit_depth_chroma_minus8 */
+	br_get_bit(&br);	/* qpprime_y_zero_transform_bypass_flag */
+	if (br_get_bit(&br)) {	/* seq_scaling_matrix_present_flag */
+	    n = sps->chroma_format_idc == 3 ? 12 : 8;
+	    for (i = 0; i < n; i++)
+		if (br_get_bit(&br))
+		    skip_scaling_list(&br, i < 6 ? 16 : 64);
+	}
+    }
+
+    br_get_ue(&br);		/* log2_max_frame_num_minus4 */
+    switch (br_get_ue(&br)) {	/* pic_order_cnt_type */
+    case 0:
+	br_get_ue(&br);		/* log2_max_pic_order_cnt_lsb_minus4 */
+	break;
+    case 1:
+	br_get_bit(&br);	/* delta_pic_order_always_zero_flag */
+	br_get_se(&br);		/* offset_for_non_ref_pic */
+	br_get_se(&br);		/* offset_for_top_to_bottom_field */
+	n = br_get_ue(&br);
+	if (n > 255)
+	    return FALSE;
+	for (i = 0; i < n; i++)
+	    br_get_se(&br);	/* offset_for_ref_frame */
+	break;
+    case 2:
+	break;
+    default:
+	return FALSE;
+    }
+
+    sps->max_num_ref_frames = br_get_ue(&br);
+    br_get_bit(&br);		/* gaps_in_frame_num_value_allowed_flag */
+    width_mbs = br_get_ue(&br) + 1;
+    height_units = br_get_ue(&br) + 1;
+    frame_mbs_only = br_get_bit(&br);
+    if (!frame_mbs_only)
+	br_get_bit(&br);	/* mb_adaptive_frame_field_flag */
+    br_get_bit(&br);		/* direct_8x8_inference_flag */
+    if (br_get_bit(&br)) {	/* frame_cropping_flag */
+	crop_left = br_get_ue(&br);
+	crop_right = br_get_ue(&br);
+	crop_top = br_get_ue(&br);
+	crop_bottom = br_get_ue(&br);
+    }
+    if (br.overrun)
+	return FALSE;
+
+    /*
+     * Cropping units, 7.4.2.1.1 
+     */
+    if (sps->chroma_format_idc == 1 || sps->chroma_format_idc == 2)
+	crop_x = 2;
+    if (sps->chroma_format_idc == 1)
+	crop_y = 2;
+    crop_y *= 2 - frame_mbs_only;
+
+    if (sps->max_num_ref_frames > 16 || width_mbs > H264_SPS_MAX_MBS
+	|| height_units > H264_SPS_MAX_MBS
+	|| width_mbs * height_units * (2 - frame_mbs_only) >
+	H264_SPS_MAX_MBS)
+	return FALSE;
+    sps->coded_width = width_mbs * 16;
+    sps->coded_height = height_units * (2 - frame_mbs_only) * 16;
+    if (((uint64_t) crop_left + crop_right) * crop_x >=
+	(uint64_t) sps->coded_width
+	|| ((uint64_t) crop_top + crop_bottom) * crop_y >=
+	(uint64_t) sps->coded_height)
+	return FALSE;
+    sps->width = sps->coded_width - (crop_left + crop_right) * crop_x;
+    sps->height = sps->coded_height - (crop_top + crop_bottom) * crop_y;
+    return TRUE;
+}
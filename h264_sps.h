@@ -0,0 +1,44 @@
+/*
+ * H.264 sequence parameter set parsing for the SDH264Dec filter.
+ *
+ * H264Sps_parse() reads, out of an SPS NAL unit (header byte included,
+ * emulation prevention bytes still in), what the decoder needs to be
+ * sized for the stream: profile and level, the coded size in
+ * macroblocks, the frame cropping that gives the displayed size, and
+ * max_num_ref_frames.  It stops right after the cropping fields, so
+ * the VUI is never looked at.  It returns FALSE for anything that is
+ * not a well formed SPS, or that describes a size no decoder of the
+ * bundle could take.
+ */
+
+#ifndef SDCODEC_H264_SPS_H
+#define SDCODEC_H264_SPS_H
+
+#include <stdint.h>
+
+#include "mediastreamer2/mscommon.h"
+
+#define H264_SPS_MAX_MBS        8192	/* macroblocks, 1080p is 8160 */
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct H264Sps {
+	int             profile_idc;
+	int             level_idc;
+	int             chroma_format_idc;
+	int             max_num_ref_frames;
+	int             coded_width;	/* in pixels, whole macroblocks */
+	int             coded_height;
+	int             width;	/* displayed, after cropping */
+	int             height;
+    } H264Sps;
+
+    bool_t          H264Sps_parse(const uint8_t * nalu, int len,
+				  H264Sps * sps);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
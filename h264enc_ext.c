@@ -0,0 +1,86 @@
+/*
+ * Extended dynamic params of the DSP H.264 encoder.
+ *
+ * Both the ticker (synchronous encode) and the encode worker set params
+ * through here, right before the frame they apply to.
+ */
+
+#include "mediastreamer2/mscommon.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/ce/Venc1.h>
+
+#include "engine_mgr.h"
+#include "h264enc_ext.h"
+
+/*
+ * Macroblock rows that make slices of about sliceBytes, at least one, for
+ * a frame of the average size at the target rate.  Bigger frames, IDRs
+ * first of all, make bigger slices, which the packer sends as FU-A.
+ */
+static XDAS_Int32
+slice_rows(VIDENC1_DynamicParams * dynParams, XDAS_Int32 sliceBytes)
+{
+    long long       frameBytes;
+    XDAS_Int32      mbRows = (dynParams->inputHeight + 15) / 16;
+    XDAS_Int32      rows;
+
+    if (dynParams->targetBitRate <= 0 || dynParams->targetFrameRate <= 0)
+	return 1;
+    frameBytes = (long long) dynParams->targetBitRate * 1000
+	/ dynParams->targetFrameRate / 8;
+    rows = frameBytes > 0 ? (XDAS_Int32) (sliceBytes * mbRows / frameBytes)
+	: mbRows;
+    if (rows < 1)
+	rows = 1;
+    return rows < mbRows ? rows : mbRows;
+}
+
+static XDAS_Int32
+set_params(Engine_Handle hEngine, Venc1_Handle hVe1,
+	   VIDENC1_DynamicParams * dynParams)
+{
+    VIDENC1_Status  encStatus;
+    XDAS_Int32      status;
+
+    encStatus.size = sizeof(VIDENC1_Status);
+    encStatus.data.buf = NULL;
+    EngineMgr_lock(hEngine);
+    status = VIDENC1_control(Venc1_getVisaHandle(hVe1), XDM_SETPARAMS,
+			     dynParams, &encStatus);
+    EngineMgr_unlock(hEngine);
+    return status;
+}
+
+Bool
+H264Enc_setDynamicParams(Engine_Handle hEngine, Venc1_Handle hVe1,
+			 VIDENC1_DynamicParams * dynParams,
+			 XDAS_Int32 sliceBytes)
+{
+    IH264VENC_DynamicParams extParams = IH264VENC_DYNAMICPARAMS;
+    XDAS_Int32      status;
+
+    /*
+     * Without a slice budget the codec gets the plain VIDENC1 params, as
+     * it did before slices were supported 
+     */
+    if (sliceBytes > 0) {
+	extParams.videncDynamicParams = *dynParams;
+	extParams.videncDynamicParams.size = sizeof(IH264VENC_DynamicParams);
+	extParams.sliceSize = slice_rows(dynParams, sliceBytes);
+	status = set_params(hEngine, hVe1, &extParams.videncDynamicParams);
+	if (status == VIDENC1_EOK)
+	    return TRUE;
+	ms_warning("H.264 encoder refused %i bytes slices: %i",
+		   (int) sliceBytes, (int) status);
+    }
+
+    status = set_params(hEngine, hVe1, dynParams);
+    if (status != VIDENC1_EOK)
+	ms_error("Failed to set the encoder params: %i", (int) status);
+    return sliceBytes <= 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Slice control of the DSP H.264 encoder.
+ *
+ * The "h264enc" codec of the server takes, besides the VIDENC1 base
+ * params, the IH264VENC_DynamicParams extension of its package's
+ * ih264venc.h, told apart by its size field.  The codec limits slices
+ * by macroblock rows, not bytes: the plugin only sets sliceSize, from
+ * the byte budget and the average frame size, and leaves every other
+ * field of the extension at the package defaults (IH264VENC_DYNAMICPARAMS).
+ *
+ * H264Enc_setDynamicParams() sends the base params with XDM_SETPARAMS,
+ * extended with the slice size when a byte budget is given.  A codec
+ * that does not take the extension rejects it; the base params are then
+ * set alone and the call returns FALSE, so the caller can go back to one
+ * slice per frame.
+ */
+
+#ifndef SDCODEC_H264ENC_EXT_H
+#define SDCODEC_H264ENC_EXT_H
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video1/videnc1.h>
+#include <ti/sdo/dmai/ce/Venc1.h>
+
+#include <h264enc/ih264venc.h>
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    Bool            H264Enc_setDynamicParams(Engine_Handle hEngine,
+					     Venc1_Handle hVe1,
+					     VIDENC1_DynamicParams *
+					     dynParams,
+					     XDAS_Int32 sliceBytes);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
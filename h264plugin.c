@@ -4,6 +4,7 @@
  * 
  */
 #include <stdio.h>
+#include <sys/time.h>
 
 #include "mediastreamer2/msfilter.h"
 #include "mediastreamer2/msticker.h"
@@ -14,7 +15,6 @@
 
 #include <xdc/std.h>
 
-#include <ti/sdo/ce/CERuntime.h>
 #include <ti/sdo/ce/Engine.h>
 #include <ti/sdo/ce/osal/Memory.h>
 
@@ -23,25 +23,88 @@
 #include <ti/sdo/dmai/ce/Venc1.h>
 #include <ti/sdo/dmai/ce/Vdec2.h>
 
+#include "sdcodecdspbundle.h"
+#include "engine_mgr.h"
+#include "codec_pool.h"
+#include "venc_worker.h"
+#include "vdec_worker.h"
+#include "frame_pool.h"
+#include "annexb.h"
+#include "h264enc_ext.h"
+#include "bw_estimator.h"
+#include "h264_sps.h"
+
 #define VERSION                 "0.2"
-#define ENGINE_NAME             "encodedecode"
-#define DISPLAY_PIPE_SIZE       5
+#define DEC_DISPLAY_BUFS        3	/* decoded frames held downstream */
+#define DEC_MB_BYTES            400	/* coded macroblock, worst case */
+#define DEC_HEADER_BYTES        4096	/* parameter sets, slice headers */
+#define DEC_VFU_INTERVAL        1000	/* ms between VFUs while waiting */
+#define DEC_MAX_DAMAGED         4	/* pictures known to miss packets */
+#define DEC_SHED_BACKLOG        3	/* pictures queued to start shedding */
+#define DEC_SHED_FLUSH          8	/* pictures queued to skip to an IDR */
+#define DEC_SHED_LOAD           90	/* % of the frame interval decoding */
+#define DEC_SHED_RELAX          70	/* % under which shedding can stop */
+#define DEC_SHED_HOLD           1000	/* ms of low load before it stops */
+#define ENC_FRAME_POOL_SIZE     6
+#define ENC_MAX_BITRATE         2000000
+#define ENC_VFU_MIN_INTERVAL    1000	/* ms between IDRs sent on request */
+#define ENC_LOW_RES_BITRATE     96000	/* estimate to ask for half size */
+#define ENC_FULL_RES_BITRATE    192000	/* and to go back to full size */
 
 typedef struct _EncData {
     Engine_Handle   hEngine;
     Venc1_Handle    hVe1;
     Buffer_Handle   hVidBuf;
     Buffer_Handle   hEncBuf;
+    VIDENC1_Params  params;
+    VIDENC1_DynamicParams dynParams;
     MSVideoSize     vsize;
     int             bitrate;
     float           fps;
+    float           max_fps;	/* MS_FILTER_SET_FPS, 0: not set */
     int             mode;
+    int             slice_bytes;	/* slice budget asked for, 0: none */
+    mblk_t         *sps;	/* last parameter sets of the encoder */
+    mblk_t         *pps;
+    bool_t          send_param_sets;	/* before the next slice */
+    XDAS_Int32      cur_slice_bytes;	/* slice budget the encoder has */
     uint64_t        framenum;
     Rfc3984Context  packer;
-    int             keyframe_int;
-    bool_t          generate_keyframe;
+    int             keyframe_int;	/* seconds between IDRs, 0 for none */
+    bool_t          generate_keyframe;	/* VFU requested */
+    bool_t          first_frame;	/* next frame is the encoder's first */
+    uint64_t        last_idr_time;	/* ticker time of the last IDR */
+    bool_t          governing;	/* next_frame_time is set */
+    int64_t         next_frame_time;	/* usecs, see enc_govern_input() */
+    int             async;	/* pipeline depth, < 2 for synchronous */
+    VencWorker_Handle hWorker;
+    Buffer_Handle   hVidBufs[VENC_WORKER_MAX_SLOTS];
+    Buffer_Handle   hEncBufs[VENC_WORKER_MAX_SLOTS];
+    int             pending;	/* frames submitted, not packetized yet */
+    FramePool_Handle hFramePool;	/* zero-copy input frames */
+    bool_t          adapting;	/* bwe follows reception reports */
+    BwEstimator     bwe;
+    MSVideoSize     full_vsize;	/* video size when adapting started */
+    bool_t          low_res;	/* half of it was asked for */
+    SDCodecStats    stats;
 } EncData;
 
+static unsigned long long
+now_usecs(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void
+account_codec_time(SDCodecStats * stats, unsigned long long usecs)
+{
+    stats->codec_usecs += usecs;
+    if (usecs > stats->codec_max_usecs)
+	stats->codec_max_usecs = usecs;
+}
+
 
 static void
 enc_init(MSFilter * f)
@@ -55,10 +118,29 @@ enc_init(MSFilter * f)
     // d->vsize = MS_VIDEO_SIZE_CIF;
     d->vsize = (MSVideoSize) {480, 320};
     d->fps = 30;
+    d->max_fps = 0;
     d->keyframe_int = 10;	/* 10 seconds */
     d->mode = 0;
+    d->slice_bytes = 0;
+    d->cur_slice_bytes = 0;
+    d->sps = NULL;
+    d->pps = NULL;
+    d->send_param_sets = FALSE;
     d->framenum = 0;
     d->generate_keyframe = FALSE;
+    d->first_frame = TRUE;
+    d->last_idr_time = 0;
+    d->governing = FALSE;
+    d->next_frame_time = 0;
+    d->async = 0;
+    d->hWorker = NULL;
+    d->pending = 0;
+    d->hFramePool = NULL;
+    d->adapting = FALSE;
+    d->low_res = FALSE;
+    memset(d->hVidBufs, 0, sizeof(d->hVidBufs));
+    memset(d->hEncBufs, 0, sizeof(d->hEncBufs));
+    memset(&d->stats, 0, sizeof(d->stats));
     f->data = d;
 }
 
@@ -67,58 +149,147 @@ enc_uninit(MSFilter * f)
 {
     EncData        *d = (EncData *) f->data;
 
+    FramePool_delete(d->hFramePool);
+    if (d->sps != NULL)
+	freemsg(d->sps);
+    if (d->pps != NULL)
+	freemsg(d->pps);
     ms_free(d);
 }
 
+/*
+ * Slot 0 of the worker uses the encoder's own buffers, the others get
+ * buffers of the same size.  Falls back to synchronous encoding if
+ * anything fails.
+ */
 static void
-enc_preprocess(MSFilter * f)
+enc_start_worker(EncData * d)
 {
-    EncData        *d = (EncData *) f->data;
-    VIDENC1_Params  defaultEncParams = Venc1_Params_DEFAULT;
-    VIDENC1_DynamicParams defaultEncDynParams =
-	Venc1_DynamicParams_DEFAULT;
-    VIDENC1_Params *encParams;
-    VIDENC1_DynamicParams *encDynParams;
     BufferGfx_Attrs gfxAttrs = BufferGfx_Attrs_DEFAULT;
     Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
-    Int32           bufSize;
+    int             i;
 
-    bool_t          cleanUpQ = FALSE;
+    if (d->async < 2 || d->hVe1 == NULL)
+	return;
 
-    rfc3984_init(&d->packer);
-    rfc3984_set_mode(&d->packer, d->mode);
-    rfc3984_enable_stap_a(&d->packer, FALSE);
+    gfxAttrs.colorSpace = ColorSpace_YUV420P;
+    gfxAttrs.dim.width = d->vsize.width;
+    gfxAttrs.dim.height = d->vsize.height;
+    gfxAttrs.dim.lineLength = BufferGfx_calcLineLength(gfxAttrs.dim.width,
+						       gfxAttrs.
+						       colorSpace);
 
-    /*
-     * Initialize Codec Engine runtime 
-     */
-    CERuntime_init();
+    d->hVidBufs[0] = d->hVidBuf;
+    d->hEncBufs[0] = d->hEncBuf;
+    for (i = 1; i < d->async; i++) {
+	d->hVidBufs[i] = Buffer_create(Buffer_getSize(d->hVidBuf),
+				       BufferGfx_getBufferAttrs(&gfxAttrs));
+	d->hEncBufs[i] = Buffer_create(Buffer_getSize(d->hEncBuf), &bAttrs);
+	if (d->hVidBufs[i] == NULL || d->hEncBufs[i] == NULL)
+	    break;
+    }
 
-    /*
-     * Initialize Davinci Multimedia Application Interface 
-     */
-    Dmai_init();
+    if (i == d->async)
+	d->hWorker = VencWorker_create(d->hEngine, d->hVe1, d->hVidBufs,
+				       d->hEncBufs, d->async);
+    if (d->hWorker == NULL) {
+	ms_warning("Async encode unavailable, encoding on the ticker thread");
+	for (i = 1; i < d->async; i++) {
+	    if (d->hVidBufs[i])
+		Buffer_delete(d->hVidBufs[i]);
+	    if (d->hEncBufs[i])
+		Buffer_delete(d->hEncBufs[i]);
+	}
+	memset(d->hVidBufs, 0, sizeof(d->hVidBufs));
+	memset(d->hEncBufs, 0, sizeof(d->hEncBufs));
+	return;
+    }
+    ms_message("Encoding on a worker thread, %i frames in flight",
+	       d->async);
+}
 
-    /*
-     * Initialize the logs. Must be done after CERuntime_init() 
-     */
-    // TraceUtil_start(ENGINE_NAME);
+static void
+enc_stop_worker(EncData * d)
+{
+    int             i;
 
-    /*
-     * Use supplied params if any, otherwise use defaults 
-     */
-    encParams = &defaultEncParams;
-    encDynParams = &defaultEncDynParams;
+    if (d->hWorker == NULL)
+	return;
 
     /*
-     * Open the codec engine 
+     * Frames still in the pipeline are encoded but not sent 
      */
-    d->hEngine = Engine_open(ENGINE_NAME, NULL, NULL);
-
-    if (d->hEngine == NULL) {
-	ms_error("Failed to open codec engine %s\n", ENGINE_NAME);
-	cleanUpQ = TRUE;
+    VencWorker_delete(d->hWorker);
+    d->hWorker = NULL;
+    d->pending = 0;
+    for (i = 1; i < d->async; i++) {
+	Buffer_delete(d->hVidBufs[i]);
+	Buffer_delete(d->hEncBufs[i]);
     }
+    memset(d->hVidBufs, 0, sizeof(d->hVidBufs));
+    memset(d->hEncBufs, 0, sizeof(d->hEncBufs));
+}
+
+/*
+ * Frame rate that suits a bit rate at the default video size 
+ */
+static float
+enc_fps_for_bitrate(int bitrate)
+{
+    if (bitrate >= 384000)
+	return 30;
+    if (bitrate >= 128000)
+	return 15;
+    if (bitrate >= 64000)
+	return 10;
+    if (bitrate >= 32000)
+	return 5;
+    return 2;
+}
+
+/*
+ * Bit rate the encoder aims at: the one set, or the bandwidth estimate
+ * when it is lower 
+ */
+static int
+enc_target_bitrate(EncData * d)
+{
+    if (d->adapting && d->bitrate >= 0 && d->bwe.bitrate < d->bitrate)
+	return d->bwe.bitrate;
+    return d->bitrate;
+}
+
+/*
+ * Frame rate for the codec, in fps * 1000 
+ */
+static XDAS_Int32
+enc_frame_rate(EncData * d, VIDENC1_Params * encParams)
+{
+    float           fps = d->fps;
+    XDAS_Int32      rate;
+
+    if (d->adapting && enc_fps_for_bitrate(d->bwe.bitrate) < fps)
+	fps = enc_fps_for_bitrate(d->bwe.bitrate);
+    rate = (XDAS_Int32) (fps * 1000);
+
+    if (rate > encParams->maxFrameRate)
+	rate = encParams->maxFrameRate;
+    if (rate < 1000)
+	rate = 1000;
+    return rate;
+}
+
+/*
+ * Creation and dynamic params for the current settings.  A constant bit
+ * rate encoder is created with a maxBitRate of at least ENC_MAX_BITRATE,
+ * so that the bit rate can be raised with XDM_SETPARAMS later on.
+ */
+static void
+enc_setup_params(EncData * d, VIDENC1_Params * encParams,
+		 VIDENC1_DynamicParams * encDynParams)
+{
+    *encParams = Venc1_Params_DEFAULT;
+    *encDynParams = Venc1_DynamicParams_DEFAULT;
 
     /*
      * Set the resolution to match the specified resolution 
@@ -140,26 +311,74 @@ enc_preprocess(MSFilter * f)
 	 * If variable bit rate use a bogus bit rate value (> 0)
 	 * since it will be ignored.
 	 */
-	encParams->maxBitRate = 2000000;
+	encParams->maxBitRate = ENC_MAX_BITRATE;
+	encDynParams->targetBitRate = encParams->maxBitRate;
     } else {
 	/*
 	 * Constant bit rate 
 	 */
 	encParams->rateControlPreset = IVIDEO_LOW_DELAY;
-	encParams->maxBitRate = d->bitrate;
+	encParams->maxBitRate =
+	    d->bitrate > ENC_MAX_BITRATE ? d->bitrate : ENC_MAX_BITRATE;
+	encDynParams->targetBitRate = enc_target_bitrate(d);
     }
 
-    encDynParams->targetBitRate = encParams->maxBitRate;
+    /*
+     * IDRs are scheduled by the filter, see enc_idr_due() 
+     */
+    encDynParams->intraFrameInterval = 0;
+    encDynParams->refFrameRate = enc_frame_rate(d, encParams);
+    encDynParams->targetFrameRate = encDynParams->refFrameRate;
     encDynParams->inputWidth = encParams->maxWidth;
     encDynParams->inputHeight = encParams->maxHeight;
+}
+
+/*
+ * Get an encoder, its engine handle and its buffers for the current
+ * settings, from the codec pool if possible.
+ */
+static bool_t
+enc_open_codec(EncData * d)
+{
+    BufferGfx_Attrs gfxAttrs = BufferGfx_Attrs_DEFAULT;
+    Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+    CodecPool_Instance inst;
+    Int32           bufSize;
+
+    enc_setup_params(d, &d->params, &d->dynParams);
+    d->cur_slice_bytes = 0;
+    d->first_frame = TRUE;
+
+    /*
+     * Reuse a parked encoder created with the same params, if any 
+     */
+    if (CodecPool_get(CodecPool_Type_VENC1, "h264enc", &d->params,
+		      sizeof(d->params), &d->dynParams, &inst)) {
+	d->hEngine = inst.hEngine;
+	d->hVe1 = (Venc1_Handle) inst.hCodec;
+	d->hVidBuf = inst.hInBuf;
+	d->hEncBuf = inst.hOutBuf;
+	enc_start_worker(d);
+	return TRUE;
+    }
 
     /*
-     * Create the video encoder 
+     * Create the video encoder, with an engine handle of its own 
      */
-    d->hVe1 = Venc1_create(d->hEngine, "h264enc", encParams, encDynParams);
+    d->hEngine = EngineMgr_acquire();
+    if (d->hEngine == NULL) {
+	ms_error("Failed to open codec engine %s\n", ENGINE_NAME);
+	return FALSE;
+    }
+    EngineMgr_lock(d->hEngine);
+    d->hVe1 = Venc1_create(d->hEngine, "h264enc", &d->params,
+			   &d->dynParams);
+    EngineMgr_unlock(d->hEngine);
     if (d->hVe1 == NULL) {
 	ms_error("Failed to create video encoder: %s\n", "h264enc");
-	cleanUpQ = TRUE;
+	EngineMgr_release(d->hEngine);
+	d->hEngine = NULL;
+	return FALSE;
     }
 
     gfxAttrs.colorSpace = ColorSpace_YUV420P;
@@ -190,16 +409,15 @@ enc_preprocess(MSFilter * f)
      */
     d->hEncBuf = Buffer_create(bufSize, &bAttrs);
 
-    if (cleanUpQ) {
-	if (d->hVe1) {
-	    Venc1_delete(d->hVe1);
-	    d->hVe1 = NULL;
-	}
+    if (d->hVidBuf == NULL || d->hEncBuf == NULL) {
+	ms_error("Failed to allocate the encoder buffers");
+	EngineMgr_lock(d->hEngine);
+	Venc1_delete(d->hVe1);
+	EngineMgr_unlock(d->hEngine);
+	d->hVe1 = NULL;
+	EngineMgr_release(d->hEngine);
+	d->hEngine = NULL;
 
-	if (d->hEngine) {
-	    Engine_close(d->hEngine);
-	    d->hEngine = NULL;
-	}
 	if (d->hVidBuf) {
 	    Buffer_delete(d->hVidBuf);
 	    d->hVidBuf = NULL;
@@ -209,225 +427,808 @@ enc_preprocess(MSFilter * f)
 	    Buffer_delete(d->hEncBuf);
 	    d->hEncBuf = NULL;
 	}
+	return FALSE;
     }
+
+    enc_start_worker(d);
+    return TRUE;
 }
 
+/*
+ * Park the encoder, its engine handle and its buffers for the next user,
+ * frames still in the pipeline are dropped
+ */
 static void
-dmai_buffer_to_msgb(Buffer_Handle hEncBuf, MSQueue * nalus)
+enc_close_codec(EncData * d)
 {
-    mblk_t         *m;
-    uint8_t        *src,
-                   *end;
-    src = (uint8_t *) Buffer_getUserPtr(hEncBuf) + 4;
-    end = src + Buffer_getNumBytesUsed(hEncBuf) - 4;
-    // tricks for the first encoded buffer from TI's demo H264 encoder
-    while (src < (end - 4)) {
-	m = allocb(Buffer_getNumBytesUsed(hEncBuf) - 4, 0);
-
-	while (!(src[0] == 0 && src[1] == 0 && src[2] == 0 && src[3] == 1)
-	       && src < (end - 4)) {
-	    *(m->b_wptr)++ = *src++;
-	}
+    CodecPool_Instance inst;
+
+    enc_stop_worker(d);
+    d->dynParams.forceFrame = IVIDEO_NA_FRAME;
+    inst.hEngine = d->hEngine;
+    inst.hCodec = d->hVe1;
+    inst.hInBuf = d->hVidBuf;
+    inst.hOutBuf = d->hEncBuf;
+    inst.hBufTab = NULL;
+    CodecPool_put(CodecPool_Type_VENC1, "h264enc", &d->params,
+		  sizeof(d->params), &d->dynParams, &inst);
+    d->hEngine = NULL;
+    d->hVe1 = NULL;
+    d->hVidBuf = NULL;
+    d->hEncBuf = NULL;
+}
+
+static void
+enc_preprocess(MSFilter * f)
+{
+    EncData        *d = (EncData *) f->data;
 
+    rfc3984_init(&d->packer);
+    rfc3984_set_mode(&d->packer, d->mode);
+    rfc3984_enable_stap_a(&d->packer, d->mode == 1);
 
-	if (src[0] == 0 && src[1] == 0 && src[2] == 0 && src[3] == 1) {
-	    src += 4;
-	    if ((*(m->b_rptr) & 0x1f) == 7) {
-		ms_message("A SPS is being sent.");
-	    } else if ((*(m->b_rptr) & 0x1f) == 8) {
-		ms_message("A PPS is being sent.");
-	    }
-	    ms_queue_put(nalus, m);
-	} else {
-	    *(m->b_wptr)++ = *src++;
-	    *(m->b_wptr)++ = *src++;
-	    *(m->b_wptr)++ = *src++;
-	    *(m->b_wptr)++ = *src++;
-	    if ((*(m->b_rptr) & 0x1f) == 7) {
-		ms_message("A SPS is being sent.");
-	    } else if ((*(m->b_rptr) & 0x1f) == 8) {
-		ms_message("A PPS is being sent.");
-	    }
-	    ms_queue_put(nalus, m);
-	}
-    }
+    enc_open_codec(d);
 }
 
+/*
+ * Slice budget for the encoder: NAL units that fit in one RTP packet go
+ * out as single NAL unit packets, without FU-A fragmentation, which is
+ * also what packetization-mode 0 requires.
+ */
+static XDAS_Int32
+enc_slice_bytes(EncData * d)
+{
+    if (d->slice_bytes <= 0)
+	return 0;
+    return d->slice_bytes < d->packer.maxsz ? d->slice_bytes :
+	d->packer.maxsz;
+}
+
+/*
+ * The codec does not take a slice budget: back to one slice per frame 
+ */
 static void
-enc_process(MSFilter * f)
+enc_slices_rejected(EncData * d)
 {
-    EncData        *d = (EncData *) f->data;
-    uint32_t        ts = f->ticker->time * 90LL;
-    mblk_t         *im;
-    Int             ret = Dmai_EOK;
+    ms_warning("Slice size not supported by the encoder, "
+	       "sending whole frames");
+    d->slice_bytes = 0;
+    d->cur_slice_bytes = 0;
+}
 
-    MSQueue         nalus;
-    ms_queue_init(&nalus);
-    while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-	Buffer_setNumBytesUsed(d->hVidBuf, im->b_wptr - im->b_rptr);
-	memcpy(Buffer_getUserPtr(d->hVidBuf), im->b_rptr,
-	       Buffer_getNumBytesUsed(d->hVidBuf));
+/*
+ * Copy the encoder output into a single mblk and slice it into its NAL
+ * units, returns the number of bytes copied.
+ */
+static int
+dmai_buffer_to_nalus(Buffer_Handle hEncBuf, MSQueue * nalus)
+{
+    Int32           len = Buffer_getNumBytesUsed(hEncBuf);
+    mblk_t         *frame;
+
+    frame = allocb(len, 0);
+    memcpy(frame->b_wptr, Buffer_getUserPtr(hEncBuf), len);
+    frame->b_wptr += len;
+    AnnexB_split(frame, nalus);
+    return len;
+}
 
-	/*
-	 * Make sure the whole buffer is used for input 
-	 */
-	BufferGfx_resetDimensions(d->hVidBuf);
+/*
+ * The buffer of a pool frame the encoder can read in place, NULL if the
+ * frame has to be copied 
+ */
+static Buffer_Handle
+enc_frame_buffer(EncData * d, mblk_t * im)
+{
+    Buffer_Handle   hBuf = FramePool_getBuffer(im);
+    BufferGfx_Dimensions dim;
 
-	Buffer_freeUseMask(d->hEncBuf, 0xffff);
-	/*
-	 * encode the video buffer 
-	 */
-	ret = Venc1_process(d->hVe1, d->hVidBuf, d->hEncBuf);
+    if (hBuf == NULL || Buffer_getSize(hBuf) < Buffer_getSize(d->hVidBuf))
+	return NULL;
 
-	if (ret < 0) {
-	    ms_error("Failed to encode video buffer\n");
-	}
+    /*
+     * Make sure the whole buffer is used for input 
+     */
+    BufferGfx_resetDimensions(hBuf);
 
-	if (Buffer_getNumBytesUsed(d->hEncBuf) == 0) {
-	    ms_error("Encoder created 0 sized output frame\n");
-	}
+    /*
+     * A frame of the pool in use before a size change 
+     */
+    BufferGfx_getDimensions(hBuf, &dim);
+    if (dim.width != d->params.maxWidth || dim.height != d->params.maxHeight)
+	return NULL;
+    return hBuf;
+}
 
-	dmai_buffer_to_msgb(d->hEncBuf, &nalus);
-	rfc3984_pack(&d->packer, &nalus, f->outputs[0], ts);
-	d->framenum++;
+/*
+ * Frames captured at another size than the encoder's cannot be copied
+ * in, they are dropped.  It happens for a frame or two after a size
+ * change.
+ */
+static bool_t
+enc_frame_fits(EncData * d, mblk_t * im, Buffer_Handle hInBuf)
+{
+    Int32           len = im->b_wptr - im->b_rptr;
 
-	freemsg(im);
+    if (len < d->params.maxWidth * d->params.maxHeight * 3 / 2
+	|| len > Buffer_getSize(hInBuf)) {
+	ms_warning("Dropping a %i bytes frame, the encoder is %ix%i", len,
+		   (int) d->params.maxWidth, (int) d->params.maxHeight);
+	return FALSE;
     }
+    return TRUE;
 }
 
-static void
-enc_postprocess(MSFilter * f)
+/*
+ * Keep a copy of a parameter set the encoder produced, frees nalu.
+ * Returns TRUE if it differs from the cached one.
+ */
+static bool_t
+enc_cache_param_set(mblk_t ** cache, mblk_t * nalu)
 {
-    EncData        *d = (EncData *) f->data;
-    rfc3984_uninit(&d->packer);
-    /*
-     * Clean up the thread before exiting 
-     */
-    if (d->hVe1) {
-	Venc1_delete(d->hVe1);
-	d->hVe1 = NULL;
-    }
+    int             len = nalu->b_wptr - nalu->b_rptr;
 
-    if (d->hEngine) {
-	Engine_close(d->hEngine);
-	d->hEngine = NULL;
-    }
-    if (d->hVidBuf) {
-	Buffer_delete(d->hVidBuf);
-	d->hVidBuf = NULL;
+    if (*cache != NULL && (*cache)->b_wptr - (*cache)->b_rptr == len
+	&& memcmp((*cache)->b_rptr, nalu->b_rptr, len) == 0) {
+	freemsg(nalu);
+	return FALSE;
     }
+    if (*cache != NULL)
+	freemsg(*cache);
+    *cache = copyb(nalu);
+    freemsg(nalu);
+    return TRUE;
+}
 
-    if (d->hEncBuf) {
-	Buffer_delete(d->hEncBuf);
-	d->hEncBuf = NULL;
+/*
+ * Move the NAL units of a frame from nalus to frame.  The SPS and PPS
+ * the encoder writes are cached rather than sent where they are: the
+ * cached ones go right before the first slice of an IDR, or of any frame
+ * after they changed or were asked for.  In packetization-mode 1 they
+ * then share a STAP-A packet, with the IDR slice if it fits.
+ */
+static void
+enc_insert_param_sets(EncData * d, MSQueue * nalus, MSQueue * frame)
+{
+    mblk_t         *m;
+    int             type;
+    bool_t          first_slice = TRUE;
+
+    while ((m = ms_queue_get(nalus)) != NULL) {
+	type = m->b_rptr[0] & 0x1f;
+	if (type == 7 || type == 8) {
+	    if (enc_cache_param_set(type == 7 ? &d->sps : &d->pps, m))
+		d->send_param_sets = TRUE;
+	    continue;
+	}
+	if ((type == 1 || type == 5) && first_slice) {
+	    first_slice = FALSE;
+	    if ((type == 5 || d->send_param_sets) && d->sps != NULL
+		&& d->pps != NULL) {
+		ms_queue_put(frame, dupb(d->sps));
+		ms_queue_put(frame, dupb(d->pps));
+		d->send_param_sets = FALSE;
+	    }
+	}
+	ms_queue_put(frame, m);
     }
 }
 
-static int
-enc_set_br(MSFilter * f, void *arg)
+/*
+ * Packetize one encoded frame 
+ */
+static void
+enc_output(MSFilter * f, Int ret, Buffer_Handle hEncBuf, uint32_t ts)
 {
     EncData        *d = (EncData *) f->data;
-    d->bitrate = *(int *) arg;
+    MSQueue         nalus,
+                    frame;
 
-    if (d->bitrate >= 1024000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 30;
-    } else if (d->bitrate >= 512000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 30;
-    } else if (d->bitrate >= 384000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 30;
-    } else if (d->bitrate >= 256000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 15;
-    } else if (d->bitrate >= 128000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 15;
-    } else if (d->bitrate >= 64000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 10;
-    } else if (d->bitrate >= 32000) {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 5;
-    } else {
-	// d->vsize = MS_VIDEO_SIZE_CIF;
-	d->vsize = (MSVideoSize) {480, 320};
-	d->fps = 2;
+    ms_queue_init(&nalus);
+    ms_queue_init(&frame);
+    if (ret < 0) {
+	ms_error("Failed to encode video buffer\n");
     }
-    ms_message("bitrate set to %i", d->bitrate);
-    return 0;
+
+    if (Buffer_getNumBytesUsed(hEncBuf) == 0) {
+	ms_error("Encoder created 0 sized output frame\n");
+    }
+
+    d->stats.bytes_copied += dmai_buffer_to_nalus(hEncBuf, &nalus);
+    enc_insert_param_sets(d, &nalus, &frame);
+    rfc3984_pack(&d->packer, &frame, f->outputs[0], ts);
+    d->framenum++;
+    d->stats.frames_out++;
 }
 
-static int
-enc_set_fps(MSFilter * f, void *arg)
+static void
+enc_output_slot(MSFilter * f, VencWorker_Slot * slot)
 {
     EncData        *d = (EncData *) f->data;
-    d->fps = *(float *) arg;
-    return 0;
+
+    account_codec_time(&d->stats, slot->encodeUsecs);
+    if (slot->setParams && slot->sliceRejected)
+	enc_slices_rejected(d);
+    enc_output(f, slot->ret, slot->hOutBuf, slot->ts);
+    VencWorker_releaseSlot(d->hWorker, slot);
+    d->pending--;
 }
 
-static int
-enc_get_fps(MSFilter * f, void *arg)
+/*
+ * Switch to an encoder for the current settings.  The frames still in
+ * the pipeline are sent first; the engine and the packer are kept, and
+ * the old encoder is parked for when the size comes back.
+ */
+static void
+enc_reopen_codec(MSFilter * f)
 {
     EncData        *d = (EncData *) f->data;
-    *(float *) arg = d->fps;
-    return 0;
+    VencWorker_Slot *slot;
+
+    ms_message("Reopening the encoder for %ix%i, %i bps", d->vsize.width,
+	       d->vsize.height, d->bitrate);
+    if (d->hWorker) {
+	while ((slot = VencWorker_getDoneSlot(d->hWorker, TRUE)) != NULL)
+	    enc_output_slot(f, slot);
+    }
+    enc_close_codec(d);
+    if (!enc_open_codec(d))
+	ms_error("Failed to reopen the video encoder");
 }
 
-static int
-enc_get_vsize(MSFilter * f, void *arg)
+/*
+ * A new size or rate control mode, or a bit rate above what the encoder
+ * was created for, needs another encoder.  Checked once per tick.
+ */
+static void
+enc_update_codec(MSFilter * f)
 {
     EncData        *d = (EncData *) f->data;
-    *(MSVideoSize *) arg = d->vsize;
-    return 0;
+
+    if (d->hVe1 == NULL)
+	return;
+
+    if (d->vsize.width != d->params.maxWidth
+	|| d->vsize.height != d->params.maxHeight
+	|| (d->bitrate < 0) !=
+	(d->params.rateControlPreset == IVIDEO_NONE)
+	|| d->bitrate > d->params.maxBitRate)
+	enc_reopen_codec(f);
 }
 
-static int
-enc_set_vsize(MSFilter * f, void *arg)
+/*
+ * Keyframe scheduler: whether the next frame must be an IDR.  A VFU
+ * request is served by the next frame, unless an IDR went out less than
+ * ENC_VFU_MIN_INTERVAL ms ago: it then waits for the end of that
+ * interval, so that the requests a receiver repeats while it recovers
+ * cost a single IDR.  Without requests an IDR goes out every
+ * keyframe_int seconds.
+ */
+static bool_t
+enc_idr_due(MSFilter * f)
 {
     EncData        *d = (EncData *) f->data;
-    d->vsize = *(MSVideoSize *) arg;
-    return 0;
+    uint64_t        now = f->ticker->time;
+    bool_t          due = FALSE;
+
+    if (d->first_frame) {
+	/*
+	 * The first frame of an encoder is an IDR anyway 
+	 */
+	d->first_frame = FALSE;
+	d->generate_keyframe = FALSE;
+	d->last_idr_time = now;
+	return FALSE;
+    }
+
+    if (d->generate_keyframe
+	&& now - d->last_idr_time >= ENC_VFU_MIN_INTERVAL) {
+	ms_message("Sending an IDR on request");
+	d->generate_keyframe = FALSE;
+	due = TRUE;
+    } else if (d->keyframe_int > 0
+	       && now - d->last_idr_time >=
+	       (uint64_t) d->keyframe_int * 1000) {
+	due = TRUE;
+    }
+    if (due)
+	d->last_idr_time = now;
+    return due;
 }
 
-static int
-enc_add_fmtp(MSFilter * f, void *arg)
+/*
+ * Dynamic params for the next frame: the current bit rate and frame
+ * rate, and forceFrame set for this frame only if an IDR is due.
+ * Returns TRUE if they differ from what the encoder was last given.
+ */
+static bool_t
+enc_next_params(MSFilter * f, VIDENC1_DynamicParams * dynParams,
+		XDAS_Int32 * sliceBytes)
 {
     EncData        *d = (EncData *) f->data;
-    const char     *fmtp = (const char *) arg;
-    char            value[12];
-    if (fmtp_get_value(fmtp, "packetization-mode", value, sizeof(value))) {
-	d->mode = atoi(value);
-	ms_message("packetization-mode set to %i", d->mode);
-    }
-    return 0;
+    bool_t          rates_changed;
+
+    *sliceBytes = enc_slice_bytes(d);
+
+    *dynParams = d->dynParams;
+    if (d->bitrate >= 0)
+	dynParams->targetBitRate = enc_target_bitrate(d);
+    dynParams->refFrameRate = enc_frame_rate(d, &d->params);
+    dynParams->targetFrameRate = dynParams->refFrameRate;
+    dynParams->forceFrame =
+	enc_idr_due(f) ? IVIDEO_IDR_FRAME : IVIDEO_NA_FRAME;
+
+    rates_changed =
+	dynParams->targetBitRate != d->dynParams.targetBitRate
+	|| dynParams->targetFrameRate != d->dynParams.targetFrameRate;
+    if (rates_changed)
+	ms_message("Encoder set to %i bps, %i fps",
+		   (int) dynParams->targetBitRate,
+		   (int) dynParams->targetFrameRate / 1000);
+    if (!rates_changed && dynParams->forceFrame == d->dynParams.forceFrame
+	&& *sliceBytes == d->cur_slice_bytes)
+	return FALSE;
+
+    d->dynParams = *dynParams;
+    d->cur_slice_bytes = *sliceBytes;
+    return TRUE;
 }
 
-static int
-enc_req_vfu(MSFilter * f, void *arg)
+/*
+ * Frame-rate governor, run before anything reaches the DSP.  Of the
+ * frames queued since the last tick only the newest is kept: older ones
+ * would only delay it.  That frame is then dropped as well if the next
+ * frame at the encoder frame rate is not due yet, so the DSP load
+ * follows the negotiated rate rather than the capture rate.
+ *
+ * next_frame_time advances by one frame interval per frame kept, which
+ * keeps the average rate exact with capture times jittered by the
+ * ticker.  It starts over half an interval ahead of the first frame,
+ * and of any frame more than two intervals away from it (capture pause,
+ * frame rate change).
+ */
+static void
+enc_govern_input(MSFilter * f)
 {
     EncData        *d = (EncData *) f->data;
-    d->generate_keyframe = TRUE;
-    return 0;
-}
+    int64_t         now = (int64_t) f->ticker->time * 1000;
+    int64_t         interval =
+	1000000000LL / enc_frame_rate(d, &d->params);
+    int64_t         ahead;
+    mblk_t         *im,
+                   *newest = NULL;
 
+    while ((im = ms_queue_get(f->inputs[0])) != NULL) {
+	d->stats.frames_in++;
+	if (newest != NULL) {
+	    freemsg(newest);
+	    d->stats.skipped_backlog++;
+	}
+	newest = im;
+    }
+    if (newest == NULL)
+	return;
+
+    ahead = d->next_frame_time - now;
+    if (d->governing && ahead > -2 * interval && ahead < 2 * interval) {
+	if (ahead > 0) {
+	    freemsg(newest);
+	    d->stats.skipped_fps++;
+	    return;
+	}
+	d->next_frame_time += interval;
+    } else {
+	d->next_frame_time = now + interval / 2;
+	d->governing = TRUE;
+    }
+    ms_queue_put(f->inputs[0], newest);
+}
 
-static MSFilterMethod enc_methods[] = {
-    {MS_FILTER_SET_FPS, enc_set_fps},
-    {MS_FILTER_SET_BITRATE, enc_set_br},
-    {MS_FILTER_GET_FPS, enc_get_fps},
+/*
+ * Async mode: send what the worker finished since the last tick, then
+ * queue the new frames.  The ticker only waits when every slot is in
+ * flight.
+ */
+static void
+enc_process_async(MSFilter * f)
+{
+    EncData        *d = (EncData *) f->data;
+    uint32_t        ts = f->ticker->time * 90LL;
+    VencWorker_Slot *slot;
+    unsigned long long start;
+    mblk_t         *im;
+
+    while ((slot = VencWorker_getDoneSlot(d->hWorker, FALSE)) != NULL)
+	enc_output_slot(f, slot);
+
+    while ((im = ms_queue_get(f->inputs[0])) != NULL) {
+	while ((slot = VencWorker_getFreeSlot(d->hWorker)) == NULL) {
+	    start = now_usecs();
+	    slot = VencWorker_getDoneSlot(d->hWorker, TRUE);
+	    d->stats.stall_usecs += now_usecs() - start;
+	    if (slot)
+		enc_output_slot(f, slot);
+	}
+
+	slot->hFrameBuf = enc_frame_buffer(d, im);
+	if (slot->hFrameBuf != NULL) {
+	    /*
+	     * Held by the slot until the frame is encoded 
+	     */
+	    slot->frame = im;
+	} else if (!enc_frame_fits(d, im, slot->hInBuf)) {
+	    freemsg(im);
+	    continue;
+	} else {
+	    Buffer_setNumBytesUsed(slot->hInBuf, im->b_wptr - im->b_rptr);
+	    memcpy(Buffer_getUserPtr(slot->hInBuf), im->b_rptr,
+		   Buffer_getNumBytesUsed(slot->hInBuf));
+	    d->stats.bytes_copied += Buffer_getNumBytesUsed(slot->hInBuf);
+
+	    /*
+	     * Make sure the whole buffer is used for input 
+	     */
+	    BufferGfx_resetDimensions(slot->hInBuf);
+	    freemsg(im);
+	}
+
+	Buffer_freeUseMask(slot->hOutBuf, 0xffff);
+	slot->setParams =
+	    enc_next_params(f, &slot->dynParams, &slot->sliceBytes);
+	slot->ts = ts;
+	VencWorker_submit(d->hWorker, slot);
+	d->stats.dsp_calls++;
+	d->pending++;
+    }
+}
+
+static void
+enc_process(MSFilter * f)
+{
+    EncData        *d = (EncData *) f->data;
+    uint32_t        ts = f->ticker->time * 90LL;
+    mblk_t         *im;
+    Buffer_Handle   hInBuf;
+    VIDENC1_DynamicParams dynParams;
+    XDAS_Int32      sliceBytes;
+    unsigned long long elapsed;
+    Int             ret = Dmai_EOK;
+
+    enc_update_codec(f);
+    if (d->hVe1 == NULL) {
+	ms_queue_flush(f->inputs[0]);
+	return;
+    }
+
+    enc_govern_input(f);
+
+    if (d->hWorker) {
+	enc_process_async(f);
+	return;
+    }
+
+    while ((im = ms_queue_get(f->inputs[0])) != NULL) {
+	hInBuf = enc_frame_buffer(d, im);
+	if (hInBuf == NULL) {
+	    hInBuf = d->hVidBuf;
+	    if (!enc_frame_fits(d, im, hInBuf)) {
+		freemsg(im);
+		continue;
+	    }
+	    Buffer_setNumBytesUsed(hInBuf, im->b_wptr - im->b_rptr);
+	    memcpy(Buffer_getUserPtr(hInBuf), im->b_rptr,
+		   Buffer_getNumBytesUsed(hInBuf));
+	    d->stats.bytes_copied += Buffer_getNumBytesUsed(hInBuf);
+
+	    /*
+	     * Make sure the whole buffer is used for input 
+	     */
+	    BufferGfx_resetDimensions(hInBuf);
+	}
+
+	Buffer_freeUseMask(d->hEncBuf, 0xffff);
+	if (enc_next_params(f, &dynParams, &sliceBytes)
+	    && !H264Enc_setDynamicParams(d->hEngine, d->hVe1, &dynParams,
+					 sliceBytes))
+	    enc_slices_rejected(d);
+	/*
+	 * encode the video buffer, the ticker is stalled meanwhile 
+	 */
+	elapsed = now_usecs();
+	EngineMgr_lock(d->hEngine);
+	ret = Venc1_process(d->hVe1, hInBuf, d->hEncBuf);
+	EngineMgr_unlock(d->hEngine);
+	elapsed = now_usecs() - elapsed;
+	d->stats.dsp_calls++;
+	account_codec_time(&d->stats, elapsed);
+	d->stats.stall_usecs += elapsed;
+
+	enc_output(f, ret, d->hEncBuf, ts);
+
+	freemsg(im);
+    }
+}
+
+static void
+enc_postprocess(MSFilter * f)
+{
+    EncData        *d = (EncData *) f->data;
+
+    rfc3984_uninit(&d->packer);
+    enc_close_codec(d);
+}
+
+static int
+enc_set_br(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->bitrate = *(int *) arg;
+    if (d->adapting)
+	BwEstimator_setMaxBitrate(&d->bwe, d->bitrate);
+
+    if (d->hVe1 != NULL) {
+	/*
+	 * Running: the size stays, the frame rate follows the bit rate
+	 * without going over the one set with MS_FILTER_SET_FPS; both are
+	 * applied on the next tick 
+	 */
+	d->fps = enc_fps_for_bitrate(d->bitrate);
+	if (d->max_fps > 0 && d->fps > d->max_fps)
+	    d->fps = d->max_fps;
+	ms_message("bitrate set to %i, %.1f fps", d->bitrate, d->fps);
+	return 0;
+    }
+
+    // d->vsize = MS_VIDEO_SIZE_CIF;
+    d->vsize = (MSVideoSize) {480, 320};
+    d->fps = enc_fps_for_bitrate(d->bitrate);
+    ms_message("bitrate set to %i", d->bitrate);
+    return 0;
+}
+
+static int
+enc_get_br(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    *(int *) arg = enc_target_bitrate(d);
+    return 0;
+}
+
+/*
+ * Ask the application for half the video size when the estimate gets
+ * too low for the one adapting started with, and for that size again
+ * once the estimate is well above 
+ */
+static void
+enc_adapt_video_size(MSFilter * f)
+{
+    EncData        *d = (EncData *) f->data;
+    MSVideoSize     vsize = d->full_vsize;
+
+    if (!d->low_res && d->bwe.bitrate < ENC_LOW_RES_BITRATE) {
+	d->low_res = TRUE;
+	vsize.width = (vsize.width / 2 + 15) & ~15;
+	vsize.height = (vsize.height / 2 + 15) & ~15;
+    } else if (d->low_res && d->bwe.bitrate >= ENC_FULL_RES_BITRATE) {
+	d->low_res = FALSE;
+    } else {
+	return;
+    }
+    ms_message("Asking for %ix%i video at %i bps", vsize.width,
+	       vsize.height, d->bwe.bitrate);
+    ms_filter_notify(f, SD_FILTER_EVENT_VIDEO_SIZE, &vsize);
+}
+
+/*
+ * A receiver report from the far end.  The new bit rate and frame rate
+ * are applied on the next frame.
+ */
+static int
+enc_set_reception_report(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+
+    if (d->bitrate < 0)
+	return 0;
+    if (!d->adapting) {
+	BwEstimator_init(&d->bwe, d->bitrate);
+	d->full_vsize = d->vsize;
+	d->adapting = TRUE;
+    }
+    /*
+     * Reports come from the RTCP side, attached to a ticker or not: the
+     * estimator's hold time always runs on the system clock 
+     */
+    BwEstimator_update(&d->bwe, (SDReceptionReport *) arg,
+		       now_usecs() / 1000);
+    enc_adapt_video_size(f);
+    return 0;
+}
+
+static int
+enc_set_fps(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->fps = *(float *) arg;
+    d->max_fps = d->fps;
+    return 0;
+}
+
+static int
+enc_get_fps(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    *(float *) arg = d->fps;
+    return 0;
+}
+
+static int
+enc_get_vsize(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    *(MSVideoSize *) arg = d->vsize;
+    return 0;
+}
+
+static int
+enc_set_vsize(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    MSVideoSize     vsize = *(MSVideoSize *) arg;
+
+    if (d->hFramePool != NULL && (vsize.width != d->vsize.width
+				  || vsize.height != d->vsize.height)) {
+	/*
+	 * Frames already handed out keep the old pool alive 
+	 */
+	FramePool_delete(d->hFramePool);
+	d->hFramePool = NULL;
+    }
+    d->vsize = vsize;
+    return 0;
+}
+
+/*
+ * The pool is created on first request, for the current video size.  The
+ * caller gets a reference of its own, so the pool stays valid after a
+ * size change or the destruction of the filter until FramePool_release().
+ */
+static int
+enc_get_frame_pool(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    BufferGfx_Attrs gfxAttrs = BufferGfx_Attrs_DEFAULT;
+    Int32           bufSize;
+
+    if (d->hFramePool == NULL) {
+	gfxAttrs.colorSpace = ColorSpace_YUV420P;
+	gfxAttrs.dim.width = d->vsize.width;
+	gfxAttrs.dim.height = d->vsize.height;
+	gfxAttrs.dim.lineLength =
+	    BufferGfx_calcLineLength(gfxAttrs.dim.width,
+				     gfxAttrs.colorSpace);
+	if (d->hVidBuf != NULL)
+	    bufSize = Buffer_getSize(d->hVidBuf);
+	else
+	    bufSize = gfxAttrs.dim.lineLength * gfxAttrs.dim.height * 3 / 2;
+	d->hFramePool = FramePool_create(ENC_FRAME_POOL_SIZE, bufSize,
+					 &gfxAttrs);
+    }
+    if (d->hFramePool == NULL)
+	return -1;
+    FramePool_retain(d->hFramePool);
+    *(FramePool_Handle *) arg = d->hFramePool;
+    return 0;
+}
+
+static int
+enc_add_fmtp(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    const char     *fmtp = (const char *) arg;
+    char            value[12];
+    if (fmtp_get_value(fmtp, "packetization-mode", value, sizeof(value))) {
+	d->mode = atoi(value);
+	ms_message("packetization-mode set to %i", d->mode);
+    }
+    return 0;
+}
+
+static int
+enc_req_vfu(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->generate_keyframe = TRUE;
+    return 0;
+}
+
+/*
+ * Have the parameter sets sent again before the next frame, without
+ * waiting for an IDR 
+ */
+static int
+enc_send_param_sets(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->send_param_sets = TRUE;
+    return 0;
+}
+
+
+static int
+enc_set_keyframe_interval(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->keyframe_int = *(int *) arg;
+    return 0;
+}
+
+static int
+enc_set_slice_size(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    d->slice_bytes = *(int *) arg;
+    return 0;
+}
+
+static int
+enc_get_stats(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    *(SDCodecStats *) arg = d->stats;
+    return 0;
+}
+
+static int
+enc_reset_stats(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    memset(&d->stats, 0, sizeof(d->stats));
+    return 0;
+}
+
+static int
+enc_set_async(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    int             depth = *(int *) arg;
+
+    if (d->hVe1 != NULL) {
+	ms_error("SDH264Enc: async mode must be set before preprocess");
+	return -1;
+    }
+    if (depth > VENC_WORKER_MAX_SLOTS)
+	depth = VENC_WORKER_MAX_SLOTS;
+    d->async = depth;
+    return 0;
+}
+
+static int
+enc_get_pending(MSFilter * f, void *arg)
+{
+    EncData        *d = (EncData *) f->data;
+    *(int *) arg = d->pending;
+    return 0;
+}
+
+static MSFilterMethod enc_methods[] = {
+    {MS_FILTER_SET_FPS, enc_set_fps},
+    {MS_FILTER_SET_BITRATE, enc_set_br},
+    {MS_FILTER_GET_BITRATE, enc_get_br},
+    {MS_FILTER_GET_FPS, enc_get_fps},
     {MS_FILTER_GET_VIDEO_SIZE, enc_get_vsize},
     {MS_FILTER_SET_VIDEO_SIZE, enc_set_vsize},
     {MS_FILTER_ADD_FMTP, enc_add_fmtp},
     {MS_FILTER_REQ_VFU, enc_req_vfu},
+    {SD_FILTER_GET_STATS, enc_get_stats},
+    {SD_FILTER_RESET_STATS, enc_reset_stats},
+    {SD_FILTER_SET_ASYNC, enc_set_async},
+    {SD_FILTER_GET_PENDING, enc_get_pending},
+    {SD_FILTER_GET_FRAME_POOL, enc_get_frame_pool},
+    {SD_FILTER_SET_KEYFRAME_INTERVAL, enc_set_keyframe_interval},
+    {SD_FILTER_SET_SLICE_SIZE, enc_set_slice_size},
+    {SD_FILTER_SEND_PARAM_SETS, enc_send_param_sets},
+    {SD_FILTER_SET_RECEPTION_REPORT, enc_set_reception_report},
     {0, NULL}
 };
 
@@ -454,27 +1255,54 @@ typedef struct _DecData {
     Buffer_Handle   hVidBuf;
     Buffer_Handle   hDecBuf;
     Buffer_Handle   hDispBuf;
+    VIDDEC2_Params  params;
+    VIDDEC2_DynamicParams dynParams;
     mblk_t         *sps,
                    *pps;
     Rfc3984Context  unpacker;
     unsigned int    packet_num;
     int             inBsBufSize;
+    MSVideoSize     vsize;	/* displayed size of the stream */
+    MSVideoSize     coded_size;	/* in whole macroblocks */
+    int             max_ref_frames;	/* of the stream */
+    int             codec_ref_frames;	/* the decoder was created for */
+    int             async;	/* pipeline depth, < 2 for synchronous */
+    VdecWorker_Handle hWorker;
+    Buffer_Handle   hDecBufs[VDEC_WORKER_MAX_SLOTS];
+    int             pending;	/* frames submitted, not output yet */
+    FramePool_Handle hFramePool;	/* over hBufTabImage */
+    MSQueue         au;		/* nalus of the picture being received */
+    uint32_t        au_ts;
+    bool_t          au_has_slice;
+    MSQueue         nalus;	/* whole pictures, last nalu marked */
+    bool_t          wait_idr;	/* no IDR since start or a broken reference */
+    bool_t          seq_valid;	/* last_seq is set */
+    uint16_t        last_seq;	/* RTP sequence number of the last packet */
+    uint32_t        last_ts;	/* its timestamp */
+    bool_t          last_marker;	/* that packet ended a picture */
+    uint32_t        damaged_ts[DEC_MAX_DAMAGED];	/* ring of timestamps */
+    int             ndamaged;
+    int             damaged_idx;	/* next entry to write */
+    bool_t          au_is_ref;	/* the picture being decoded is a reference */
+    bool_t          shed_enabled;	/* SD_FILTER_SET_LOAD_SHEDDING */
+    bool_t          shedding;	/* non-reference pictures are dropped */
+    bool_t          calm;	/* load low since calm_since */
+    uint64_t        calm_since;	/* ticker time */
+    int             decode_avg;	/* usecs per picture, moving average */
+    int             frame_interval;	/* usecs between pictures, same */
+    bool_t          pic_ts_valid;	/* pic_ts is set */
+    uint32_t        pic_ts;	/* timestamp of the last picture checked */
+    bool_t          vfu_sent;	/* last_vfu_time is set */
+    uint64_t        last_vfu_time;	/* ticker time */
+    unsigned long long first_packet_usecs;	/* 0 until one came */
+    bool_t          first_frame_out;
+    SDCodecStats    stats;
 } DecData;
 
 static void
 dec_init(MSFilter * f)
 {
     DecData        *d = (DecData *) ms_new(DecData, 1);
-    VIDDEC2_Params  defaultDecParams = Vdec2_Params_DEFAULT;
-    VIDDEC2_DynamicParams defaultDecDynParams =
-	Vdec2_DynamicParams_DEFAULT;
-    VIDDEC2_Params *decParams;
-    VIDDEC2_DynamicParams *decDynParams;
-    BufferGfx_Attrs gfxAttrs = BufferGfx_Attrs_DEFAULT;
-    Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
-    Int32           bufSize;
-
-    bool_t          cleanUpQ = FALSE;
 
     d->hEngine = NULL;
     d->hVd2 = NULL;
@@ -486,369 +1314,1229 @@ dec_init(MSFilter * f)
     d->pps = NULL;
     rfc3984_init(&d->unpacker);
     d->packet_num = 0;
-    d->inBsBufSize = 500000;
+    d->inBsBufSize = 0;
+    // d->vsize = MS_VIDEO_SIZE_CIF;
+    d->vsize = (MSVideoSize) {480, 320};
+    d->coded_size = d->vsize;
+    d->max_ref_frames = 1;
+    d->codec_ref_frames = 0;
+    d->async = 0;
+    d->hWorker = NULL;
+    memset(d->hDecBufs, 0, sizeof(d->hDecBufs));
+    d->pending = 0;
+    d->hFramePool = NULL;
+    ms_queue_init(&d->au);
+    d->au_ts = 0;
+    d->au_has_slice = FALSE;
+    ms_queue_init(&d->nalus);
+    d->wait_idr = TRUE;
+    d->seq_valid = FALSE;
+    d->last_seq = 0;
+    d->last_ts = 0;
+    d->last_marker = TRUE;
+    d->ndamaged = 0;
+    d->damaged_idx = 0;
+    d->au_is_ref = FALSE;
+    d->shed_enabled = FALSE;
+    d->shedding = FALSE;
+    d->calm = FALSE;
+    d->calm_since = 0;
+    d->decode_avg = 0;
+    d->frame_interval = 1000000 / 30;
+    d->pic_ts_valid = FALSE;
+    d->pic_ts = 0;
+    d->vfu_sent = FALSE;
+    d->last_vfu_time = 0;
+    d->first_packet_usecs = 0;
+    d->first_frame_out = FALSE;
+    memset(&d->stats, 0, sizeof(d->stats));
     f->data = d;
+}
 
-    /*
-     * Initialize Codec Engine runtime 
-     */
-    CERuntime_init();
-
-    /*
-     * Initialize Davinci Multimedia Application Interface 
-     */
-    Dmai_init();
+/*
+ * Take the size and reference frame count of a new SPS.  Returns TRUE
+ * if they changed.
+ */
+static bool_t
+dec_set_stream(DecData * d, const H264Sps * sps)
+{
+    if (sps->width == d->vsize.width && sps->height == d->vsize.height
+	&& sps->coded_width == d->coded_size.width
+	&& sps->coded_height == d->coded_size.height
+	&& sps->max_num_ref_frames == d->max_ref_frames)
+	return FALSE;
+
+    ms_message("H264 stream is %ix%i, profile %i, level %i, %i reference "
+	       "frames", sps->width, sps->height, sps->profile_idc,
+	       sps->level_idc, sps->max_num_ref_frames);
+    d->vsize.width = sps->width;
+    d->vsize.height = sps->height;
+    d->coded_size.width = sps->coded_width;
+    d->coded_size.height = sps->coded_height;
+    d->max_ref_frames = sps->max_num_ref_frames;
+    return TRUE;
+}
 
-    /*
-     * Initialize the logs. Must be done after CERuntime_init() 
-     */
-    // TraceUtil_start(ENGINE_NAME);
+/*
+ * Whether the decoder was created for the stream as last described 
+ */
+static bool_t
+dec_codec_fits(DecData * d)
+{
+    return d->params.maxWidth == d->coded_size.width
+	&& d->params.maxHeight == d->coded_size.height
+	&& d->codec_ref_frames == d->max_ref_frames;
+}
 
-    /*
-     * Use supplied params if any, otherwise use defaults 
-     */
-    decParams = &defaultDecParams;
-    decDynParams = &defaultDecDynParams;
+/*
+ * What a parked decoder is looked up by: besides its params, the size of
+ * its BufTab, which follows the reference frames of the stream and the
+ * async depth 
+ */
+typedef struct _DecPoolKey {
+    VIDDEC2_Params  params;
+    Int             numBufs;
+} DecPoolKey;
 
-    /*
-     * Open the codec engine 
-     */
-    d->hEngine = Engine_open(ENGINE_NAME, NULL, NULL);
+static void
+dec_pool_key(DecData * d, Int numBufs, DecPoolKey * key)
+{
+    memset(key, 0, sizeof(*key));	/* compared whole, padding included */
+    key->params = d->params;
+    key->numBufs = numBufs;
+}
 
-    if (d->hEngine == NULL) {
-	ms_error("Failed to open codec engine %s\n", ENGINE_NAME);
-	cleanUpQ = TRUE;
-    }
+/*
+ * Get a decoder and its buffers for the stream, from the codec pool if
+ * possible, and lay the frame pool over its BufTab.  The BufTab holds
+ * the reference frames of the stream, the frame being decoded, those
+ * in flight in async mode and DEC_DISPLAY_BUFS frames held downstream.
+ * The bitstream buffer takes a picture of DEC_MB_BYTES per macroblock.
+ */
+static bool_t
+dec_open_codec(DecData * d)
+{
+    VIDDEC2_Params *decParams = &d->params;
+    VIDDEC2_DynamicParams *decDynParams = &d->dynParams;
+    BufferGfx_Attrs gfxAttrs = BufferGfx_Attrs_DEFAULT;
+    Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+    CodecPool_Instance inst;
+    DecPoolKey      key;
+    Int32           bufSize;
+    Int             numBufs;
 
-    // decParams->maxWidth = MS_VIDEO_SIZE_CIF_W;
-    // decParams->maxHeight = MS_VIDEO_SIZE_CIF_H;
-    decParams->maxWidth = 480;
-    decParams->maxHeight = 320;
+    *decParams = Vdec2_Params_DEFAULT;
+    *decDynParams = Vdec2_DynamicParams_DEFAULT;
+    decParams->maxWidth = d->coded_size.width;
+    decParams->maxHeight = d->coded_size.height;
     decParams->forceChromaFormat = XDM_YUV_420P;
+    d->wait_idr = TRUE;
+    d->shedding = FALSE;	/* a new decoder does not skip */
+    d->calm = FALSE;
+    d->inBsBufSize = (d->coded_size.width / 16) *
+	(d->coded_size.height / 16) * DEC_MB_BYTES + DEC_HEADER_BYTES;
+    numBufs = d->max_ref_frames + 1 + DEC_DISPLAY_BUFS;
+    if (d->async > 1)
+	numBufs += d->async - 1;
 
     /*
-     * Create the video decoder 
+     * Reuse a parked decoder created with the same params and as many
+     * buffers, if any 
      */
-    d->hVd2 = Vdec2_create(d->hEngine, "h264dec", decParams, decDynParams);
+    dec_pool_key(d, numBufs, &key);
+    if (CodecPool_get(CodecPool_Type_VDEC2, "h264dec", &key, sizeof(key),
+		      decDynParams, &inst)) {
+	d->hEngine = inst.hEngine;
+	d->hVd2 = (Vdec2_Handle) inst.hCodec;
+	d->hDecBuf = inst.hInBuf;
+	d->hBufTabImage = inst.hBufTab;
+    } else {
+	/*
+	 * Create the video decoder, with an engine handle of its own 
+	 */
+	d->hEngine = EngineMgr_acquire();
+	if (d->hEngine == NULL) {
+	    ms_error("Failed to open codec engine %s\n", ENGINE_NAME);
+	    return FALSE;
+	}
+	EngineMgr_lock(d->hEngine);
+	d->hVd2 =
+	    Vdec2_create(d->hEngine, "h264dec", decParams, decDynParams);
+	EngineMgr_unlock(d->hEngine);
+
+	if (d->hVd2 == NULL) {
+	    ms_error("Failed to create video decoder: %s\n", "h264dec");
+	    EngineMgr_release(d->hEngine);
+	    d->hEngine = NULL;
+	    return FALSE;
+	}
 
-    if (d->hVd2 == NULL) {
-	ms_error("Failed to create video decoder: %s\n", "h264dec");
-	cleanUpQ = TRUE;
+	gfxAttrs.colorSpace = ColorSpace_YUV420P;
+	gfxAttrs.dim.width = decParams->maxWidth;
+	gfxAttrs.dim.height = decParams->maxHeight;
+	gfxAttrs.dim.lineLength =
+	    BufferGfx_calcLineLength(gfxAttrs.dim.width,
+				     gfxAttrs.colorSpace);
+	/*
+	 * Buffers are held by the codec (reference frames) and downstream
+	 * (display frames) independently 
+	 */
+	gfxAttrs.bAttrs.useMask = VDEC_CODEC_FREE | VDEC_DISPLAY_FREE;
+
+	/*
+	 * Which output buffer size does the codec require? 
+	 */
+	bufSize = Vdec2_getOutBufSize(d->hVd2);
+	d->hBufTabImage = BufTab_create(numBufs, bufSize,
+					BufferGfx_getBufferAttrs(&gfxAttrs));
+
+	/*
+	 * Vdec2_getInBufSize() asks for far more than a picture of this
+	 * size ever takes 
+	 */
+	d->hDecBuf = Buffer_create(d->inBsBufSize, &bAttrs);
+
+	if (d->hBufTabImage == NULL || d->hDecBuf == NULL) {
+	    ms_error("Failed to allocate the decoder buffers\n");
+	    EngineMgr_lock(d->hEngine);
+	    Vdec2_delete(d->hVd2);
+	    EngineMgr_unlock(d->hEngine);
+	    d->hVd2 = NULL;
+	    EngineMgr_release(d->hEngine);
+	    d->hEngine = NULL;
+	    if (d->hBufTabImage) {
+		BufTab_delete(d->hBufTabImage);
+		d->hBufTabImage = NULL;
+	    }
+	    if (d->hDecBuf) {
+		Buffer_delete(d->hDecBuf);
+		d->hDecBuf = NULL;
+	    }
+	    return FALSE;
+	}
+
+	/*
+	 * The codec is going to use this BufTab for output buffers 
+	 */
+	Vdec2_setBufTab(d->hVd2, d->hBufTabImage);
+	ms_message("Video decoder created for %ix%i, %i frame buffers, "
+		   "%i bytes of bitstream buffer", (int) decParams->maxWidth,
+		   (int) decParams->maxHeight, (int) numBufs,
+		   d->inBsBufSize);
     }
-    // The default transmitting size in linphone is set to
-    // MS_VIDEO_SIZE_CIF
-    gfxAttrs.colorSpace = ColorSpace_YUV420P;
-    // gfxAttrs.dim.width = MS_VIDEO_SIZE_CIF_W;
-    // gfxAttrs.dim.height = MS_VIDEO_SIZE_CIF_H;
-    gfxAttrs.dim.width = 480;
-    gfxAttrs.dim.height = 320;
-    gfxAttrs.dim.lineLength = BufferGfx_calcLineLength(gfxAttrs.dim.width,
-						       gfxAttrs.
-						       colorSpace);
 
     /*
-     * Which output buffer size does the codec require? 
+     * Decoded frames go downstream through a frame pool laid over the
+     * BufTab 
      */
-    bufSize = Vdec2_getOutBufSize(d->hVd2);
+    d->hFramePool = FramePool_createFromBufTab(d->hBufTabImage);
+    if (d->hFramePool == NULL) {
+	ms_error("Failed to create the decoder frame pool");
+	inst.hEngine = d->hEngine;
+	inst.hCodec = d->hVd2;
+	inst.hInBuf = d->hDecBuf;
+	inst.hOutBuf = NULL;
+	inst.hBufTab = d->hBufTabImage;
+	CodecPool_deleteInstance(CodecPool_Type_VDEC2, &inst);
+	d->hEngine = NULL;
+	d->hVd2 = NULL;
+	d->hDecBuf = NULL;
+	d->hBufTabImage = NULL;
+	return FALSE;
+    }
+    d->codec_ref_frames = d->max_ref_frames;
+    return TRUE;
+}
 
-    /*
-     * Allocate video buffers 
-     */
-    d->hBufTabImage = BufTab_create(DISPLAY_PIPE_SIZE, bufSize,
-				    BufferGfx_getBufferAttrs(&gfxAttrs));
+/*
+ * Park the decoder, its engine handle and its buffers for the next call,
+ * or delete them if frames of the BufTab are still held downstream 
+ */
+static void
+dec_close_codec(DecData * d)
+{
+    CodecPool_Instance inst;
+    DecPoolKey      key;
+
+    if (d->hVd2 == NULL)
+	return;
+
+    inst.hEngine = d->hEngine;
+    inst.hCodec = d->hVd2;
+    inst.hInBuf = d->hDecBuf;
+    inst.hOutBuf = NULL;
+    inst.hBufTab = d->hBufTabImage;
+    if (d->hFramePool != NULL && FramePool_getNumHeld(d->hFramePool) > 0) {
+	/*
+	 * Frames are still held downstream: the BufTab cannot be reset
+	 * for the next call, it goes with the pool when they are freed 
+	 */
+	FramePool_adoptBufTab(d->hFramePool);
+	inst.hBufTab = NULL;
+	CodecPool_deleteInstance(CodecPool_Type_VDEC2, &inst);
+    } else {
+	/*
+	 * Park the decoder and its buffers for the next call.  hVidBuf
+	 * belongs to the BufTab.
+	 */
+	dec_pool_key(d, BufTab_getNumBufs(d->hBufTabImage), &key);
+	CodecPool_put(CodecPool_Type_VDEC2, "h264dec", &key, sizeof(key),
+		      &d->dynParams, &inst);
+    }
+    FramePool_delete(d->hFramePool);
+    d->hFramePool = NULL;
+    d->hEngine = NULL;
+    d->hVd2 = NULL;
+    d->hDecBuf = NULL;
+    d->hBufTabImage = NULL;
+    d->hVidBuf = NULL;
+}
+
+/*
+ * In async mode, the input buffers of the ring: slot 0 is the decoder's
+ * own, the others are allocated with the same size.  Falls back to
+ * synchronous decoding if anything fails.
+ */
+static void
+dec_start_worker(DecData * d)
+{
+    Buffer_Attrs    bAttrs = Buffer_Attrs_DEFAULT;
+    int             i;
 
-    if (d->hBufTabImage == NULL) {
-	ms_error("Failed to create BufTab for decoder\n");
-	cleanUpQ = TRUE;
+    d->hDecBufs[0] = d->hDecBuf;
+    for (i = 1; i < d->async; i++) {
+	d->hDecBufs[i] = Buffer_create(Buffer_getSize(d->hDecBuf), &bAttrs);
+	if (d->hDecBufs[i] == NULL)
+	    break;
     }
 
-    /*
-     * The codec is going to use this BufTab for output buffers 
-     */
-    Vdec2_setBufTab(d->hVd2, d->hBufTabImage);
+    if (i == d->async)
+	d->hWorker = VdecWorker_create(d->hEngine, d->hVd2, d->hFramePool,
+				       d->hDecBufs, d->async);
+    if (d->hWorker == NULL) {
+	ms_warning("Async decode unavailable, decoding on the ticker thread");
+	for (i = 1; i < d->async; i++)
+	    if (d->hDecBufs[i])
+		Buffer_delete(d->hDecBufs[i]);
+	memset(d->hDecBufs, 0, sizeof(d->hDecBufs));
+	return;
+    }
+    ms_message("Decoding on a worker thread, %i frames in flight",
+	       d->async);
+}
+
+static void
+dec_stop_worker(DecData * d)
+{
+    int             i;
+
+    if (d->hWorker == NULL)
+	return;
 
     /*
-     * which input buffer size does the decoder require? 
-     */
-    /*
-     * maybe it can be obtained by the encoder, because the required 
-     */
-    /*
-     * buffer size determined by the VDEC2 is 1.5M, but it is not 
+     * Frames still in the pipeline are decoded but not output 
      */
+    VdecWorker_delete(d->hWorker);
+    d->hWorker = NULL;
+    d->pending = 0;
+    for (i = 1; i < d->async; i++)
+	Buffer_delete(d->hDecBufs[i]);
+    memset(d->hDecBufs, 0, sizeof(d->hDecBufs));
+}
+
+static void     dec_prime_headers(DecData * d);
+
+static void
+dec_preprocess(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+
+    if (d->hVd2 == NULL) {
+	if (!dec_open_codec(d))
+	    return;
+	dec_prime_headers(d);
+    }
+
+    if (d->async >= 2)
+	dec_start_worker(d);
+}
+
+static void
+dec_postprocess(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+
+    dec_stop_worker(d);
+}
+
+static void
+dec_uninit(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+
+    rfc3984_uninit(&d->unpacker);
+    ms_queue_flush(&d->au);
+    ms_queue_flush(&d->nalus);
+    dec_close_codec(d);
+
+    if (d->sps)
+	freemsg(d->sps);
+    if (d->pps)
+	freemsg(d->pps);
+    ms_free(d);
+}
+
+static void
+update_sps(DecData * d, mblk_t * sps)
+{
+    if (d->sps)
+	freemsg(d->sps);
+    d->sps = dupb(sps);
+}
+
+static void
+update_pps(DecData * d, mblk_t * pps)
+{
+    if (d->pps)
+	freemsg(d->pps);
+    if (pps)
+	d->pps = dupb(pps);
+    else
+	d->pps = NULL;
+}
+
+static bool_t
+check_sps_pps_change(DecData * d, mblk_t * sps, mblk_t * pps)
+{
+    bool_t          ret1 = FALSE,
+	ret2 = FALSE;
+    if (d->sps) {
+	if (sps) {
+	    ret1 = (msgdsize(sps) != msgdsize(d->sps))
+		|| (memcmp(d->sps->b_rptr, sps->b_rptr, msgdsize(sps)) !=
+		    0);
+	    if (ret1) {
+		update_sps(d, sps);
+		ms_message("SPS changed !");
+		update_pps(d, NULL);
+	    }
+	}
+    } else if (sps) {
+	ms_message("Receiving first SPS");
+	update_sps(d, sps);
+    }
+    if (d->pps) {
+	if (pps) {
+	    ret2 = (msgdsize(pps) != msgdsize(d->pps))
+		|| (memcmp(d->pps->b_rptr, pps->b_rptr, msgdsize(pps)) !=
+		    0);
+	    if (ret2) {
+		ms_message("PPS changed ! %i,%i", msgdsize(pps),
+			   msgdsize(d->pps));
+		update_pps(d, pps);
+	    }
+	}
+    } else if (pps) {
+	ms_message("Receiving first PPS");
+	update_pps(d, pps);
+    }
+    return ret1 || ret2;
+}
+
+static void
+nalusToFrame(DecData *d, Buffer_Handle hDecBuf, Int32 *poffset, mblk_t *im)
+{
+    uint8_t        *dst,
+                   *src;
+    int             nal_len;
+    bool_t          start_picture = TRUE;
+    uint8_t         nalu_type;
+
+    dst = (uint8_t *) Buffer_getUserPtr(hDecBuf) + *poffset;
+    src = im->b_rptr;
+    nal_len = im->b_wptr - src;
+
+    nalu_type = (*src) & 0x1f;
+    // drop SEI messages
+    if (nalu_type != 6) {
+        if (nalu_type == 7)
+            check_sps_pps_change(d, im, NULL);
+        if (nalu_type == 8)
+            check_sps_pps_change(d, NULL, im);
+        if (start_picture || nalu_type == 7/*SPS*/ || nalu_type == 8/*PPS*/ ) {
+            *dst++ = 0;
+            // assume no slices
+            // start_picture = FALSE;
+        }
+        /*prepend nal marker*/
+        *dst++ = 0;
+        *dst++ = 0;
+        *dst++ = 1;
+        *dst++ = *src++;
+
+        while (src < (im->b_wptr - 3)) {
+            if (src[0] == 0 && src[1] == 0 && src[2] < 3) {
+                *dst++ = 0;
+                *dst++ = 0;
+                *dst++ = 3;
+                src += 2;
+            }
+            *dst++ = *src++;
+        }
+        *dst++ = *src++;
+        *dst++ = *src++;
+        *dst++ = *src++;
+        freemsg(im);
+        d->stats.bytes_copied +=
+            dst - (uint8_t *) Buffer_getUserPtr(hDecBuf) - *poffset;
+        *poffset = dst - (uint8_t *) Buffer_getUserPtr(hDecBuf);
+        Buffer_setNumBytesUsed(hDecBuf, *poffset);
+    } else {
+        freemsg(im);
+    }
+}
+
+/*
+ * The picture being received is complete: move it to the decode queue,
+ * marking its last nalu 
+ */
+static void
+dec_end_au(DecData * d)
+{
+    mblk_t         *m;
+
+    if (ms_queue_empty(&d->au))
+	return;
+    while ((m = ms_queue_get(&d->au)) != NULL) {
+	mblk_set_marker_info(m, ms_queue_empty(&d->au));
+	ms_queue_put(&d->nalus, m);
+    }
+    d->au_has_slice = FALSE;
+}
+
+/*
+ * Does this nalu begin a new access unit (H.264 7.4.1.2.3)?  Once the
+ * current one has a slice, an AUD, SPS, PPS or SEI starts the next one,
+ * and so does a slice whose first_mb_in_slice is 0, that is whose
+ * ue(v) starts with a 1 bit.
+ */
+static bool_t
+nalu_starts_picture(DecData * d, mblk_t * nalu)
+{
+    uint8_t         nalu_type = nalu->b_rptr[0] & 0x1f;
+
+    if (!d->au_has_slice)
+	return FALSE;
+
+    switch (nalu_type) {
+    case 6:
+    case 7:
+    case 8:
+    case 9:
+	return TRUE;
+    case 1:
+    case 5:
+	return nalu->b_wptr - nalu->b_rptr > 1 && (nalu->b_rptr[1] & 0x80);
+    default:
+	return FALSE;
+    }
+}
+
+/*
+ * Remember ts as a picture that lost packets, the oldest one goes 
+ */
+static void
+dec_add_damaged(DecData * d, uint32_t ts)
+{
+    d->damaged_ts[d->damaged_idx] = ts;
+    d->damaged_idx = (d->damaged_idx + 1) % DEC_MAX_DAMAGED;
+    if (d->ndamaged < DEC_MAX_DAMAGED)
+	d->ndamaged++;
+}
+
+/*
+ * Takes ts out of the damaged pictures, returns TRUE if it was there 
+ */
+static bool_t
+dec_take_damaged(DecData * d, uint32_t ts)
+{
+    int             i;
+
+    for (i = 0; i < d->ndamaged; i++) {
+	if (d->damaged_ts[i] == ts) {
+	    d->damaged_ts[i] = d->damaged_ts[--d->ndamaged];
+	    d->damaged_idx = d->ndamaged;
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+/*
+ * RTP sequence gaps.  Packets lost between two packets of a picture
+ * damage that picture only.  Across a timestamp change they may have
+ * been the end of the previous picture (if its marker did not come),
+ * the start of the new one, or whole pictures in between: references
+ * may be gone, so the decoder waits for an IDR.  Packets without a
+ * sequence number (0 all along) are never taken for a gap.
+ */
+static void
+dec_check_sequence(DecData * d, mblk_t * im)
+{
+    uint16_t        seq = mblk_get_cseq(im);
+    uint32_t        ts = mblk_get_timestamp_info(im);
+    int16_t         delta = (int16_t) (seq - d->last_seq);
+
+    if (d->seq_valid && delta > 1) {
+	ms_warning("%i video packets lost", delta - 1);
+	dec_add_damaged(d, ts);
+	if (ts != d->last_ts) {
+	    if (!d->last_marker)
+		dec_add_damaged(d, d->last_ts);
+	    d->wait_idr = TRUE;
+	}
+    }
+    if (!d->seq_valid || delta > 0) {
+	d->last_seq = seq;
+	d->last_ts = ts;
+	d->last_marker = mblk_get_marker_info(im);
+	d->seq_valid = TRUE;
+    }
+}
+
+/*
+ * Access unit assembly: a picture ends with the RTP marker bit, when the
+ * timestamp changes (marker lost), or when a nalu starts the next one.
+ * Nalus keep the timestamp of the packet they came in.
+ */
+static void
+dec_feed_packet(DecData * d, mblk_t * im)
+{
+    uint32_t        ts = mblk_get_timestamp_info(im);
+    bool_t          marker = mblk_get_marker_info(im);
+    uint8_t         nalu_type;
+    MSQueue         nalus;
+    mblk_t         *m;
+
+    dec_check_sequence(d, im);
+    ms_queue_init(&nalus);
+    rfc3984_unpack(&d->unpacker, im, &nalus);
+    while ((m = ms_queue_get(&nalus)) != NULL) {
+	if (mblk_get_timestamp_info(m) != d->au_ts
+	    || nalu_starts_picture(d, m))
+	    dec_end_au(d);
+	d->au_ts = mblk_get_timestamp_info(m);
+	nalu_type = m->b_rptr[0] & 0x1f;
+	if (nalu_type >= 1 && nalu_type <= 5)
+	    d->au_has_slice = TRUE;
+	ms_queue_put(&d->au, m);
+    }
+
     /*
-     * needed by the real decoder 
+     * The unpacker only gives out the nalus of the previous timestamp
+     * when a new one begins: no need to wait for more of them
      */
-    if (d->inBsBufSize == 0) {
-	bufSize = Vdec2_getInBufSize(d->hVd2);
-    } else {
-	bufSize = d->inBsBufSize;
+    if (marker || ts != d->au_ts)
+	dec_end_au(d);
+}
+
+/*
+ * Assemble the next picture of nalus into hDecBuf, all its slices
+ * behind the parameter sets, so that it takes a single Vdec2_process().
+ * Returns FALSE if nothing is left to decode.
+ */
+static bool_t
+dec_build_frame(DecData * d, MSQueue * nalus, Buffer_Handle hDecBuf)
+{
+    mblk_t         *msgbm;
+    Int32           offset = 0;
+    bool_t          last = FALSE;
+
+    Buffer_setNumBytesUsed(hDecBuf, 0);
+    while (!last && (msgbm = ms_queue_get(nalus)) != NULL) {
+	last = mblk_get_marker_info(msgbm);
+	/*
+	 * Start code plus emulation prevention bytes in the worst case 
+	 */
+	if (offset + 4 + msgdsize(msgbm) * 3 / 2 > Buffer_getSize(hDecBuf)) {
+	    ms_warning("Picture too large for the decoder input buffer, "
+		       "nalu dropped");
+	    freemsg(msgbm);
+	    continue;
+	}
+	nalusToFrame(d, hDecBuf, &offset, msgbm);
+    }
+    return offset > 0;
+}
+
+/*
+ * Fast start: hand the parameter sets of sprop-parameter-sets to a new
+ * decoder with XDM_PARSE_HEADER, so that it is ready for the first IDR
+ * without waiting for in-band ones.  Runs before the worker starts.
+ */
+static void
+dec_prime_headers(DecData * d)
+{
+    Buffer_Handle   hOutBuf;
+    Int32           offset = 0;
+    VIDDEC2_Status  st;
+    XDAS_Int32      status;
+    Int             ret = Dmai_EFAIL;
+
+    if (d->sps == NULL || d->pps == NULL)
+	return;
+    if ((hOutBuf = FramePool_getFreeBuf(d->hFramePool)) == NULL)
+	return;
+    BufferGfx_resetDimensions(hOutBuf);
+
+    nalusToFrame(d, d->hDecBuf, &offset, dupb(d->sps));
+    nalusToFrame(d, d->hDecBuf, &offset, dupb(d->pps));
+
+    st.size = sizeof(st);
+    st.data.buf = NULL;
+    d->dynParams.decodeHeader = XDM_PARSE_HEADER;
+    EngineMgr_lock(d->hEngine);
+    status = VIDDEC2_control(Vdec2_getVisaHandle(d->hVd2), XDM_SETPARAMS,
+			     &d->dynParams, &st);
+    if (status == VIDDEC2_EOK) {
+	ret = Vdec2_process(d->hVd2, d->hDecBuf, hOutBuf);
+	d->stats.dsp_calls++;
     }
+    d->dynParams.decodeHeader = XDM_DECODE_AU;
+    VIDDEC2_control(Vdec2_getVisaHandle(d->hVd2), XDM_SETPARAMS,
+		    &d->dynParams, &st);
+    EngineMgr_unlock(d->hEngine);
 
     /*
-     * Allocate buffer for encoded data 
+     * No picture came out, the buffer is nobody's 
      */
-    d->hDecBuf = Buffer_create(bufSize, &bAttrs);
+    FramePool_freeUseMask(d->hFramePool, hOutBuf, 0xffff);
+    if (ret == Dmai_EOK)
+	ms_message("Video decoder primed with sprop-parameter-sets");
+    else
+	ms_warning("Video decoder refused sprop-parameter-sets: %i",
+		   (int) (status != VIDDEC2_EOK ? status : ret));
+}
+
+/*
+ * Moving averages over 8 pictures of the decode time and of the time
+ * between pictures, from the RTP timestamps 
+ */
+static void
+dec_account_decode(DecData * d, unsigned long long usecs)
+{
+    account_codec_time(&d->stats, usecs);
+    d->decode_avg += ((int) usecs - d->decode_avg) / 8;
+}
+
+static void
+dec_update_frame_interval(DecData * d, uint32_t ts)
+{
+    uint32_t        delta = ts - d->pic_ts;
+    int             usecs;
+
+    if (d->pic_ts_valid && delta > 0 && delta <= 90 * 200) {
+	usecs = delta * 1000 / 90;
+	d->frame_interval += (usecs - d->frame_interval) / 8;
+    }
+    d->pic_ts = ts;
+    d->pic_ts_valid = TRUE;
+}
+
+/*
+ * Pictures waiting to be decoded: those assembled, and one per
+ * timestamp change among the packets queued on the input 
+ */
+static int
+dec_count_backlog(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+    MSQueue        *q = f->inputs[0];
+    mblk_t         *m;
+    uint32_t        ts = d->au_ts;
+    int             n = 0;
+
+    for (m = ms_queue_peek_first(&d->nalus); !ms_queue_end(&d->nalus, m);
+	 m = ms_queue_next(&d->nalus, m))
+	if (mblk_get_marker_info(m))
+	    n++;
+    for (m = ms_queue_peek_first(q); !ms_queue_end(q, m);
+	 m = ms_queue_next(q, m)) {
+	if (mblk_get_timestamp_info(m) != ts)
+	    n++;
+	ts = mblk_get_timestamp_info(m);
+    }
+    return n;
+}
+
+static void
+dec_set_skip_mode(DecData * d, XDAS_Int32 mode)
+{
+    VIDDEC2_Status  st;
+    XDAS_Int32      status;
+
+    st.size = sizeof(st);
+    st.data.buf = NULL;
+    d->dynParams.frameSkipMode = mode;
+    EngineMgr_lock(d->hEngine);
+    status = VIDDEC2_control(Vdec2_getVisaHandle(d->hVd2), XDM_SETPARAMS,
+			     &d->dynParams, &st);
+    EngineMgr_unlock(d->hEngine);
+    if (status != VIDDEC2_EOK)
+	ms_warning("Video decoder refused frameSkipMode %i: %i", (int) mode,
+		   (int) status);
+}
+
+/*
+ * Load shedding, once per tick.  The decoder falls behind when pictures
+ * pile up on the input (the ARM is late) or when decoding one takes
+ * nearly the time between two (the DSP is).  It then sheds the pictures
+ * that cost the least to lose: the codec skips B pictures
+ * (frameSkipMode) and the non-reference ones are dropped before the DSP
+ * call (see dec_skip_undecodable()).  If pictures still pile up, the
+ * backlog is given up and the decoder goes on from the next IDR, which
+ * only costs parsing.  Shedding stops after DEC_SHED_HOLD ms with the
+ * backlog gone and the whole stream fitting in DEC_SHED_RELAX % of the
+ * DSP time.
+ */
+static void
+dec_update_load(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+    uint64_t        now = f->ticker->time;
+    int             backlog;
+    int             load;
+
+    if (!d->shed_enabled)
+	return;
+    backlog = dec_count_backlog(f);
+    load = d->decode_avg * 100 / d->frame_interval;
+
+    if (!d->shedding) {
+	if (backlog < DEC_SHED_BACKLOG && load <= DEC_SHED_LOAD)
+	    return;
+	ms_message("Video decoder behind (%i pictures queued, load %i%%), "
+		   "shedding non-reference pictures", backlog, load);
+	dec_set_skip_mode(d, IVIDEO_SKIP_B);
+	d->shedding = TRUE;
+	d->calm = FALSE;
+    }
+
+    if (backlog >= DEC_SHED_FLUSH && !d->wait_idr) {
+	ms_warning("Video decoder %i pictures behind, skipping to the "
+		   "next IDR", backlog);
+	d->wait_idr = TRUE;
+    }
+
+    if (backlog > 1 || load >= DEC_SHED_RELAX) {
+	d->calm = FALSE;
+    } else if (!d->calm) {
+	d->calm = TRUE;
+	d->calm_since = now;
+    } else if (now - d->calm_since >= DEC_SHED_HOLD) {
+	ms_message("Video decoder caught up, decoding every picture");
+	dec_set_skip_mode(d, IVIDEO_NO_SKIP);
+	d->shedding = FALSE;
+    }
+}
+
+/*
+ * Ask the sender for an IDR with SD_FILTER_EVENT_SEND_VFU: at once, then
+ * again every DEC_VFU_INTERVAL ms while the decoder still waits 
+ */
+static void
+dec_request_vfu(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+    uint64_t        now = f->ticker->time;
+
+    if (d->vfu_sent && now - d->last_vfu_time < DEC_VFU_INTERVAL)
+	return;
+    ms_message("Waiting for an IDR, asking the sender for one");
+    ms_filter_notify_no_arg(f, SD_FILTER_EVENT_SEND_VFU);
+    d->vfu_sent = TRUE;
+    d->last_vfu_time = now;
+    d->stats.vfu_requests++;
+}
+
+/*
+ * Drop the picture at the head of nalus 
+ */
+static void
+dec_drop_picture(DecData * d)
+{
+    mblk_t         *m;
+    bool_t          last = FALSE;
 
-    if (d->hDecBuf == NULL) {
-	ms_error("Failed to allocate Buffer for decoder input\n");
-	cleanUpQ = TRUE;
+    while (!last && (m = ms_queue_get(&d->nalus)) != NULL) {
+	last = mblk_get_marker_info(m);
+	freemsg(m);
+    }
+}
+
+/*
+ * Reference integrity, checked on the picture at the head of nalus
+ * before it goes to the DSP:
+ *  - a picture that lost packets is dropped; if it was a reference
+ *    (nal_ref_idc != 0, or no slice header left to tell), the pictures
+ *    after it are broken too and the decoder waits for an IDR;
+ *  - while the decoder waits for an IDR (fast start, broken reference,
+ *    decoding error on a reference), the pictures without one are
+ *    dropped rather than decoded into garbage, and an IDR is asked for.
+ * While shedding load (see dec_update_load()), the pictures no other
+ * refers to are dropped as well, before they cost a DSP call.
+ * Returns TRUE if the picture was dropped.  Otherwise au_is_ref tells
+ * whether it is a reference picture.
+ */
+static bool_t
+dec_skip_undecodable(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+    mblk_t         *m;
+    uint32_t        ts;
+    uint8_t         nalu_type;
+    bool_t          idr = FALSE,
+		    has_slice = FALSE;
+
+    d->au_is_ref = FALSE;
+    ts = mblk_get_timestamp_info(ms_queue_peek_first(&d->nalus));
+    dec_update_frame_interval(d, ts);
+    for (m = ms_queue_peek_first(&d->nalus); !ms_queue_end(&d->nalus, m);
+	 m = ms_queue_next(&d->nalus, m)) {
+	nalu_type = m->b_rptr[0] & 0x1f;
+	if (nalu_type >= 1 && nalu_type <= 5) {
+	    has_slice = TRUE;
+	    idr |= nalu_type == 5;
+	    d->au_is_ref |= (m->b_rptr[0] & 0x60) != 0;
+	}
+	if (mblk_get_marker_info(m))
+	    break;
     }
 
-    if (cleanUpQ) {
-	/*
-	 * Clean up the thread before exiting 
-	 */
-	if (d->hVd2) {
-	    Vdec2_delete(d->hVd2);
-	    d->hVd2 = NULL;
+    if (d->ndamaged > 0 && dec_take_damaged(d, ts)) {
+	dec_drop_picture(d);
+	d->stats.skipped_damaged++;
+	if (d->au_is_ref || !has_slice) {
+	    d->wait_idr = TRUE;
+	    dec_request_vfu(f);
 	}
+	return TRUE;
+    }
 
-	if (d->hEngine) {
-	    Engine_close(d->hEngine);
-	    d->hEngine = NULL;
-	}
-	if (d->hBufTabImage) {
-	    BufTab_delete(d->hBufTabImage);
-	    d->hBufTabImage = NULL;
+    if (d->wait_idr) {
+	if (!idr) {
+	    dec_drop_picture(d);
+	    d->stats.skipped_no_idr++;
+	    dec_request_vfu(f);
+	    return TRUE;
 	}
+	d->wait_idr = FALSE;
+	d->vfu_sent = FALSE;
+    }
 
-	if (d->hVidBuf) {
-	    Buffer_delete(d->hVidBuf);
-	    d->hVidBuf = NULL;
-	}
+    if (d->shedding && has_slice && !d->au_is_ref) {
+	dec_drop_picture(d);
+	d->stats.skipped_load++;
+	return TRUE;
+    }
+    return FALSE;
+}
 
-	if (d->hDecBuf) {
-	    Buffer_delete(d->hDecBuf);
-	    d->hDecBuf = NULL;
-	}
+/*
+ * A picture the decoder failed on breaks the pictures that refer to it 
+ */
+static void
+dec_decode_failed(DecData * d, Int ret, bool_t reference)
+{
+    if (ret != Dmai_EBITERROR && ret != Dmai_EFAIL)
+	return;
+    d->stats.decode_errors++;
+    if (reference && !d->wait_idr) {
+	ms_warning("Decoding error on a reference picture, waiting for "
+		   "an IDR");
+	d->wait_idr = TRUE;
     }
 }
 
+/*
+ * Send a decoded frame downstream, the first one with the time it took
+ * since the first packet 
+ */
 static void
-dec_uninit(MSFilter * f)
+dec_output_frame(MSFilter * f, mblk_t * m)
 {
     DecData        *d = (DecData *) f->data;
-    rfc3984_uninit(&d->unpacker);
-    /*
-     * Clean up the thread before exiting 
-     */
-    if (d->hVd2) {
-	Vdec2_delete(d->hVd2);
-	d->hVd2 = NULL;
-    }
 
-    if (d->hEngine) {
-	Engine_close(d->hEngine);
-	d->hEngine = NULL;
-    }
-    if (d->hBufTabImage) {
-	BufTab_delete(d->hBufTabImage);
-	d->hBufTabImage = NULL;
+    ms_queue_put(f->outputs[0], m);
+    d->stats.frames_out++;
+    if (!d->first_frame_out) {
+	d->first_frame_out = TRUE;
+	d->stats.first_frame_usecs = now_usecs() - d->first_packet_usecs;
+	ms_message("First video frame decoded %i ms after the first packet",
+		   (int) (d->stats.first_frame_usecs / 1000));
     }
+}
 
-    if (d->hVidBuf) {
-	Buffer_delete(d->hVidBuf);
-	d->hVidBuf = NULL;
-    }
+/*
+ * An output buffer for the next frame, NULL while every buffer is held by
+ * the codec or downstream.  The caller then leaves its input queued for
+ * the next tick.
+ */
+static Buffer_Handle
+dec_get_out_buf(DecData * d)
+{
+    Buffer_Handle   hBuf = FramePool_getFreeBuf(d->hFramePool);
 
-    if (d->hDecBuf) {
-	Buffer_delete(d->hDecBuf);
-	d->hDecBuf = NULL;
+    if (hBuf == NULL) {
+	d->stats.out_waits++;
+	return NULL;
     }
 
-    if (d->sps)
-	freemsg(d->sps);
-    if (d->pps)
-	freemsg(d->pps);
-    ms_free(d);
+    /*
+     * Make sure the whole buffer is used for output 
+     */
+    BufferGfx_resetDimensions(hBuf);
+    return hBuf;
 }
 
-static void
-update_sps(DecData * d, mblk_t * sps)
+/*
+ * Feed input packets until a whole picture is ready, returns FALSE when
+ * there is none 
+ */
+static bool_t
+dec_next_nalus(MSFilter * f)
 {
-    if (d->sps)
-	freemsg(d->sps);
-    d->sps = dupb(sps);
+    DecData        *d = (DecData *) f->data;
+    mblk_t         *im;
+
+    while (ms_queue_empty(&d->nalus)) {
+	if ((im = ms_queue_get(f->inputs[0])) == NULL)
+	    return FALSE;
+	if (d->first_packet_usecs == 0)
+	    d->first_packet_usecs = now_usecs();
+	d->stats.frames_in++;
+	dec_feed_packet(d, im);
+	d->packet_num++;
+    }
+    return TRUE;
 }
 
-static void
-update_pps(DecData * d, mblk_t * pps)
+/*
+ * An SPS other than the last one seen in the picture about to be
+ * decoded describes the stream anew.  Returns TRUE if the decoder does
+ * not fit the stream any more: the picture is then left queued for the
+ * next one.
+ */
+static bool_t
+dec_stream_changed(DecData * d)
 {
-    if (d->pps)
-	freemsg(d->pps);
-    if (pps)
-	d->pps = dupb(pps);
-    else
-	d->pps = NULL;
+    mblk_t         *m;
+    H264Sps         sps;
+    int             len;
+
+    for (m = ms_queue_peek_first(&d->nalus); !ms_queue_end(&d->nalus, m);
+	 m = ms_queue_next(&d->nalus, m)) {
+	len = m->b_wptr - m->b_rptr;
+	if ((m->b_rptr[0] & 0x1f) == 7
+	    && (d->sps == NULL || msgdsize(d->sps) != len
+		|| memcmp(d->sps->b_rptr, m->b_rptr, len) != 0)
+	    && H264Sps_parse(m->b_rptr, len, &sps))
+	    return dec_set_stream(d, &sps) && !dec_codec_fits(d);
+	if (mblk_get_marker_info(m))
+	    break;
+    }
+    return FALSE;
 }
 
+/*
+ * Returns TRUE if it stopped for a new decoder, see dec_stream_changed() 
+ */
 static bool_t
-check_sps_pps_change(DecData * d, mblk_t * sps, mblk_t * pps)
+dec_process_sync(MSFilter * f)
 {
-    bool_t          ret1 = FALSE,
-	ret2 = FALSE;
-    if (d->sps) {
-	if (sps) {
-	    ret1 = (msgdsize(sps) != msgdsize(d->sps))
-		|| (memcmp(d->sps->b_rptr, sps->b_rptr, msgdsize(sps)) !=
-		    0);
-	    if (ret1) {
-		update_sps(d, sps);
-		ms_message("SPS changed !");
-		update_pps(d, NULL);
+    DecData        *d = (DecData *) f->data;
+    Buffer_Handle   hOutBuf;
+    mblk_t         *m;
+    Int             ret = Dmai_EOK;
+    unsigned long long elapsed;
+
+    while (dec_next_nalus(f)) {
+	if (dec_stream_changed(d))
+	    return TRUE;
+	if (dec_skip_undecodable(f))
+	    continue;
+	if ((hOutBuf = dec_get_out_buf(d)) == NULL)
+	    break;
+
+	if (!dec_build_frame(d, &d->nalus, d->hDecBuf)) {
+	    FramePool_freeUseMask(d->hFramePool, hOutBuf, 0xffff);
+	    continue;
+	}
+
+	elapsed = now_usecs();
+	EngineMgr_lock(d->hEngine);
+	ret = Vdec2_process(d->hVd2, d->hDecBuf, hOutBuf);
+	EngineMgr_unlock(d->hEngine);
+	elapsed = now_usecs() - elapsed;
+	d->stats.dsp_calls++;
+	dec_account_decode(d, elapsed);
+	d->stats.stall_usecs += elapsed;
+
+	if (ret != Dmai_EOK) {
+	    ms_error("Failed to decode video buffer\n");
+	    dec_decode_failed(d, ret, d->au_is_ref);
+	    if (ret == Dmai_EFAIL) {
+		/*
+		 * The codec did not report on the buffers 
+		 */
+		FramePool_freeUseMask(d->hFramePool, hOutBuf, 0xffff);
+		continue;
 	    }
 	}
-    } else if (sps) {
-	ms_message("Receiving first SPS");
-	update_sps(d, sps);
-    }
-    if (d->pps) {
-	if (pps) {
-	    ret2 = (msgdsize(pps) != msgdsize(d->pps))
-		|| (memcmp(d->pps->b_rptr, pps->b_rptr, msgdsize(pps)) !=
-		    0);
-	    if (ret2) {
-		ms_message("PPS changed ! %i,%i", msgdsize(pps),
-			   msgdsize(d->pps));
-		update_pps(d, pps);
+
+	/*
+	 * Send display frames downstream, they go back to the BufTab
+	 * when the last reference is freed
+	 */
+	d->hDispBuf = Vdec2_getDisplayBuf(d->hVd2);
+	while (d->hDispBuf) {
+	    m = FramePool_wrapBuffer(d->hFramePool, d->hDispBuf,
+				     VDEC_DISPLAY_FREE);
+	    if (m != NULL) {
+		dec_output_frame(f, m);
+	    } else {
+		FramePool_freeUseMask(d->hFramePool, d->hDispBuf,
+				      VDEC_DISPLAY_FREE);
 	    }
+	    d->hDispBuf = Vdec2_getDisplayBuf(d->hVd2);
+	}
+
+	/*
+	 * Free up released frames 
+	 */
+	d->hVidBuf = Vdec2_getFreeBuf(d->hVd2);
+	while (d->hVidBuf) {
+	    FramePool_freeUseMask(d->hFramePool, d->hVidBuf,
+				  VDEC_CODEC_FREE);
+	    d->hVidBuf = Vdec2_getFreeBuf(d->hVd2);
 	}
-    } else if (pps) {
-	ms_message("Receiving first PPS");
-	update_pps(d, pps);
     }
-    return ret1 || ret2;
+    return FALSE;
 }
 
-static mblk_t *
-get_as_yuvmsg(Buffer_Handle hVidBuf)
+static void
+dec_output_slot(MSFilter * f, VdecWorker_Slot * slot)
 {
-    mblk_t * yuvmsg;
-    yuvmsg = allocb(Buffer_getNumBytesUsed(hVidBuf), 0);
-
-    memcpy(yuvmsg->b_wptr, Buffer_getUserPtr(hVidBuf),
-	   Buffer_getNumBytesUsed(hVidBuf));
-    yuvmsg->b_wptr += Buffer_getNumBytesUsed(hVidBuf);
+    DecData        *d = (DecData *) f->data;
+    mblk_t         *m;
 
-    return yuvmsg;
+    if (slot->ret != Dmai_EOK) {
+	ms_error("Failed to decode video buffer\n");
+	dec_decode_failed(d, slot->ret, slot->reference);
+	if (slot->ret == Dmai_EFAIL)
+	    FramePool_freeUseMask(d->hFramePool, slot->hOutBuf, 0xffff);
+    }
+    dec_account_decode(d, slot->decodeUsecs);
+    while ((m = ms_queue_get(&slot->frames)) != NULL)
+	dec_output_frame(f, m);
+    VdecWorker_releaseSlot(d->hWorker, slot);
+    d->pending--;
 }
 
-static void
-nalusToFrame(DecData *d, Buffer_Handle hDecBuf, Int32 *poffset, mblk_t *im)
+/*
+ * Async mode: output what the worker decoded since the last tick, then
+ * assemble the new access units into the free slots of the ring while
+ * the DSP works.  The ticker only waits when the ring is full.
+ */
+static bool_t
+dec_process_async(MSFilter * f)
 {
-    uint8_t        *dst,
-                   *src;
-    int             nal_len;
-    bool_t          start_picture = TRUE;
-    uint8_t         nalu_type;
+    DecData        *d = (DecData *) f->data;
+    VdecWorker_Slot *slot;
+    Buffer_Handle   hOutBuf;
+    unsigned long long start;
+
+    while ((slot = VdecWorker_getDoneSlot(d->hWorker, FALSE)) != NULL)
+	dec_output_slot(f, slot);
+
+    while (dec_next_nalus(f)) {
+	if (dec_stream_changed(d))
+	    return TRUE;
+	if (dec_skip_undecodable(f))
+	    continue;
+	while ((slot = VdecWorker_getFreeSlot(d->hWorker)) == NULL) {
+	    start = now_usecs();
+	    slot = VdecWorker_getDoneSlot(d->hWorker, TRUE);
+	    d->stats.stall_usecs += now_usecs() - start;
+	    if (slot)
+		dec_output_slot(f, slot);
+	}
 
-    dst = (uint8_t *) Buffer_getUserPtr(hDecBuf) + *poffset;
-    src = im->b_rptr;
-    nal_len = im->b_wptr - src;
+	if ((hOutBuf = dec_get_out_buf(d)) == NULL)
+	    break;
 
-    nalu_type = (*src) & 0x1f;
-    // drop SEI messages
-    if (nalu_type != 6) {
-        if (nalu_type == 7)
-            check_sps_pps_change(d, im, NULL);
-        if (nalu_type == 8)
-            check_sps_pps_change(d, NULL, im);
-        if (start_picture || nalu_type == 7/*SPS*/ || nalu_type == 8/*PPS*/ ) {
-            *dst++ = 0;
-            // assume no slices
-            // start_picture = FALSE;
-        }
-        /*prepend nal marker*/
-        *dst++ = 0;
-        *dst++ = 0;
-        *dst++ = 1;
-        *dst++ = *src++;
+	if (!dec_build_frame(d, &d->nalus, slot->hInBuf)) {
+	    FramePool_freeUseMask(d->hFramePool, hOutBuf, 0xffff);
+	    continue;
+	}
 
-        while (src < (im->b_wptr - 3)) {
-            if (src[0] == 0 && src[1] == 0 && src[2] < 3) {
-                *dst++ = 0;
-                *dst++ = 0;
-                *dst++ = 3;
-                src += 2;
-            }
-            *dst++ = *src++;
-        }
-        *dst++ = *src++;
-        *dst++ = *src++;
-        *dst++ = *src++;
-        freemsg(im);
-        *poffset = dst - (uint8_t *) Buffer_getUserPtr(hDecBuf);
-        Buffer_setNumBytesUsed(hDecBuf, *poffset);
-    } else {
-        freemsg(im);
+	slot->hOutBuf = hOutBuf;
+	slot->reference = d->au_is_ref;
+	VdecWorker_submit(d->hWorker, slot);
+	d->stats.dsp_calls++;
+	d->pending++;
     }
+    return FALSE;
 }
 
+/*
+ * Recreate the decoder for the stream after an SPS changed its size.
+ * What is in the pipeline is decoded and output first; frames still
+ * held downstream keep the old BufTab alive.  The new decoder is not
+ * primed, the picture with the new SPS brings its parameter sets.
+ */
 static void
-dec_process(MSFilter * f)
+dec_reopen_codec(MSFilter * f)
 {
     DecData        *d = (DecData *) f->data;
-    mblk_t         *im, *msgbm;
-    MSQueue         nalus;
-    Int             ret = Dmai_EOK;
-    Int32           offset;
-    uint8_t         nalu_type;
-
-    ms_queue_init(&nalus);
-
-    while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-	rfc3984_unpack(&d->unpacker, im, &nalus);
-        while ((msgbm = ms_queue_get(&nalus)) != NULL) {
-            offset = 0;
-            // header info should be packed with one frame
-            nalu_type = msgbm->b_rptr[0] & 0x1f;
-            while (msgbm != NULL && nalu_type > 5 && nalu_type < 9) {
-                nalusToFrame(d, d->hDecBuf, &offset, msgbm);
-                msgbm = ms_queue_get(&nalus);
-                nalu_type = msgbm->b_rptr[0] & 0x1f;
-            }
-	    nalusToFrame(d, d->hDecBuf, &offset, msgbm);
-
-            d->hVidBuf = BufTab_getFreeBuf(d->hBufTabImage);
-
-	    /*
-	     * Make sure the whole buffer is used for input and output 
-	     */
-	    BufferGfx_resetDimensions(d->hVidBuf);
-
-	    ret = Vdec2_process(d->hVd2, d->hDecBuf, d->hVidBuf);
-
-	    if (ret != Dmai_EOK) {
-		ms_error("Failed to decode video buffer\n");
-		break;
-	    }
-
-	    /*
-	     * Send display frames to display thread 
-	     */
-	    d->hDispBuf = Vdec2_getDisplayBuf(d->hVd2);
-	    while (d->hDispBuf) {
-		ms_queue_put(f->outputs[0], get_as_yuvmsg(d->hDispBuf));
-
-		Buffer_freeUseMask(d->hDispBuf, 0xffff);
-                BufferGfx_resetDimensions(d->hDispBuf);
-		d->hDispBuf = Vdec2_getDisplayBuf(d->hVd2);
-	    }
-
-	    /*
-	     * Free up released frames 
-	     */
-	    d->hVidBuf = Vdec2_getFreeBuf(d->hVd2);
-	    while (d->hVidBuf) {
-		Buffer_freeUseMask(d->hVidBuf, 0xffff);
-                BufferGfx_resetDimensions(d->hVidBuf);
-		d->hVidBuf = Vdec2_getFreeBuf(d->hVd2);
-	    }
-        }
-
-	d->packet_num++;
+    VdecWorker_Slot *slot;
+    bool_t          async = d->hWorker != NULL;
+
+    ms_message("Recreating the video decoder for %ix%i",
+	       d->coded_size.width, d->coded_size.height);
+    if (async) {
+	while ((slot = VdecWorker_getDoneSlot(d->hWorker, TRUE)) != NULL)
+	    dec_output_slot(f, slot);
+	dec_stop_worker(d);
+    }
+    dec_close_codec(d);
+    if (!dec_open_codec(d)) {
+	ms_error("Failed to recreate the video decoder");
+	return;
     }
+    if (async)
+	dec_start_worker(d);
+}
+
+static void
+dec_process(MSFilter * f)
+{
+    DecData        *d = (DecData *) f->data;
+    bool_t          changed;
+
+    do {
+	if (d->hVd2 != NULL && !dec_codec_fits(d))
+	    dec_reopen_codec(f);
+	if (d->hVd2 == NULL) {
+	    ms_queue_flush(f->inputs[0]);
+	    return;
+	}
+	dec_update_load(f);
+	if (d->hWorker)
+	    changed = dec_process_async(f);
+	else
+	    changed = dec_process_sync(f);
+    } while (changed);
 }
 
 static int
@@ -857,6 +2545,7 @@ dec_add_fmtp(MSFilter * f, void *arg)
     DecData        *d = (DecData *) f->data;
     const char     *fmtp = (const char *) arg;
     char            value[256];
+    H264Sps         sps;
     if (fmtp_get_value(fmtp, "sprop-parameter-sets", value, sizeof(value))) {
 	char           *b64_sps = value;
 	char           *b64_pps = strchr(value, ',');
@@ -873,13 +2562,89 @@ dec_add_fmtp(MSFilter * f, void *arg)
 	    d->pps->b_wptr +=
 		b64_decode(b64_pps, strlen(b64_pps), d->pps->b_wptr,
 			   sizeof(value));
+	    /*
+	     * Size the decoder for the stream announced, it is created in
+	     * preprocess 
+	     */
+	    if (H264Sps_parse(d->sps->b_rptr, msgdsize(d->sps), &sps))
+		dec_set_stream(d, &sps);
+	    else
+		ms_warning("Could not parse the SPS of "
+			   "sprop-parameter-sets");
 	}
     }
     return 0;
 }
 
+static int
+dec_get_vsize(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+    *(MSVideoSize *) arg = d->vsize;
+    return 0;
+}
+
+static int
+dec_get_stats(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+    *(SDCodecStats *) arg = d->stats;
+    return 0;
+}
+
+static int
+dec_reset_stats(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+    memset(&d->stats, 0, sizeof(d->stats));
+    return 0;
+}
+
+static int
+dec_set_async(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+    int             depth = *(int *) arg;
+
+    if (d->hWorker != NULL) {
+	ms_error("SDH264Dec: async mode must be set before preprocess");
+	return -1;
+    }
+    if (depth > VDEC_WORKER_MAX_SLOTS)
+	depth = VDEC_WORKER_MAX_SLOTS;
+    d->async = depth;
+    return 0;
+}
+
+static int
+dec_get_pending(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+    *(int *) arg = d->pending;
+    return 0;
+}
+
+static int
+dec_set_load_shedding(MSFilter * f, void *arg)
+{
+    DecData        *d = (DecData *) f->data;
+
+    d->shed_enabled = *(int *) arg != 0;
+    if (!d->shed_enabled && d->shedding && d->hVd2 != NULL) {
+	dec_set_skip_mode(d, IVIDEO_NO_SKIP);
+	d->shedding = FALSE;
+    }
+    return 0;
+}
+
 static MSFilterMethod h264_dec_methods[] = {
     {MS_FILTER_ADD_FMTP, dec_add_fmtp},
+    {MS_FILTER_GET_VIDEO_SIZE, dec_get_vsize},
+    {SD_FILTER_GET_STATS, dec_get_stats},
+    {SD_FILTER_RESET_STATS, dec_reset_stats},
+    {SD_FILTER_SET_ASYNC, dec_set_async},
+    {SD_FILTER_GET_PENDING, dec_get_pending},
+    {SD_FILTER_SET_LOAD_SHEDDING, dec_set_load_shedding},
     {0, NULL}
 };
 
@@ -892,7 +2657,9 @@ static MSFilterDesc h264_dec_desc = {
     .ninputs = 1,
     .noutputs = 1,
     .init = dec_init,
+    .preprocess = dec_preprocess,
     .process = dec_process,
+    .postprocess = dec_postprocess,
     .uninit = dec_uninit,
     .methods = h264_dec_methods
 };
@@ -913,3 +2680,9 @@ libsdcodecdspbundle_init(void)
     ms_filter_register(&g729_enc_desc);
     ms_message("SD-CODEC-DSP-BUNDLE-" VERSION " plugin registered.");
 }
+
+void
+libsdcodecdspbundle_uninit(void)
+{
+    CodecPool_drain();
+}
@@ -12,11 +12,22 @@
  * 
  */
 
+#include <string.h>
+#include <sys/time.h>
+
 #include <mediastreamer2/msfilter.h>
 
+#include "sdcodecdspbundle.h"
+
 #include "g729_if_dec.h"
 #include "g729_if_enc.h"
+#include "frame_pool.h"
 
+/*
+ * Frame sizes by frame type, the type being in bits 3-6 of the header
+ * byte the codec puts before each frame: speech, SID (Annex B), and
+ * frames not transmitted 
+ */
 static const int g729_frame_sizes[] = {
     10,
     2,
@@ -24,29 +35,41 @@ static const int g729_frame_sizes[] = {
 };
 
 
-#define toc_get_f(toc) ((toc) >> 7)
 #define toc_get_index(toc)	((toc>>3) & 0xf)
 #define VERSION "0.0.1"
+#define DEFAULT_PTIME 20
+#define ENC_POOL_SIZE 8
+#define FT_SPEECH 0
+#define FT_SID 1
+#define MAX_PACKET_FRAMES 48	/* 480 ms */
 
 typedef struct EncState {
     void           *enc;
     MSBufferizer   *mb;
     uint32_t        ts;
     bool_t          dtx;
+    bool_t          annexb;	/* the far end takes SID frames */
+    bool_t          silent;	/* no frame sent for the last one */
+    int             ptime;	/* ms of speech per packet */
+    int             frames;	/* frames per DSP call */
+    int             packet_frames;	/* frames per packet, from ptime */
+    mblk_t         *pending[MAX_PACKET_FRAMES + G729_MAX_FRAMES_PER_CALL];
+    int             npending;	/* coded frames waiting for their packet */
+    FramePool_Handle hPool;	/* DSP output buffers the packets point to */
+    SDCodecStats    stats;
 } EncState;
 
-static int
-toc_list_check(uint8_t * tl, size_t buflen)
-{
-    int             s = 1;
-    while (toc_get_f(*tl)) {
-	tl++;
-	s++;
-	if (s > buflen) {
-	    return -1;
-	}
-    }
-    return s;
+typedef struct DecState {
+    void           *dec;
+    SDCodecStats    stats;
+} DecState;
+
+static unsigned long long
+now_usecs(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
 }
 
 static int
@@ -56,7 +79,10 @@ enable_vad(MSFilter * f, void *arg)
 
     s->dtx = *(bool_t *) arg;
 
-    G729_Encoder_Interface_ctrl(s->enc, s->dtx);
+    /*
+     * DTX sends SID frames, only for a far end with Annex B 
+     */
+    G729_Encoder_Interface_ctrl(s->enc, s->dtx && s->annexb);
 
     return 0;
 }
@@ -64,60 +90,95 @@ enable_vad(MSFilter * f, void *arg)
 static void
 dec_init(MSFilter * f)
 {
-    f->data = G729_Decoder_Interface_init();
+    DecState       *s = ms_new0(DecState, 1);
+    s->dec = G729_Decoder_Interface_init();
+    f->data = s;
     ms_warning("libmyG729: dec inited.");
 }
 
+/*
+ * Frames of an RFC 3551 payload: 10 byte speech frames back to back, the
+ * last one possibly a 2 byte SID frame.  tocs[] gets the header byte of
+ * each frame, as the codec wants it.  Returns the number of frames, or
+ * -1 for a payload length that does not add up.
+ */
+static int
+dec_split(mblk_t * im, uint8_t * tocs)
+{
+    int             len = im->b_wptr - im->b_rptr;
+    int             n = 0;
+
+    if (len % g729_frame_sizes[FT_SPEECH] != 0
+	&& len % g729_frame_sizes[FT_SPEECH] != g729_frame_sizes[FT_SID])
+	return -1;
+    if ((len + g729_frame_sizes[FT_SPEECH] - 1)
+	/ g729_frame_sizes[FT_SPEECH] > MAX_PACKET_FRAMES)
+	return -1;
+    for (; len >= g729_frame_sizes[FT_SPEECH];
+	 len -= g729_frame_sizes[FT_SPEECH])
+	tocs[n++] = FT_SPEECH << 3;
+    if (len > 0)
+	tocs[n++] = FT_SID << 3;
+    return n;
+}
+
 static void
 dec_process(MSFilter * f)
 {
     static const int nsamples = 80;
+    DecState       *s = (DecState *) f->data;
     mblk_t         *im,
                    *om;
-    uint8_t        *tocs;
-    int             toclen;
-    uint8_t         tmp[12];
+    uint8_t         tocs[MAX_PACKET_FRAMES];
+    unsigned long long elapsed;
 
     while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-	int             sz = msgdsize(im);
-	int             i;
-	if (sz < 2) {
-	    freemsg(im);
-	    continue;
-	}
-	/*
-	 * skip payload header, ignore CMR 
-	 */
-	im->b_rptr++;
+	int             nframes,
+	                n,
+	                i;
+	const uint8_t  *data;
+	s->stats.frames_in++;
 	/*
-	 * see the number of TOCs :
+	 * packets straight from the encoder come in several blocks 
 	 */
-	tocs = im->b_rptr;
-	toclen = toc_list_check(tocs, sz);
-	if (toclen == -1) {
-	    ms_warning("Bad G729AB toc list");
+	if (im->b_cont != NULL)
+	    msgpullup(im, -1);
+	nframes = dec_split(im, tocs);
+	if (nframes < 0) {
+	    ms_warning("Bad G729AB payload of %i bytes",
+		       (int) (im->b_wptr - im->b_rptr));
 	    freemsg(im);
 	    continue;
 	}
-	im->b_rptr += toclen;
 	/*
-	 * iterate through frames, following the toc list
+	 * each frame is staged once in the DSP input buffer and its PCM
+	 * copied once out of the DSP output buffer
 	 */
-	for (i = 0; i < toclen; ++i) {
-	    int             framesz =
-		g729_frame_sizes[toc_get_index(tocs[i])];
-	    if (im->b_rptr + framesz > im->b_wptr) {
-		ms_warning("Truncated G729AB frame");
-		break;
-	    }
-	    tmp[0] = tocs[i];
-	    memcpy(&tmp[1], im->b_rptr, framesz);
-	    om = allocb(nsamples * 2, 0);
-	    G729_Decoder_Interface_Decode(f->data, tmp, (short *) om->b_wptr,
-				     0);
-	    om->b_wptr += nsamples * 2;
-	    im->b_rptr += framesz;
+	s->stats.bytes_copied +=
+	    (im->b_wptr - im->b_rptr) + nframes * (1 + nsamples * 2);
+	/*
+	 * decode them in as few DSP calls as possible, into one buffer of
+	 * PCM per call
+	 */
+	data = im->b_rptr;
+	for (i = 0; i < nframes; i += n) {
+	    n = nframes - i;
+	    if (n > G729_MAX_FRAMES_PER_CALL)
+		n = G729_MAX_FRAMES_PER_CALL;
+	    om = allocb(n * nsamples * 2, 0);
+	    elapsed = now_usecs();
+	    s->stats.dsp_calls +=
+		G729_Decoder_Interface_DecodeFrames(s->dec, tocs + i, data, n,
+						    (short *) om->b_wptr);
+	    elapsed = now_usecs() - elapsed;
+	    s->stats.codec_usecs += elapsed;
+	    if (elapsed > s->stats.codec_max_usecs)
+		s->stats.codec_max_usecs = elapsed;
+	    s->stats.stall_usecs += elapsed;
+	    om->b_wptr += n * nsamples * 2;
 	    ms_queue_put(f->outputs[0], om);
+	    data += n * g729_frame_sizes[FT_SPEECH];
+	    s->stats.frames_out += n;
 	}
 	freemsg(im);
     }
@@ -126,10 +187,34 @@ dec_process(MSFilter * f)
 static void
 dec_uninit(MSFilter * f)
 {
+    DecState       *s = (DecState *) f->data;
     ms_warning("libmyG729: dec_uninit...");
-    G729_Decoder_Interface_exit(f->data);
+    G729_Decoder_Interface_exit(s->dec);
+    ms_free(s);
+}
+
+static int
+dec_get_stats(MSFilter * f, void *arg)
+{
+    DecState       *s = (DecState *) f->data;
+    *(SDCodecStats *) arg = s->stats;
+    return 0;
 }
 
+static int
+dec_reset_stats(MSFilter * f, void *arg)
+{
+    DecState       *s = (DecState *) f->data;
+    memset(&s->stats, 0, sizeof(s->stats));
+    return 0;
+}
+
+static MSFilterMethod g729_dec_methods[] = {
+    {SD_FILTER_GET_STATS, dec_get_stats},
+    {SD_FILTER_RESET_STATS, dec_reset_stats},
+    {0, NULL}
+};
+
 MSFilterDesc g729_dec_desc = {
     .id = MS_FILTER_PLUGIN_ID,
     .name = "HJLG729Dec",
@@ -140,7 +225,8 @@ MSFilterDesc g729_dec_desc = {
     .noutputs = 1,
     .init = dec_init,
     .process = dec_process,
-    .uninit = dec_uninit
+    .uninit = dec_uninit,
+    .methods = g729_dec_methods
 };
 
 static void
@@ -150,6 +236,12 @@ enc_init(MSFilter * f)
     s->dtx = FALSE;
     s->mb = ms_bufferizer_new();
     s->ts = 0;
+    s->annexb = TRUE;
+    s->silent = TRUE;
+    s->ptime = DEFAULT_PTIME;
+    s->frames = 1;
+    s->packet_frames = 1;
+    s->npending = 0;
     f->data = s;
     ms_warning("libmyG729: enc inited.");
 }
@@ -163,12 +255,135 @@ enc_uninit(MSFilter * f)
     ms_free(s);
 }
 
+/*
+ * A packet holds the frames of ptime, whatever the codec takes per call.
+ * Asking for as many frames per DSP call only saves round trips; a codec
+ * that refuses gets several calls per packet.
+ */
+static void
+enc_set_frames(EncState * s)
+{
+    int             frames = s->ptime / 10;
+
+    if (frames > MAX_PACKET_FRAMES)
+	frames = MAX_PACKET_FRAMES;
+    s->packet_frames = frames;
+    if (frames > G729_MAX_FRAMES_PER_CALL)
+	frames = G729_MAX_FRAMES_PER_CALL;
+    s->frames = G729_Encoder_Interface_setFrames(s->enc, frames);
+    ms_message("libmyG729: %i ms per packet, %i frames per DSP call",
+	       s->packet_frames * 10, s->frames);
+}
+
+static int
+enc_add_fmtp(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    const char     *fmtp = (const char *) arg;
+    char            value[16];
+
+    if (fmtp_get_value(fmtp, "ptime", value, sizeof(value))) {
+	s->ptime = atoi(value);
+	if (s->ptime < 10)
+	    s->ptime = 10;
+	if (s->enc != NULL)
+	    enc_set_frames(s);
+    }
+    if (fmtp_get_value(fmtp, "annexb", value, sizeof(value))) {
+	s->annexb = strcmp(value, "no") != 0;
+	if (s->enc != NULL)
+	    G729_Encoder_Interface_ctrl(s->enc, s->dtx && s->annexb);
+    }
+    return 0;
+}
+
+/*
+ * RFC 3551 packets of the first nframes pending frames: the 10 byte
+ * speech frames back to back, a 2 byte SID frame only at the end of a
+ * packet.  The frames not transmitted (Annex B) end a packet too, and
+ * the first packet after them is marked as the start of a talk spurt.
+ * The packets point into the DSP output, no frame is copied.
+ */
+static void
+enc_pack(MSFilter * f, EncState * s, int nframes)
+{
+    static const int nsamples = 80;
+    mblk_t         *om = NULL,
+	*tail = NULL,
+	*m;
+    uint8_t        *p;
+    uint32_t        ts = s->ts;
+    int             ft,
+                    framesz,
+                    i;
+
+    for (i = 0; i < nframes; i++, ts += nsamples) {
+	p = s->pending[i]->b_rptr;
+	ft = toc_get_index(*p);
+	framesz = g729_frame_sizes[ft];
+	if (framesz == 0) {
+	    s->silent = TRUE;
+	} else {
+	    m = dupb(s->pending[i]);
+	    m->b_rptr = p + 1;
+	    m->b_wptr = p + 1 + framesz;
+	    if (om == NULL) {
+		om = m;
+		mblk_set_timestamp_info(om, ts);
+		if (s->silent)
+		    mblk_set_marker_info(om, TRUE);
+		s->silent = FALSE;
+	    } else {
+		tail->b_cont = m;
+	    }
+	    tail = m;
+	}
+	if (ft != FT_SPEECH && om != NULL) {
+	    ms_queue_put(f->outputs[0], om);
+	    om = NULL;
+	}
+    }
+    if (om != NULL)
+	ms_queue_put(f->outputs[0], om);
+
+    s->stats.frames_out += nframes;
+    s->ts = ts;
+    for (i = 0; i < nframes; i++)
+	freemsg(s->pending[i]);
+    s->npending -= nframes;
+    memmove(s->pending, s->pending + nframes,
+	    s->npending * sizeof(mblk_t *));
+}
+
+/*
+ * Queue the frames of one DSP call, coded holding them back to back; each
+ * one keeps a reference to the buffer until it is packed 
+ */
+static void
+enc_queue_frames(EncState * s, mblk_t * coded, int nframes)
+{
+    uint8_t        *p = coded->b_rptr;
+    mblk_t         *m;
+    int             i;
+
+    for (i = 0; i < nframes && p < coded->b_wptr; i++) {
+	m = dupb(coded);
+	m->b_rptr = p;
+	p += 1 + g729_frame_sizes[toc_get_index(*p)];
+	m->b_wptr = p;
+	s->pending[s->npending++] = m;
+    }
+}
+
 static void
 enc_preprocess(MSFilter * f)
 {
     ms_warning("libmyG729: enc_preprocessing...");
     EncState       *s = (EncState *) f->data;
-    s->enc = G729_Encoder_Interface_init(s->dtx);
+    s->enc = G729_Encoder_Interface_init(s->dtx && s->annexb);
+    enc_set_frames(s);
+    s->hPool =
+	FramePool_create(ENC_POOL_SIZE, G729_MAX_FRAMES_PER_CALL * 11, NULL);
 }
 
 static void
@@ -178,28 +393,62 @@ enc_process(MSFilter * f)
     ms_warning("libmyG729: enc_process start...");
     EncState       *s = (EncState *) f->data;
     mblk_t         *im,
-                   *om;
-    int16_t         samples[nsamples];
+                   *coded;
+    uint8_t        *speech = G729_Encoder_Interface_getInBuf(s->enc);
+    unsigned long long elapsed;
 
     while ((im = ms_queue_get(f->inputs[0])) != NULL) {
 	ms_bufferizer_put(s->mb, im);
     }
-    while ((ms_bufferizer_read(s->mb, (uint8_t *) samples, nsamples * 2))
-	   >= nsamples * 2) {
+    /*
+     * the samples go straight from the bufferizer to the DSP input buffer
+     */
+    while ((ms_bufferizer_read(s->mb, speech, s->frames * nsamples * 2))
+	   >= s->frames * nsamples * 2) {
 	int             ret;
-	om = allocb(12, 0);
-	*om->b_wptr = 0xf0;
-	om->b_wptr++;
-	ret = G729_Encoder_Interface_Encode(s->enc, samples, om->b_wptr);
+	Buffer_Handle   hBuf = NULL;
+
+	/*
+	 * and the DSP writes the frames to a pool buffer the packets then
+	 * point to, unless they are all still held downstream
+	 */
+	coded = s->hPool != NULL ? FramePool_getFrame(s->hPool) : NULL;
+	if (coded != NULL)
+	    hBuf = FramePool_getBuffer(coded);
+	else
+	    coded = allocb(G729_MAX_FRAMES_PER_CALL * 11, 0);
+
+	elapsed = now_usecs();
+	ret = G729_Encoder_Interface_EncodeInBuf(s->enc, s->frames, hBuf,
+						 coded->b_wptr);
+	elapsed = now_usecs() - elapsed;
+	s->stats.codec_usecs += elapsed;
+	if (elapsed > s->stats.codec_max_usecs)
+	    s->stats.codec_max_usecs = elapsed;
+	/*
+	 * the call is synchronous, the ticker waits for all of it 
+	 */
+	s->stats.stall_usecs += elapsed;
+	s->stats.frames_in += s->frames;
+	s->stats.dsp_calls++;
 	if (ret <= 0) {
+	    /*
+	     * the frames before the lost ones go out on their own 
+	     */
 	    ms_warning("G729_Encoder returned %i", ret);
-	    freemsg(om);
+	    freemsg(coded);
+	    if (s->npending > 0)
+		enc_pack(f, s, s->npending);
+	    s->ts += s->frames * nsamples;
 	    continue;
 	}
-	om->b_wptr += ret;
-	mblk_set_timestamp_info(om, s->ts);
-	s->ts += nsamples;
-	ms_queue_put(f->outputs[0], om);
+	s->stats.bytes_copied +=
+	    s->frames * nsamples * 2 + (hBuf == NULL ? ret : 0);
+	coded->b_wptr += ret;
+	enc_queue_frames(s, coded, s->frames);
+	freemsg(coded);
+	while (s->npending >= s->packet_frames)
+	    enc_pack(f, s, s->packet_frames);
     }
 }
 
@@ -209,12 +458,35 @@ enc_postprocess(MSFilter * f)
     EncState       *s = (EncState *) f->data;
     ms_warning("libmyG729: enc_postprocess...");
     G729_Encoder_Interface_exit(s->enc);
+    while (s->npending > 0)
+	freemsg(s->pending[--s->npending]);
+    FramePool_delete(s->hPool);
+    s->hPool = NULL;
     s->enc = NULL;
     ms_bufferizer_flush(s->mb);
 }
 
+static int
+enc_get_stats(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    *(SDCodecStats *) arg = s->stats;
+    return 0;
+}
+
+static int
+enc_reset_stats(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    memset(&s->stats, 0, sizeof(s->stats));
+    return 0;
+}
+
 static MSFilterMethod hjlg729_methods[] = {
     {MS_FILTER_ENABLE_VAD, enable_vad},
+    {MS_FILTER_ADD_FMTP, enc_add_fmtp},
+    {SD_FILTER_GET_STATS, enc_get_stats},
+    {SD_FILTER_RESET_STATS, enc_reset_stats},
     {0, NULL}
 };
 
@@ -12,10 +12,16 @@
  * 
  */
 
+#include <stdlib.h>
+#include <sys/time.h>
+
 #include <mediastreamer2/msfilter.h>
 
+#include "sdcodecdspbundle.h"
+
 #include "amr_if_dec.h"
 #include "amr_if_enc.h"
+#include "frame_pool.h"
 
 /*
  * Class A total speech Index Mode bits bits
@@ -44,43 +50,99 @@ static const int amr_frame_sizes[] = {
     0, 0, 0, 0, 0, 0, 0
 };
 
+/*
+ * Speech bits of a frame, as packed in bandwidth-efficient mode 
+ */
+static const int amr_frame_bits[] = {
+    95,
+    103,
+    118,
+    134,
+    148,
+    159,
+    204,
+    244,
+    39,
+    0, 0, 0, 0, 0, 0, 0
+};
+
+/*
+ * Bit rate of each mode, in bps 
+ */
+static const int amr_mode_bitrates[] = {
+    4750, 5150, 5900, 6700, 7400, 7950, 10200, 12200
+};
+
 
 #define toc_get_f(toc) ((toc) >> 7)
 #define toc_get_index(toc)	((toc>>3) & 0xf)
+#define toc_get_q(toc)	(((toc) >> 2) & 1)
+#define toc_index_valid(ft)	((ft) <= 8 || (ft) == FT_NO_DATA)
 #define VERSION "0.0.1"
+#define DEFAULT_PTIME 20
+#define ENC_POOL_SIZE 8
+#define CMR_NONE 15
+#define FT_NO_DATA 15
+#define MAX_PACKET_FRAMES 24	/* 480 ms, far over any maxptime */
 
 typedef struct EncState {
     void           *enc;
     MSBufferizer   *mb;
     uint32_t        ts;
     bool_t          dtx;
+    bool_t          octet_align;	/* RFC 4867 octet-aligned mode */
+    bool_t          silent;	/* nothing sent for the last packet */
+    int             ptime;	/* ms of speech per packet */
+    int             maxptime;	/* upper bound of ptime, 0: none */
+    int             frames;	/* frames per DSP call */
+    int             packet_frames;	/* frames per packet, from ptime */
+    mblk_t         *pending[MAX_PACKET_FRAMES + AMRNB_MAX_FRAMES_PER_CALL];
+    int             npending;	/* coded frames waiting for their packet */
+    FramePool_Handle hPool;	/* DSP output buffers the packets point to */
     int             mode;
+    int             mode_set;	/* modes allowed, one bit each */
+    SDCodecStats    stats;
 } EncState;
 
-static int
-toc_list_check(uint8_t * tl, size_t buflen)
+typedef struct DecState {
+    void           *dec;
+    bool_t          octet_align;	/* RFC 4867 octet-aligned mode */
+    int             cmr;	/* last mode request of the sender */
+    SDCodecStats    stats;
+} DecState;
+
+static unsigned long long
+now_usecs(void)
 {
-    int             s = 1;
-    while (toc_get_f(*tl)) {
-	tl++;
-	s++;
-	if (s > buflen) {
-	    return -1;
-	}
-    }
-    return s;
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
 }
 
-static int
-set_bitrate(MSFilter * f, void *arg)
+/*
+ * Bit fields of the bandwidth-efficient mode, most significant bit first.
+ * put_bits() expects the buffer cleared.
+ */
+static void
+put_bits(uint8_t * buf, int *pos, unsigned int value, int n)
 {
-    EncState       *s = (EncState *) f->data;
-
-    s->mode = *(int *) arg;
+    while (n-- > 0) {
+	if ((value >> n) & 1)
+	    buf[*pos >> 3] |= 0x80 >> (*pos & 7);
+	(*pos)++;
+    }
+}
 
-    Encoder_Interface_ctrl(s->enc, s->dtx, s->mode);
+static unsigned int
+get_bits(const uint8_t * buf, int *pos, int n)
+{
+    unsigned int    value = 0;
 
-    return 0;
+    while (n-- > 0) {
+	value = (value << 1) | ((buf[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+	(*pos)++;
+    }
+    return value;
 }
 
 static int
@@ -99,60 +161,152 @@ static void
 dec_init(MSFilter * f)
 {
 
-    f->data = Decoder_Interface_init();
+    DecState       *s = ms_new0(DecState, 1);
+    s->dec = Decoder_Interface_init();
+    s->octet_align = FALSE;
+    s->cmr = CMR_NONE;
+    f->data = s;
     ms_warning("libmyamr: dec inited.");
 }
 
+/*
+ * Split an RFC 4867 payload into its frames.  tocs[] gets the TOC entries
+ * and *data the speech of the frames, back to back and padded to an
+ * octet each: the payload itself in octet-aligned mode, what is unpacked
+ * to buf in bandwidth-efficient mode.  Every field is checked against
+ * the payload length.  Returns the number of complete frames, or -1 for
+ * a payload that does not parse.
+ */
+static int
+dec_unpack(DecState * s, mblk_t * im, uint8_t * tocs,
+	   const uint8_t ** data, uint8_t * buf, int *cmr)
+{
+    const uint8_t  *p = im->b_rptr;
+    int             len = im->b_wptr - im->b_rptr;
+    int             n = 0,
+	            pos = 0,
+	            i,
+	            k,
+	            ft,
+	            nbits;
+    uint8_t        *out = buf;
+
+    if (s->octet_align) {
+	if (len < 2)
+	    return -1;
+	*cmr = p[pos++] >> 4;
+	do {
+	    if (pos >= len || n == MAX_PACKET_FRAMES
+		|| !toc_index_valid(toc_get_index(p[pos])))
+		return -1;
+	    tocs[n++] = p[pos++];
+	} while (toc_get_f(tocs[n - 1]));
+	*data = p + pos;
+	for (i = 0; i < n; i++) {
+	    pos += amr_frame_sizes[toc_get_index(tocs[i])];
+	    if (pos > len) {
+		ms_warning("Truncated amr frame");
+		break;
+	    }
+	}
+	return i;
+    }
+
+    len *= 8;
+    if (len < 4)
+	return -1;
+    *cmr = get_bits(p, &pos, 4);
+    do {
+	if (pos + 6 > len || n == MAX_PACKET_FRAMES)
+	    return -1;
+	tocs[n] = get_bits(p, &pos, 6) << 2;
+	if (!toc_index_valid(toc_get_index(tocs[n])))
+	    return -1;
+    } while (toc_get_f(tocs[n++]));
+    for (i = 0; i < n; i++) {
+	ft = toc_get_index(tocs[i]);
+	nbits = amr_frame_bits[ft];
+	if (pos + nbits > len) {
+	    ms_warning("Truncated amr frame");
+	    break;
+	}
+	for (k = 0; k < nbits; k += 8)
+	    *out++ = get_bits(p, &pos, nbits - k < 8 ? nbits - k : 8)
+		<< (nbits - k < 8 ? 8 - (nbits - k) : 0);
+    }
+    s->stats.bytes_copied += out - buf;
+    *data = buf;
+    return i;
+}
+
 static void
 dec_process(MSFilter * f)
 {
     static const int nsamples = 160;
+    DecState       *s = (DecState *) f->data;
     mblk_t         *im,
                    *om;
-    uint8_t        *tocs;
-    int             toclen;
-    uint8_t         tmp[32];
+    uint8_t         tocs[MAX_PACKET_FRAMES];
+    uint8_t         unpacked[MAX_PACKET_FRAMES * 31];
+    unsigned long long elapsed;
 
     while ((im = ms_queue_get(f->inputs[0])) != NULL) {
-	int             sz = msgdsize(im);
-	int             i;
-	if (sz < 2) {
+	int             nframes,
+	                cmr,
+	                n,
+	                i,
+	                j;
+	const uint8_t  *data;
+	s->stats.frames_in++;
+	/*
+	 * packets straight from the encoder come in several blocks 
+	 */
+	if (im->b_cont != NULL)
+	    msgpullup(im, -1);
+	nframes = dec_unpack(s, im, tocs, &data, unpacked, &cmr);
+	if (nframes < 0) {
+	    ms_warning("Bad AMR payload");
 	    freemsg(im);
 	    continue;
 	}
 	/*
-	 * skip payload header, ignore CMR 
+	 * the sender asks for another mode of our encoder 
 	 */
-	im->b_rptr++;
+	if (cmr != s->cmr) {
+	    s->cmr = cmr;
+	    if (cmr != CMR_NONE)
+		ms_filter_notify(f, SD_FILTER_EVENT_AMR_CMR, &cmr);
+	}
 	/*
-	 * see the number of TOCs :
+	 * each frame is staged once in the DSP input buffer and its PCM
+	 * copied once out of the DSP output buffer
 	 */
-	tocs = im->b_rptr;
-	toclen = toc_list_check(tocs, sz);
-	if (toclen == -1) {
-	    ms_warning("Bad AMR toc list");
-	    freemsg(im);
-	    continue;
-	}
-	im->b_rptr += toclen;
+	for (i = 0; i < nframes; i++)
+	    s->stats.bytes_copied +=
+		1 + amr_frame_sizes[toc_get_index(tocs[i])] + nsamples * 2;
 	/*
-	 * iterate through frames, following the toc list
+	 * decode them in as few DSP calls as possible, into one buffer of
+	 * PCM per call
 	 */
-	for (i = 0; i < toclen; ++i) {
-	    int             framesz =
-		amr_frame_sizes[toc_get_index(tocs[i])];
-	    if (im->b_rptr + framesz > im->b_wptr) {
-		ms_warning("Truncated amr frame");
-		break;
-	    }
-	    tmp[0] = tocs[i];
-	    memcpy(&tmp[1], im->b_rptr, framesz);
-	    om = allocb(nsamples * 2, 0);
-	    Decoder_Interface_Decode(f->data, tmp, (short *) om->b_wptr,
-				     0);
-	    om->b_wptr += nsamples * 2;
-	    im->b_rptr += framesz;
+	for (i = 0; i < nframes; i += n) {
+	    n = nframes - i;
+	    if (n > AMRNB_MAX_FRAMES_PER_CALL)
+		n = AMRNB_MAX_FRAMES_PER_CALL;
+	    om = allocb(n * nsamples * 2, 0);
+	    elapsed = now_usecs();
+	    s->stats.dsp_calls +=
+		Decoder_Interface_DecodeFrames(s->dec, tocs + i, data, n,
+					       (short *) om->b_wptr);
+	    elapsed = now_usecs() - elapsed;
+	    s->stats.codec_usecs += elapsed;
+	    if (elapsed > s->stats.codec_max_usecs)
+		s->stats.codec_max_usecs = elapsed;
+	    s->stats.stall_usecs += elapsed;
+	    om->b_wptr += n * nsamples * 2;
 	    ms_queue_put(f->outputs[0], om);
+	    for (j = i; j < i + n; j++)
+		data += amr_frame_sizes[toc_get_index(tocs[j])];
+	    s->stats.frames_out += n;
 	}
 	freemsg(im);
     }
@@ -161,10 +315,65 @@ dec_process(MSFilter * f)
 static void
 dec_uninit(MSFilter * f)
 {
+    DecState       *s = (DecState *) f->data;
     ms_warning("libmyamr: dec_uninit...");
-    Decoder_Interface_exit(f->data);
+    Decoder_Interface_exit(s->dec);
+    ms_free(s);
+}
+
+/*
+ * Payload options we cannot honour 
+ */
+static void
+check_unsupported(const char *fmtp)
+{
+    static const char *const options[] =
+	{ "crc", "robust-sorting", "interleaving", NULL };
+    char            value[16];
+    int             i;
+
+    for (i = 0; options[i] != NULL; i++)
+	if (fmtp_get_value(fmtp, options[i], value, sizeof(value))
+	    && atoi(value) != 0)
+	    ms_warning("libmyamr: %s=%s not supported", options[i], value);
+}
+
+static int
+dec_add_fmtp(MSFilter * f, void *arg)
+{
+    DecState       *s = (DecState *) f->data;
+    const char     *fmtp = (const char *) arg;
+    char            value[16];
+
+    if (fmtp_get_value(fmtp, "octet-align", value, sizeof(value)))
+	s->octet_align = atoi(value) == 1;
+    check_unsupported(fmtp);
+    return 0;
+}
+
+static int
+dec_get_stats(MSFilter * f, void *arg)
+{
+    DecState       *s = (DecState *) f->data;
+    *(SDCodecStats *) arg = s->stats;
+    return 0;
 }
 
+static int
+dec_reset_stats(MSFilter * f, void *arg)
+{
+    DecState       *s = (DecState *) f->data;
+    memset(&s->stats, 0, sizeof(s->stats));
+    return 0;
+}
+
+static MSFilterMethod amr_dec_methods[] = {
+    {MS_FILTER_ADD_FMTP, dec_add_fmtp},
+    {SD_FILTER_GET_STATS, dec_get_stats},
+    {SD_FILTER_RESET_STATS, dec_reset_stats},
+    {0, NULL}
+};
+
 MSFilterDesc amr_dec_desc = {
     .id = MS_FILTER_PLUGIN_ID,
     .name = "HJLAmrDec",
@@ -175,7 +384,8 @@ MSFilterDesc amr_dec_desc = {
     .noutputs = 1,
     .init = dec_init,
     .process = dec_process,
-    .uninit = dec_uninit
+    .uninit = dec_uninit,
+    .methods = amr_dec_methods
 };
 
 static void
@@ -185,7 +395,15 @@ enc_init(MSFilter * f)
     s->dtx = FALSE;
     s->mb = ms_bufferizer_new();
     s->ts = 0;
+    s->octet_align = FALSE;
+    s->silent = TRUE;
+    s->ptime = DEFAULT_PTIME;
+    s->maxptime = 0;
+    s->frames = 1;
+    s->packet_frames = 1;
+    s->npending = 0;
     s->mode = 7;
+    s->mode_set = 0xff;
     f->data = s;
     ms_warning("libmyamr: enc inited.");
 }
@@ -199,6 +417,250 @@ enc_uninit(MSFilter * f)
     ms_free(s);
 }
 
+/*
+ * A packet holds the frames of ptime, whatever the codec takes per call.
+ * Asking for as many frames per DSP call only saves round trips; a codec
+ * that refuses gets several calls per packet.
+ */
+static void
+enc_set_frames(EncState * s)
+{
+    int             ptime = s->ptime;
+    int             frames;
+
+    if (s->maxptime > 0 && ptime > s->maxptime)
+	ptime = s->maxptime;
+    frames = ptime / 20;
+    if (frames < 1)
+	frames = 1;
+    if (frames > MAX_PACKET_FRAMES)
+	frames = MAX_PACKET_FRAMES;
+    s->packet_frames = frames;
+    if (frames > AMRNB_MAX_FRAMES_PER_CALL)
+	frames = AMRNB_MAX_FRAMES_PER_CALL;
+    s->frames = Encoder_Interface_setFrames(s->enc, frames);
+    ms_message("libmyamr: %i ms per packet, %i frames per DSP call",
+	       s->packet_frames * 20, s->frames);
+}
+
+/*
+ * Keep the mode within the mode-set, at its highest mode otherwise 
+ */
+static void
+enc_check_mode(EncState * s)
+{
+    int             mode;
+
+    if (s->mode >= 0 && s->mode <= 7 && (s->mode_set & (1 << s->mode)))
+	return;
+    for (mode = 7; mode > 0 && !(s->mode_set & (1 << mode)); mode--);
+    s->mode = mode;
+    if (s->enc != NULL)
+	Encoder_Interface_ctrl(s->enc, s->dtx, s->mode);
+}
+
+/*
+ * A mode number (0-7) is taken as is, anything else as a bit rate in bps:
+ * the highest mode not above it, the lowest one under 4750 bps.
+ */
+static int
+set_bitrate(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    int             value = *(int *) arg;
+    int             mode = value;
+
+    if (value < 0)
+	return -1;
+    if (value > 7)
+	for (mode = 7; mode > 0 && amr_mode_bitrates[mode] > value; mode--);
+    s->mode = mode;
+    if (s->mode_set & (1 << mode))
+	Encoder_Interface_ctrl(s->enc, s->dtx, s->mode);
+    else
+	enc_check_mode(s);
+
+    return 0;
+}
+
+static int
+enc_add_fmtp(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    const char     *fmtp = (const char *) arg;
+    char            value[32];
+    char           *p,
+                   *end;
+    int             mode;
+
+    if (fmtp_get_value(fmtp, "ptime", value, sizeof(value))) {
+	s->ptime = atoi(value);
+	if (s->ptime < 20)
+	    s->ptime = 20;
+    }
+    if (fmtp_get_value(fmtp, "maxptime", value, sizeof(value)))
+	s->maxptime = atoi(value);
+    if (s->enc != NULL)
+	enc_set_frames(s);
+    if (fmtp_get_value(fmtp, "octet-align", value, sizeof(value)))
+	s->octet_align = atoi(value) == 1;
+    if (fmtp_get_value(fmtp, "mode-set", value, sizeof(value))) {
+	s->mode_set = 0;
+	for (p = value; *p != '\0'; p = *end != '\0' ? end + 1 : end) {
+	    mode = strtol(p, &end, 10);
+	    if (end != p && mode >= 0 && mode <= 7)
+		s->mode_set |= 1 << mode;
+	}
+	if (s->mode_set == 0)
+	    s->mode_set = 0xff;
+	enc_check_mode(s);
+    }
+    check_unsupported(fmtp);
+    return 0;
+}
+
+/*
+ * The mode request (CMR) the far end sent, see SD_FILTER_EVENT_AMR_CMR 
+ */
+static int
+enc_set_cmr(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    int             mode = *(int *) arg;
+
+    if (mode < 0 || mode > 7 || !(s->mode_set & (1 << mode)))
+	return -1;
+    if (mode != s->mode) {
+	s->mode = mode;
+	if (s->enc != NULL)
+	    Encoder_Interface_ctrl(s->enc, s->dtx, s->mode);
+    }
+    return 0;
+}
+
+/*
+ * The RFC 4867 payload of nframes frames, each frames[i] pointing to one
+ * in the storage format (header byte, then the speech padded to an
+ * octet).  In octet-aligned mode the payload header, CMR and TOC
+ * entries, is a block of its own and the speech is not copied: the
+ * following blocks point into the DSP output.  In bandwidth-efficient
+ * mode everything is packed in one block.  Returns NULL when no frame
+ * holds speech or a SID.
+ */
+static mblk_t  *
+enc_pack(EncState * s, mblk_t ** frames, int nframes)
+{
+    mblk_t         *om,
+                   *m,
+                   *tail;
+    uint8_t        *p;
+    int             bits = 4,
+	            pos = 0,
+	            more,
+	            nbits,
+	            ft,
+	            i,
+	            k;
+    bool_t          sound = FALSE;
+
+    for (i = 0; i < nframes; i++) {
+	ft = toc_get_index(*frames[i]->b_rptr);
+	if (ft != FT_NO_DATA)
+	    sound = TRUE;
+	bits += 6 + amr_frame_bits[ft];
+    }
+    if (!sound)
+	return NULL;
+
+    if (s->octet_align) {
+	om = allocb(1 + nframes, 0);
+	*om->b_wptr++ = CMR_NONE << 4;
+	for (i = 0; i < nframes; i++)
+	    *om->b_wptr++ =
+		(*frames[i]->b_rptr & 0x7c) | (i < nframes - 1 ? 0x80 : 0);
+	for (tail = om, i = 0; i < nframes; i++) {
+	    p = frames[i]->b_rptr;
+	    k = amr_frame_sizes[toc_get_index(*p)];
+	    if (k > 0) {
+		m = dupb(frames[i]);
+		m->b_rptr = p + 1;
+		m->b_wptr = p + 1 + k;
+		tail->b_cont = m;
+		tail = m;
+	    }
+	}
+	return om;
+    }
+
+    om = allocb((bits + 7) / 8, 0);
+    memset(om->b_wptr, 0, (bits + 7) / 8);
+    put_bits(om->b_wptr, &pos, CMR_NONE, 4);
+    for (i = 0; i < nframes; i++) {
+	p = frames[i]->b_rptr;
+	more = i < nframes - 1;
+	put_bits(om->b_wptr, &pos,
+		 (more << 5) | (toc_get_index(*p) << 1) | toc_get_q(*p), 6);
+    }
+    for (i = 0; i < nframes; i++) {
+	p = frames[i]->b_rptr;
+	nbits = amr_frame_bits[toc_get_index(*p)];
+	for (k = 0; k < nbits; k += 8)
+	    put_bits(om->b_wptr, &pos,
+		     nbits - k < 8 ? p[1 + k / 8] >> (8 - (nbits - k)) :
+		     p[1 + k / 8], nbits - k < 8 ? nbits - k : 8);
+    }
+    om->b_wptr += (pos + 7) / 8;
+    s->stats.bytes_copied += om->b_wptr - om->b_rptr;
+    return om;
+}
+
+/*
+ * Queue the frames of one DSP call, coded holding them back to back; each
+ * one keeps a reference to the buffer until it is packed 
+ */
+static void
+enc_queue_frames(EncState * s, mblk_t * coded, int nframes)
+{
+    uint8_t        *p = coded->b_rptr;
+    mblk_t         *m;
+    int             i;
+
+    for (i = 0; i < nframes && p < coded->b_wptr; i++) {
+	m = dupb(coded);
+	m->b_rptr = p;
+	p += 1 + amr_frame_sizes[toc_get_index(*p)];
+	m->b_wptr = p;
+	s->pending[s->npending++] = m;
+    }
+}
+
+/*
+ * Send the first nframes pending frames as one packet.  The first packet
+ * of a talk spurt is marked.
+ */
+static void
+enc_send_packet(MSFilter * f, EncState * s, int nframes)
+{
+    static const int nsamples = 160;
+    mblk_t         *om = enc_pack(s, s->pending, nframes);
+    int             i;
+
+    if (om != NULL) {
+	mblk_set_timestamp_info(om, s->ts);
+	if (s->silent)
+	    mblk_set_marker_info(om, TRUE);
+	ms_queue_put(f->outputs[0], om);
+    }
+    s->silent = om == NULL;
+    s->stats.frames_out += nframes;
+    s->ts += nframes * nsamples;
+    for (i = 0; i < nframes; i++)
+	freemsg(s->pending[i]);
+    s->npending -= nframes;
+    memmove(s->pending, s->pending + nframes,
+	    s->npending * sizeof(mblk_t *));
+}
+
 static void
 enc_preprocess(MSFilter * f)
 {
@@ -206,6 +668,9 @@ enc_preprocess(MSFilter * f)
     EncState       *s = (EncState *) f->data;
 
     s->enc = Encoder_Interface_init(s->dtx, s->mode);
+    enc_set_frames(s);
+    s->hPool =
+	FramePool_create(ENC_POOL_SIZE, AMRNB_MAX_FRAMES_PER_CALL * 32, NULL);
 }
 
 static void
@@ -215,28 +680,62 @@ enc_process(MSFilter * f)
     ms_warning("libmyamr: enc_process start...");
     EncState       *s = (EncState *) f->data;
     mblk_t         *im,
-                   *om;
-    int16_t         samples[nsamples];
+                   *coded;
+    uint8_t        *speech = Encoder_Interface_getInBuf(s->enc);
+    unsigned long long elapsed;
 
     while ((im = ms_queue_get(f->inputs[0])) != NULL) {
 	ms_bufferizer_put(s->mb, im);
     }
-    while ((ms_bufferizer_read(s->mb, (uint8_t *) samples, nsamples * 2))
-	   >= nsamples * 2) {
+    /*
+     * the samples go straight from the bufferizer to the DSP input buffer
+     */
+    while ((ms_bufferizer_read(s->mb, speech, s->frames * nsamples * 2))
+	   >= s->frames * nsamples * 2) {
 	int             ret;
-	om = allocb(33, 0);
-	*om->b_wptr = 0xf0;
-	om->b_wptr++;
-	ret = Encoder_Interface_Encode(s->enc, samples, om->b_wptr);
+	Buffer_Handle   hBuf = NULL;
+
+	/*
+	 * and the DSP writes the frames to a pool buffer the packets then
+	 * point to, unless they are all still held downstream
+	 */
+	coded = s->hPool != NULL ? FramePool_getFrame(s->hPool) : NULL;
+	if (coded != NULL)
+	    hBuf = FramePool_getBuffer(coded);
+	else
+	    coded = allocb(AMRNB_MAX_FRAMES_PER_CALL * 32, 0);
+
+	elapsed = now_usecs();
+	ret = Encoder_Interface_EncodeInBuf(s->enc, s->frames, hBuf,
+					    coded->b_wptr);
+	elapsed = now_usecs() - elapsed;
+	s->stats.codec_usecs += elapsed;
+	if (elapsed > s->stats.codec_max_usecs)
+	    s->stats.codec_max_usecs = elapsed;
+	/*
+	 * the call is synchronous, the ticker waits for all of it 
+	 */
+	s->stats.stall_usecs += elapsed;
+	s->stats.frames_in += s->frames;
+	s->stats.dsp_calls++;
 	if (ret <= 0) {
+	    /*
+	     * the frames before the lost ones go out on their own 
+	     */
 	    ms_warning("Encoder returned %i", ret);
-	    freemsg(om);
+	    freemsg(coded);
+	    if (s->npending > 0)
+		enc_send_packet(f, s, s->npending);
+	    s->ts += s->frames * nsamples;
 	    continue;
 	}
-	om->b_wptr += ret;
-	mblk_set_timestamp_info(om, s->ts);
-	s->ts += nsamples;
-	ms_queue_put(f->outputs[0], om);
+	s->stats.bytes_copied +=
+	    s->frames * nsamples * 2 + (hBuf == NULL ? ret : 0);
+	coded->b_wptr += ret;
+	enc_queue_frames(s, coded, s->frames);
+	freemsg(coded);
+	while (s->npending >= s->packet_frames)
+	    enc_send_packet(f, s, s->packet_frames);
     }
 }
 
@@ -246,13 +745,37 @@ enc_postprocess(MSFilter * f)
     EncState       *s = (EncState *) f->data;
     ms_warning("libmyamr: enc_postprocess...");
     Encoder_Interface_exit(s->enc);
+    while (s->npending > 0)
+	freemsg(s->pending[--s->npending]);
+    FramePool_delete(s->hPool);
+    s->hPool = NULL;
     s->enc = NULL;
     ms_bufferizer_flush(s->mb);
 }
 
+static int
+enc_get_stats(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    *(SDCodecStats *) arg = s->stats;
+    return 0;
+}
+
+static int
+enc_reset_stats(MSFilter * f, void *arg)
+{
+    EncState       *s = (EncState *) f->data;
+    memset(&s->stats, 0, sizeof(s->stats));
+    return 0;
+}
+
 static MSFilterMethod hjlamr_methods[] = {
     {MS_FILTER_SET_BITRATE, set_bitrate},
     {MS_FILTER_ENABLE_VAD, enable_vad},
+    {MS_FILTER_ADD_FMTP, enc_add_fmtp},
+    {SD_FILTER_SET_AMR_CMR, enc_set_cmr},
+    {SD_FILTER_GET_STATS, enc_get_stats},
+    {SD_FILTER_RESET_STATS, enc_reset_stats},
     {0, NULL}
 };
 
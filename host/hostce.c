@@ -0,0 +1,1100 @@
+/*
+ * Host stand-in for the Codec Engine runtime, Engine and the VISA
+ * interfaces used by the bundle (VIDENC1, VIDDEC2, SPHENC1, SPHDEC1).
+ *
+ * The "codecs" do no real compression.  They produce deterministic,
+ * syntactically plausible output of realistic size so that everything
+ * above the VISA layer (DMAI modules, filters, RTP packing) runs
+ * unmodified, and every call that would go to the DSP can be given a
+ * latency with HOSTCE_LATENCY (see hostce.h).
+ *
+ *  - h264enc writes Annex-B access units with 4-byte start codes: an
+ *    SPS (describing the real input size), a PPS and an IDR slice for
+ *    key frames, a single P slice otherwise.  Slice sizes follow
+ *    targetBitRate/targetFrameRate, payload bytes come from a per-frame
+ *    LCG and contain no zero byte so no emulation prevention is needed.
+ *    With the sliceSize extension (include/h264enc/ih264venc.h) the
+ *    picture is cut into slices of that many macroblock rows, the bytes
+ *    of the frame spread evenly over its macroblocks.
+ *  - h264dec decodes any access unit holding a slice once it has seen
+ *    an IDR, filling the output with a flat picture.  Before that, slices
+ *    are rejected as corrupted data.
+ *  - amrnbenc/g729enc write one frame in the bundle's storage format
+ *    (header byte with the frame type index in bits 3-6, then the frame).
+ *    With the frameSize dynamic param set to several frames worth of
+ *    samples they take that many frames per call and write the encoded
+ *    frames back to back, each with its header byte.
+ *  - amrnbdec/g729dec write 20 ms / 10 ms of PCM derived from each frame
+ *    of the input.  Frames given back to back in one call are all
+ *    decoded, as long as the output buffer has room for their PCM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/CERuntime.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video1/videnc1.h>
+#include <ti/sdo/ce/video2/viddec2.h>
+#include <ti/sdo/ce/speech1/sphenc1.h>
+#include <ti/sdo/ce/speech1/sphdec1.h>
+
+#include <h264enc/ih264venc.h>
+
+#include "hostce.h"
+
+#define HOSTCE_ENGINE_NAME      "encodedecode"
+
+/* Rough DM6446 figures, see hostce.h */
+static const UInt32 dm6446Latency[HostCE_Call_COUNT] = {
+    150000,     /* open: DSP link start and server load */
+    4000,       /* create */
+    300,        /* control */
+    20000,      /* venc: 480x320 baseline */
+    9000,       /* vdec: 480x320 baseline */
+    800,        /* senc */
+    400,        /* sdec */
+};
+
+static const Char *callNames[HostCE_Call_COUNT] = {
+    "open", "create", "control", "venc", "vdec", "senc", "sdec"
+};
+
+static UInt32 latency[HostCE_Call_COUNT];
+static UInt32 callCount[HostCE_Call_COUNT];
+static Int    openEngines;      /* the server is loaded while > 0 */
+
+typedef struct Engine_Obj {
+    Engine_Error    lastError;
+} Engine_Obj;
+
+/******************************************************************************
+ * Latency and call accounting
+ ******************************************************************************/
+static Void callEnter(HostCE_Call call)
+{
+    __sync_fetch_and_add(&callCount[call], 1);
+
+    if (latency[call] > 0) {
+        usleep(latency[call]);
+    }
+}
+
+Void HostCE_setLatency(HostCE_Call call, UInt32 usecs)
+{
+    if (call < HostCE_Call_COUNT) {
+        latency[call] = usecs;
+    }
+}
+
+UInt32 HostCE_getLatency(HostCE_Call call)
+{
+    return call < HostCE_Call_COUNT ? latency[call] : 0;
+}
+
+UInt32 HostCE_getCallCount(HostCE_Call call)
+{
+    return call < HostCE_Call_COUNT ? callCount[call] : 0;
+}
+
+Void HostCE_resetCallCounts(Void)
+{
+    memset(callCount, 0, sizeof(callCount));
+}
+
+const Char *HostCE_callName(HostCE_Call call)
+{
+    return call < HostCE_Call_COUNT ? callNames[call] : "unknown";
+}
+
+Int HostCE_parseLatency(const Char *spec)
+{
+    Char    buf[256];
+    Char   *tok;
+    Char   *save;
+    Char   *eq;
+    Int     i;
+
+    if (strcmp(spec, "dm6446") == 0) {
+        memcpy(latency, dm6446Latency, sizeof(latency));
+        return 0;
+    }
+
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (tok = strtok_r(buf, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        eq = strchr(tok, '=');
+        if (eq == NULL) {
+            return -1;
+        }
+        *eq = '\0';
+        for (i = 0; i < HostCE_Call_COUNT; i++) {
+            if (strcmp(tok, callNames[i]) == 0) {
+                latency[i] = strtoul(eq + 1, NULL, 10);
+                break;
+            }
+        }
+        if (i == HostCE_Call_COUNT) {
+            fprintf(stderr, "HostCE: unknown call '%s' in latency spec\n",
+                    tok);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/******************************************************************************
+ * CERuntime
+ ******************************************************************************/
+Void CERuntime_init(Void)
+{
+    const Char *spec = getenv("HOSTCE_LATENCY");
+
+    if (spec != NULL && HostCE_parseLatency(spec) < 0) {
+        fprintf(stderr, "HostCE: ignoring bad HOSTCE_LATENCY '%s'\n", spec);
+    }
+}
+
+Void CERuntime_exit(Void)
+{
+}
+
+/******************************************************************************
+ * Engine
+ ******************************************************************************/
+Engine_Handle Engine_open(String name, Engine_Attrs *attrs, Engine_Error *ec)
+{
+    Engine_Handle hEngine;
+
+    (Void) attrs;
+
+    /* Only loading the server costs, later opens just connect to it */
+    if (__sync_fetch_and_add(&openEngines, 1) == 0) {
+        callEnter(HostCE_Call_ENGINE_OPEN);
+    }
+
+    if (name == NULL || strcmp(name, HOSTCE_ENGINE_NAME) != 0) {
+        if (ec) {
+            *ec = Engine_EEXIST;
+        }
+        __sync_fetch_and_sub(&openEngines, 1);
+        return NULL;
+    }
+
+    hEngine = calloc(1, sizeof(Engine_Obj));
+    if (ec) {
+        *ec = hEngine ? Engine_EOK : Engine_ENOMEM;
+    }
+    if (hEngine == NULL) {
+        __sync_fetch_and_sub(&openEngines, 1);
+    }
+
+    return hEngine;
+}
+
+Void Engine_close(Engine_Handle hEngine)
+{
+    if (hEngine != NULL) {
+        __sync_fetch_and_sub(&openEngines, 1);
+    }
+    free(hEngine);
+}
+
+Engine_Error Engine_getLastError(Engine_Handle hEngine)
+{
+    return hEngine ? hEngine->lastError : Engine_EINVAL;
+}
+
+/******************************************************************************
+ * Deterministic bitstream helpers
+ ******************************************************************************/
+typedef struct BitWriter {
+    UInt8  *buf;
+    Int     size;
+    Int     pos;        /* in bits */
+} BitWriter;
+
+static Void bwPut(BitWriter *bw, UInt32 val, Int bits)
+{
+    while (bits-- > 0) {
+        Int byte = bw->pos >> 3;
+        if (byte >= bw->size) {
+            return;
+        }
+        if (((val >> bits) & 1) != 0) {
+            bw->buf[byte] |= 0x80 >> (bw->pos & 7);
+        }
+        else {
+            bw->buf[byte] &= ~(0x80 >> (bw->pos & 7));
+        }
+        bw->pos++;
+    }
+}
+
+static Void bwUe(BitWriter *bw, UInt32 val)
+{
+    Int     len = 0;
+    UInt32  tmp = val + 1;
+
+    while ((tmp >> len) > 1) {
+        len++;
+    }
+    bwPut(bw, 0, len);
+    bwPut(bw, val + 1, len + 1);
+}
+
+static Void bwSe(BitWriter *bw, Int32 val)
+{
+    bwUe(bw, val > 0 ? 2 * val - 1 : -2 * val);
+}
+
+/* rbsp_trailing_bits(), returns the size in bytes */
+static Int bwTrailing(BitWriter *bw)
+{
+    bwPut(bw, 1, 1);
+    while (bw->pos & 7) {
+        bwPut(bw, 0, 1);
+    }
+    return bw->pos >> 3;
+}
+
+/*
+ * Copy an RBSP behind a start code and NAL header, inserting emulation
+ * prevention bytes.  Returns the number of bytes written.
+ */
+static Int putNal(UInt8 *dst, Int size, UInt8 nalHeader, const UInt8 *rbsp,
+                  Int len)
+{
+    Int     n = 0;
+    Int     zeros = 0;
+    Int     i;
+
+    if (size < len * 3 / 2 + 5) {
+        return 0;
+    }
+
+    dst[n++] = 0;
+    dst[n++] = 0;
+    dst[n++] = 0;
+    dst[n++] = 1;
+    dst[n++] = nalHeader;
+
+    for (i = 0; i < len; i++) {
+        if (zeros >= 2 && rbsp[i] <= 3) {
+            dst[n++] = 3;
+            zeros = 0;
+        }
+        dst[n++] = rbsp[i];
+        zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+    }
+
+    return n;
+}
+
+static UInt32 lcgNext(UInt32 *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+/******************************************************************************
+ * VIDENC1
+ ******************************************************************************/
+/* No slice limit, as the codec starts */
+const IH264VENC_DynamicParams IH264VENC_DYNAMICPARAMS = {
+    {
+        sizeof(IH264VENC_DynamicParams),
+        0,                          /* inputHeight */
+        0,                          /* inputWidth */
+        0,                          /* refFrameRate */
+        0,                          /* targetFrameRate */
+        0,                          /* targetBitRate */
+        0,                          /* intraFrameInterval */
+        0,                          /* generateHeader */
+        0,                          /* captureWidth */
+        0,                          /* forceFrame */
+        0,                          /* interFrameInterval */
+        0,                          /* mbDataFlag */
+    },
+    0,                              /* sliceSize */
+};
+
+typedef struct VIDENC1_Obj {
+    VIDENC1_Params          params;
+    VIDENC1_DynamicParams   dynParams;
+    XDAS_Int32              sliceRows;
+    UInt32                  frameNum;
+    UInt32                  idrNum;
+    Bool                    needIdr;
+} VIDENC1_Obj;
+
+VIDENC1_Handle VIDENC1_create(Engine_Handle e, String name,
+                              VIDENC1_Params *params)
+{
+    VIDENC1_Handle h;
+
+    callEnter(HostCE_Call_CREATE);
+
+    if (e == NULL || strcmp(name, "h264enc") != 0 || params == NULL ||
+        params->maxWidth <= 0 || params->maxHeight <= 0) {
+        if (e) {
+            e->lastError = Engine_ECODECCREATE;
+        }
+        return NULL;
+    }
+
+    h = calloc(1, sizeof(VIDENC1_Obj));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->params = *params;
+    h->dynParams.size = sizeof(VIDENC1_DynamicParams);
+    h->dynParams.inputWidth = params->maxWidth;
+    h->dynParams.inputHeight = params->maxHeight;
+    h->dynParams.refFrameRate = params->maxFrameRate;
+    h->dynParams.targetFrameRate = params->maxFrameRate;
+    h->dynParams.targetBitRate = params->maxBitRate;
+    h->dynParams.intraFrameInterval = 30;
+    h->dynParams.forceFrame = IVIDEO_NA_FRAME;
+    h->needIdr = TRUE;
+
+    return h;
+}
+
+Void VIDENC1_delete(VIDENC1_Handle h)
+{
+    free(h);
+}
+
+XDAS_Int32 VIDENC1_control(VIDENC1_Handle h, VIDENC1_Cmd id,
+                           VIDENC1_DynamicParams *params,
+                           VIDENC1_Status *status)
+{
+    Int32   w;
+    Int32   hgt;
+
+    callEnter(HostCE_Call_CONTROL);
+
+    status->extendedError = 0;
+
+    switch (id) {
+    case XDM_SETPARAMS:
+        if (params->inputWidth > h->params.maxWidth ||
+            params->inputHeight > h->params.maxHeight ||
+            params->inputWidth <= 0 || params->inputHeight <= 0) {
+            XDM_SETFATALERROR(status->extendedError);
+            return VIDENC1_EFAIL;
+        }
+        if (params->size == sizeof(IH264VENC_DynamicParams)) {
+            h->sliceRows = ((IH264VENC_DynamicParams *) params)->sliceSize;
+        }
+        else if (params->size == sizeof(VIDENC1_DynamicParams)) {
+            h->sliceRows = 0;
+        }
+        else {
+            return VIDENC1_EUNSUPPORTED;
+        }
+        memcpy(&h->dynParams, params, sizeof(VIDENC1_DynamicParams));
+        h->dynParams.size = sizeof(VIDENC1_DynamicParams);
+        return VIDENC1_EOK;
+
+    case XDM_RESET:
+        h->frameNum = 0;
+        h->needIdr = TRUE;
+        return VIDENC1_EOK;
+
+    case XDM_GETBUFINFO:
+        w = h->params.maxWidth;
+        hgt = h->params.maxHeight;
+        memset(&status->bufInfo, 0, sizeof(status->bufInfo));
+        status->bufInfo.minNumInBufs = 3;
+        status->bufInfo.minInBufSize[0] = w * hgt;
+        status->bufInfo.minInBufSize[1] = w * hgt / 4;
+        status->bufInfo.minInBufSize[2] = w * hgt / 4;
+        status->bufInfo.minNumOutBufs = 1;
+        status->bufInfo.minOutBufSize[0] = w * hgt / 2;
+        return VIDENC1_EOK;
+
+    case XDM_GETSTATUS:
+    case XDM_SETDEFAULT:
+    case XDM_FLUSH:
+    case XDM_GETVERSION:
+        return VIDENC1_EOK;
+    }
+
+    return VIDENC1_EUNSUPPORTED;
+}
+
+static Int writeSps(UInt8 *dst, Int size, Int32 width, Int32 height)
+{
+    UInt8       rbsp[32];
+    BitWriter   bw = { rbsp, sizeof(rbsp), 0 };
+    Int32       mbW = (width + 15) / 16;
+    Int32       mbH = (height + 15) / 16;
+    Int32       cropR = (mbW * 16 - width) / 2;
+    Int32       cropB = (mbH * 16 - height) / 2;
+
+    memset(rbsp, 0, sizeof(rbsp));
+    bwPut(&bw, 66, 8);              /* profile_idc: baseline */
+    bwPut(&bw, 0xc0, 8);            /* constraint_set0/1 */
+    bwPut(&bw, 30, 8);              /* level_idc */
+    bwUe(&bw, 0);                   /* seq_parameter_set_id */
+    bwUe(&bw, 0);                   /* log2_max_frame_num_minus4 */
+    bwUe(&bw, 2);                   /* pic_order_cnt_type */
+    bwUe(&bw, 1);                   /* max_num_ref_frames */
+    bwPut(&bw, 0, 1);               /* gaps_in_frame_num_allowed */
+    bwUe(&bw, mbW - 1);
+    bwUe(&bw, mbH - 1);
+    bwPut(&bw, 1, 1);               /* frame_mbs_only_flag */
+    bwPut(&bw, 1, 1);               /* direct_8x8_inference_flag */
+    if (cropR || cropB) {
+        bwPut(&bw, 1, 1);
+        bwUe(&bw, 0);
+        bwUe(&bw, cropR);
+        bwUe(&bw, 0);
+        bwUe(&bw, cropB);
+    }
+    else {
+        bwPut(&bw, 0, 1);
+    }
+    bwPut(&bw, 0, 1);               /* vui_parameters_present_flag */
+
+    return putNal(dst, size, 0x67, rbsp, bwTrailing(&bw));
+}
+
+static Int writePps(UInt8 *dst, Int size)
+{
+    UInt8       rbsp[16];
+    BitWriter   bw = { rbsp, sizeof(rbsp), 0 };
+
+    memset(rbsp, 0, sizeof(rbsp));
+    bwUe(&bw, 0);                   /* pic_parameter_set_id */
+    bwUe(&bw, 0);                   /* seq_parameter_set_id */
+    bwPut(&bw, 0, 1);               /* entropy_coding_mode_flag */
+    bwPut(&bw, 0, 1);               /* bottom_field_pic_order... */
+    bwUe(&bw, 0);                   /* num_slice_groups_minus1 */
+    bwUe(&bw, 0);                   /* num_ref_idx_l0_default_minus1 */
+    bwUe(&bw, 0);                   /* num_ref_idx_l1_default_minus1 */
+    bwPut(&bw, 0, 1);               /* weighted_pred_flag */
+    bwPut(&bw, 0, 2);               /* weighted_bipred_idc */
+    bwSe(&bw, 0);                   /* pic_init_qp_minus26 */
+    bwSe(&bw, 0);                   /* pic_init_qs_minus26 */
+    bwSe(&bw, 0);                   /* chroma_qp_index_offset */
+    bwPut(&bw, 1, 1);               /* deblocking_filter_control_present */
+    bwPut(&bw, 0, 1);               /* constrained_intra_pred_flag */
+    bwPut(&bw, 0, 1);               /* redundant_pic_cnt_present_flag */
+
+    return putNal(dst, size, 0x68, rbsp, bwTrailing(&bw));
+}
+
+/*
+ * Write one slice NAL of about payload bytes, starting at macroblock
+ * firstMb.  The header is real slice_header() syntax up to frame_num,
+ * the rest is filler without zero bytes.
+ */
+static Int writeSlice(UInt8 *dst, Int size, Bool idr, UInt32 firstMb,
+                      UInt32 frameNum, Int payload, UInt32 *seed)
+{
+    UInt8       hdr[16];
+    BitWriter   bw = { hdr, sizeof(hdr), 0 };
+    Int         n;
+    Int         len;
+
+    if (size < payload + 24) {
+        payload = size - 24;
+    }
+    if (payload < 8) {
+        return 0;
+    }
+
+    memset(hdr, 0, sizeof(hdr));
+    bwUe(&bw, firstMb);             /* first_mb_in_slice */
+    bwUe(&bw, idr ? 7 : 5);         /* slice_type: all I / all P */
+    bwUe(&bw, 0);                   /* pic_parameter_set_id */
+    bwPut(&bw, frameNum & 0xf, 4);  /* frame_num */
+    /* pad the header to a byte boundary with ones */
+    while (bw.pos & 7) {
+        bwPut(&bw, 1, 1);
+    }
+
+    n = putNal(dst, size, idr ? 0x65 : 0x41, hdr, bw.pos >> 3);
+    for (len = 0; len < payload; len++) {
+        dst[n++] = (UInt8) (lcgNext(seed) % 255 + 1);
+    }
+
+    return n;
+}
+
+XDAS_Int32 VIDENC1_process(VIDENC1_Handle h, IVIDEO1_BufDescIn *inBufs,
+                           XDM_BufDesc *outBufs, VIDENC1_InArgs *inArgs,
+                           VIDENC1_OutArgs *outArgs)
+{
+    VIDENC1_DynamicParams  *dp = &h->dynParams;
+    UInt8      *out;
+    Int         size;
+    Int         n = 0;
+    Int         payload;
+    Int         mbRows;
+    Int         numSlices = 1;
+    Int         numMbs;
+    Int         i;
+    Int32       fps;
+    Bool        idr;
+    UInt32      seed;
+
+    callEnter(HostCE_Call_VIDENC1_PROCESS);
+
+    outArgs->extendedError = 0;
+    outArgs->bytesGenerated = 0;
+    outArgs->inputFrameSkip = 0;
+    outArgs->outputID = inArgs->inputID;
+    memset(&outArgs->reconBufs, 0, sizeof(outArgs->reconBufs));
+
+    if (inBufs->numBufs < 1 || inBufs->bufDesc[0].buf == NULL ||
+        outBufs->numBufs < 1 || outBufs->bufs[0] == NULL ||
+        inBufs->frameWidth < dp->inputWidth ||
+        inBufs->frameHeight < dp->inputHeight) {
+        XDM_SETFATALERROR(outArgs->extendedError);
+        return VIDENC1_EFAIL;
+    }
+
+    out = (UInt8 *) outBufs->bufs[0];
+    size = outBufs->bufSizes[0];
+
+    idr = h->needIdr || dp->forceFrame == IVIDEO_IDR_FRAME ||
+          dp->forceFrame == IVIDEO_I_FRAME ||
+          (dp->intraFrameInterval > 0 &&
+           h->frameNum % dp->intraFrameInterval == 0);
+
+    fps = dp->targetFrameRate > 0 ? dp->targetFrameRate : 30000;
+    payload = (Int) ((long long) dp->targetBitRate * 1000 / fps / 8);
+    if (idr) {
+        payload *= 4;
+        h->idrNum++;
+    }
+
+    /* Same input position, same output: seed from frame and content */
+    seed = h->frameNum * 2654435761u ^ *(UInt8 *) inBufs->bufDesc[0].buf;
+
+    if (idr) {
+        n += writeSps(out + n, size - n, dp->inputWidth, dp->inputHeight);
+        n += writePps(out + n, size - n);
+    }
+    mbRows = (dp->inputHeight + 15) / 16;
+    if (h->sliceRows > 0) {
+        numSlices = (mbRows + h->sliceRows - 1) / h->sliceRows;
+    }
+    numMbs = ((dp->inputWidth + 15) / 16) * mbRows;
+    for (i = 0; i < numSlices; i++) {
+        Int first = numMbs * i / numSlices;
+        Int last = numMbs * (i + 1) / numSlices;
+
+        if (h->sliceRows > 0) {
+            first = numMbs / mbRows * h->sliceRows * i;
+            last = numMbs / mbRows * h->sliceRows * (i + 1);
+            if (last > numMbs) {
+                last = numMbs;
+            }
+        }
+        n += writeSlice(out + n, size - n, idr, first, h->frameNum,
+                        (Int) ((long long) payload * last / numMbs -
+                               (long long) payload * first / numMbs),
+                        &seed);
+    }
+
+    outArgs->bytesGenerated = n;
+    outArgs->encodedFrameType = idr ? IVIDEO_IDR_FRAME : IVIDEO_P_FRAME;
+    outArgs->encodedBuf.buf = (XDAS_Int8 *) out;
+    outArgs->encodedBuf.bufSize = n;
+
+    h->needIdr = FALSE;
+    h->frameNum = idr ? 1 : h->frameNum + 1;
+
+    return VIDENC1_EOK;
+}
+
+/******************************************************************************
+ * VIDDEC2
+ ******************************************************************************/
+typedef struct VIDDEC2_Obj {
+    VIDDEC2_Params          params;
+    VIDDEC2_DynamicParams   dynParams;
+    XDAS_Int32              refId;
+    Bool                    seenIdr;
+    UInt32                  frameNum;
+} VIDDEC2_Obj;
+
+VIDDEC2_Handle VIDDEC2_create(Engine_Handle e, String name,
+                              VIDDEC2_Params *params)
+{
+    VIDDEC2_Handle h;
+
+    callEnter(HostCE_Call_CREATE);
+
+    if (e == NULL || strcmp(name, "h264dec") != 0 || params == NULL ||
+        params->maxWidth <= 0 || params->maxHeight <= 0) {
+        if (e) {
+            e->lastError = Engine_ECODECCREATE;
+        }
+        return NULL;
+    }
+
+    h = calloc(1, sizeof(VIDDEC2_Obj));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->params = *params;
+    h->dynParams.size = sizeof(VIDDEC2_DynamicParams);
+
+    return h;
+}
+
+Void VIDDEC2_delete(VIDDEC2_Handle h)
+{
+    free(h);
+}
+
+XDAS_Int32 VIDDEC2_control(VIDDEC2_Handle h, VIDDEC2_Cmd id,
+                           VIDDEC2_DynamicParams *params,
+                           VIDDEC2_Status *status)
+{
+    Int32   w = h->params.maxWidth;
+    Int32   hgt = h->params.maxHeight;
+
+    callEnter(HostCE_Call_CONTROL);
+
+    status->extendedError = 0;
+
+    switch (id) {
+    case XDM_SETPARAMS:
+        memcpy(&h->dynParams, params, sizeof(VIDDEC2_DynamicParams));
+        return VIDDEC2_EOK;
+
+    case XDM_RESET:
+        h->refId = 0;
+        h->seenIdr = FALSE;
+        return VIDDEC2_EOK;
+
+    case XDM_FLUSH:
+        return VIDDEC2_EOK;
+
+    case XDM_GETBUFINFO:
+    case XDM_GETSTATUS:
+        memset(&status->bufInfo, 0, sizeof(status->bufInfo));
+        status->bufInfo.minNumInBufs = 1;
+        status->bufInfo.minInBufSize[0] = w * hgt * 3 / 2;
+        status->bufInfo.minNumOutBufs = 3;
+        status->bufInfo.minOutBufSize[0] = w * hgt;
+        status->bufInfo.minOutBufSize[1] = w * hgt / 4;
+        status->bufInfo.minOutBufSize[2] = w * hgt / 4;
+        status->maxNumDisplayBufs = 2;
+        status->outputWidth = w;
+        status->outputHeight = hgt;
+        return VIDDEC2_EOK;
+
+    case XDM_SETDEFAULT:
+    case XDM_GETVERSION:
+        return VIDDEC2_EOK;
+    }
+
+    return VIDDEC2_EUNSUPPORTED;
+}
+
+XDAS_Int32 VIDDEC2_process(VIDDEC2_Handle h, XDM1_BufDesc *inBufs,
+                           XDM_BufDesc *outBufs, VIDDEC2_InArgs *inArgs,
+                           VIDDEC2_OutArgs *outArgs)
+{
+    const UInt8    *p = (const UInt8 *) inBufs->descs[0].buf;
+    Int32           len = inArgs->numBytes;
+    Int32           i;
+    Int             nalType;
+    Int             refIdc = 0;
+    Bool            hasSlice = FALSE;
+    Bool            isIdr = FALSE;
+    Int             nFree = 0;
+    Int             plane;
+
+    callEnter(HostCE_Call_VIDDEC2_PROCESS);
+
+    memset(outArgs->outputID, 0, sizeof(outArgs->outputID));
+    memset(outArgs->freeBufID, 0, sizeof(outArgs->freeBufID));
+    outArgs->bytesConsumed = len;
+    outArgs->outBufsInUseFlag = 0;
+    outArgs->decodedBufs.extendedError = 0;
+
+    for (i = 0; i + 3 < len; i++) {
+        if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) {
+            nalType = p[i + 3] & 0x1f;
+            if (nalType >= 1 && nalType <= 5) {
+                hasSlice = TRUE;
+                refIdc |= (p[i + 3] >> 5) & 3;
+                isIdr |= nalType == 5;
+            }
+            i += 3;
+        }
+    }
+
+    if (len <= 0 || (len >= 3 && !(p[0] == 0 && p[1] == 0))) {
+        XDM_SETFATALERROR(outArgs->decodedBufs.extendedError);
+        outArgs->freeBufID[0] = inArgs->inputID;
+        return VIDDEC2_EFAIL;
+    }
+
+    if (!hasSlice || h->dynParams.decodeHeader == XDM_PARSE_HEADER) {
+        /* headers only: nothing to display, give the buffer back */
+        outArgs->freeBufID[0] = inArgs->inputID;
+        return VIDDEC2_EOK;
+    }
+
+    h->seenIdr |= isIdr;
+    if (!h->seenIdr ||
+        (h->dynParams.frameSkipMode == IVIDEO_SKIP_P && !isIdr)) {
+        if (!h->seenIdr) {
+            XDM_SETCORRUPTEDDATA(outArgs->decodedBufs.extendedError);
+        }
+        outArgs->freeBufID[0] = inArgs->inputID;
+        return h->seenIdr ? VIDDEC2_EOK : VIDDEC2_EFAIL;
+    }
+
+    /* "Decode": a flat picture whose luma follows the frame count */
+    for (plane = 0; plane < outBufs->numBufs && plane < 3; plane++) {
+        memset(outBufs->bufs[plane],
+               plane == 0 ? (Int) (16 + h->frameNum % 220) : 128,
+               outBufs->bufSizes[plane]);
+    }
+    h->frameNum++;
+
+    outArgs->outputID[0] = inArgs->inputID;
+    memset(&outArgs->displayBufs[0], 0, sizeof(IVIDEO1_BufDesc));
+    outArgs->displayBufs[0].numBufs = outBufs->numBufs;
+    outArgs->displayBufs[0].frameWidth = h->params.maxWidth;
+    outArgs->displayBufs[0].frameHeight = h->params.maxHeight;
+    outArgs->displayBufs[0].framePitch = h->params.maxWidth;
+    outArgs->displayBufs[0].bufDesc[0].buf = outBufs->bufs[0];
+    outArgs->displayBufs[0].bufDesc[0].bufSize = outBufs->bufSizes[0];
+    outArgs->displayBufs[0].frameType =
+        isIdr ? IVIDEO_IDR_FRAME : IVIDEO_P_FRAME;
+
+    /* A reference picture replaces the previous one */
+    if (refIdc != 0) {
+        if (h->refId != 0) {
+            outArgs->freeBufID[nFree++] = h->refId;
+        }
+        h->refId = inArgs->inputID;
+    }
+    else {
+        outArgs->freeBufID[nFree++] = inArgs->inputID;
+    }
+
+    return VIDDEC2_EOK;
+}
+
+/******************************************************************************
+ * SPHENC1
+ ******************************************************************************/
+/* Frame sizes without the header byte, indexed by AMR mode */
+static const Int amrFrameBytes[8] = { 12, 13, 15, 17, 19, 20, 26, 31 };
+
+#define G729_FRAME_BYTES        10
+#define G729_SID_BYTES          2
+
+typedef struct SPHENC1_Obj {
+    SPHENC1_Params          params;
+    SPHENC1_DynamicParams   dynParams;
+    Bool                    isAmr;
+} SPHENC1_Obj;
+
+/* Samples of one frame, and frames per process() call */
+static Int sphenc1FrameSamples(SPHENC1_Handle h)
+{
+    return h->isAmr ? 160 : 80;
+}
+
+static Int sphenc1NumFrames(SPHENC1_Handle h)
+{
+    Int n = h->dynParams.frameSize / sphenc1FrameSamples(h);
+
+    return n > 1 ? n : 1;
+}
+
+SPHENC1_Handle SPHENC1_create(Engine_Handle e, String name,
+                              SPHENC1_Params *params)
+{
+    SPHENC1_Handle h;
+    Bool           isAmr = strcmp(name, "amrnbenc") == 0;
+
+    callEnter(HostCE_Call_CREATE);
+
+    if (e == NULL || params == NULL ||
+        (!isAmr && strcmp(name, "g729enc") != 0)) {
+        if (e) {
+            e->lastError = Engine_ECODECCREATE;
+        }
+        return NULL;
+    }
+
+    h = calloc(1, sizeof(SPHENC1_Obj));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->params = *params;
+    h->isAmr = isAmr;
+    h->dynParams.bitRate = params->bitRate;
+    h->dynParams.vadFlag = params->vadSelection;
+
+    return h;
+}
+
+Void SPHENC1_delete(SPHENC1_Handle h)
+{
+    free(h);
+}
+
+XDAS_Int32 SPHENC1_control(SPHENC1_Handle h, SPHENC1_Cmd id,
+                           SPHENC1_DynamicParams *params,
+                           SPHENC1_Status *status)
+{
+    callEnter(HostCE_Call_CONTROL);
+
+    status->extendedError = 0;
+
+    switch (id) {
+    case XDM_SETPARAMS:
+        memcpy(&h->dynParams, params, sizeof(SPHENC1_DynamicParams));
+        return SPHENC1_EOK;
+
+    case XDM_GETBUFINFO:
+        memset(&status->bufInfo, 0, sizeof(status->bufInfo));
+        status->bufInfo.minNumInBufs = 1;
+        status->bufInfo.minNumOutBufs = 1;
+        status->bufInfo.minInBufSize[0] =
+            sphenc1NumFrames(h) * sphenc1FrameSamples(h) * 2;
+        status->bufInfo.minOutBufSize[0] =
+            sphenc1NumFrames(h) * (h->isAmr ? 32 : 11);
+        return SPHENC1_EOK;
+
+    case XDM_RESET:
+    case XDM_GETSTATUS:
+    case XDM_SETDEFAULT:
+    case XDM_FLUSH:
+    case XDM_GETVERSION:
+        return SPHENC1_EOK;
+    }
+
+    return SPHENC1_EUNSUPPORTED;
+}
+
+XDAS_Int32 SPHENC1_process(SPHENC1_Handle h, XDM1_SingleBufDesc *inBuf,
+                           XDM1_SingleBufDesc *outBuf,
+                           SPHENC1_InArgs *inArgs, SPHENC1_OutArgs *outArgs)
+{
+    const Int16    *pcm = (const Int16 *) inBuf->buf;
+    Int             frameSamples = sphenc1FrameSamples(h);
+    Int             numFrames = inBuf->bufSize / 2 / frameSamples;
+    UInt8          *out = (UInt8 *) outBuf->buf;
+    Int             offset = 0;
+    UInt32          seed;
+    long long       energy;
+    Int             frameBytes;
+    Int             mode;
+    Int             f;
+    Int             i;
+
+    (Void) inArgs;
+    callEnter(HostCE_Call_SPHENC1_PROCESS);
+
+    outArgs->extendedError = 0;
+    memset(out, 0, outBuf->bufSize);
+    if (numFrames < 1) {
+        numFrames = 1;
+        frameSamples = inBuf->bufSize / 2;
+    }
+
+    for (f = 0; f < numFrames; f++, pcm += frameSamples) {
+        seed = 0;
+        energy = 0;
+        mode = 0;
+        for (i = 0; i < frameSamples; i++) {
+            seed = seed * 31 + (UInt16) pcm[i];
+            energy += (long long) pcm[i] * pcm[i];
+        }
+
+        if (h->isAmr) {
+            mode = h->dynParams.bitRate;
+            if (mode < 0 || mode > 7) {
+                mode = 7;
+            }
+            frameBytes = amrFrameBytes[mode];
+        }
+        else if (h->dynParams.vadFlag &&
+                 energy < (long long) frameSamples * 64) {
+            mode = 1;
+            frameBytes = G729_SID_BYTES;
+        }
+        else {
+            frameBytes = G729_FRAME_BYTES;
+        }
+
+        if (outBuf->bufSize < offset + frameBytes + 1) {
+            XDM_SETFATALERROR(outArgs->extendedError);
+            return SPHENC1_EFAIL;
+        }
+
+        out[offset] = (UInt8) ((mode << 3) | (h->isAmr ? 0x04 : 0));
+        for (i = 1; i <= frameBytes; i++) {
+            out[offset + i] = (UInt8) lcgNext(&seed);
+        }
+        offset += frameBytes + 1;
+    }
+
+    return SPHENC1_EOK;
+}
+
+/******************************************************************************
+ * SPHDEC1
+ ******************************************************************************/
+typedef struct SPHDEC1_Obj {
+    SPHDEC1_Params          params;
+    SPHDEC1_DynamicParams   dynParams;
+    Bool                    isAmr;
+} SPHDEC1_Obj;
+
+SPHDEC1_Handle SPHDEC1_create(Engine_Handle e, String name,
+                              SPHDEC1_Params *params)
+{
+    SPHDEC1_Handle h;
+    Bool           isAmr = strcmp(name, "amrnbdec") == 0;
+
+    callEnter(HostCE_Call_CREATE);
+
+    if (e == NULL || params == NULL ||
+        (!isAmr && strcmp(name, "g729dec") != 0)) {
+        if (e) {
+            e->lastError = Engine_ECODECCREATE;
+        }
+        return NULL;
+    }
+
+    h = calloc(1, sizeof(SPHDEC1_Obj));
+    if (h == NULL) {
+        return NULL;
+    }
+    h->params = *params;
+    h->isAmr = isAmr;
+
+    return h;
+}
+
+Void SPHDEC1_delete(SPHDEC1_Handle h)
+{
+    free(h);
+}
+
+XDAS_Int32 SPHDEC1_control(SPHDEC1_Handle h, SPHDEC1_Cmd id,
+                           SPHDEC1_DynamicParams *params,
+                           SPHDEC1_Status *status)
+{
+    callEnter(HostCE_Call_CONTROL);
+
+    status->extendedError = 0;
+
+    switch (id) {
+    case XDM_SETPARAMS:
+        memcpy(&h->dynParams, params, sizeof(SPHDEC1_DynamicParams));
+        return SPHDEC1_EOK;
+
+    case XDM_GETBUFINFO:
+        memset(&status->bufInfo, 0, sizeof(status->bufInfo));
+        status->bufInfo.minNumInBufs = 1;
+        status->bufInfo.minNumOutBufs = 1;
+        status->bufInfo.minInBufSize[0] = h->isAmr ? 32 : 11;
+        status->bufInfo.minOutBufSize[0] = h->isAmr ? 160 * 2 : 80 * 2;
+        return SPHDEC1_EOK;
+
+    case XDM_RESET:
+    case XDM_GETSTATUS:
+    case XDM_SETDEFAULT:
+    case XDM_FLUSH:
+    case XDM_GETVERSION:
+        return SPHDEC1_EOK;
+    }
+
+    return SPHDEC1_EUNSUPPORTED;
+}
+
+/* Frame size without the header byte, -1 for a frame type we don't know */
+static Int sphdec1FrameBytes(SPHDEC1_Handle h, UInt8 header)
+{
+    Int mode = (header >> 3) & 0xf;
+
+    if (mode == 15) {
+        return 0;                       /* no data */
+    }
+    if (h->isAmr) {
+        return mode < 8 ? amrFrameBytes[mode] : mode == 8 ? 5 : -1;
+    }
+
+    return mode == 0 ? G729_FRAME_BYTES : mode == 1 ? G729_SID_BYTES :
+        mode == 2 ? 0 : -1;
+}
+
+XDAS_Int32 SPHDEC1_process(SPHDEC1_Handle h, XDM1_SingleBufDesc *inBuf,
+                           XDM1_SingleBufDesc *outBuf,
+                           SPHDEC1_InArgs *inArgs, SPHDEC1_OutArgs *outArgs)
+{
+    const UInt8    *in = (const UInt8 *) inBuf->buf;
+    Int16          *pcm = (Int16 *) outBuf->buf;
+    Int             samples = h->isAmr ? 160 : 80;
+    Int             offset = 0;
+    Int             frameLen;
+    UInt32          seed;
+    Int             i;
+
+    (Void) inArgs;
+    callEnter(HostCE_Call_SPHDEC1_PROCESS);
+
+    outArgs->extendedError = 0;
+    outArgs->dataSize = 0;
+
+    if (outBuf->bufSize < samples * 2) {
+        XDM_SETFATALERROR(outArgs->extendedError);
+        return SPHDEC1_EFAIL;
+    }
+
+    /*
+     * Decode the frames found back to back in the input, as long as they
+     * are complete and there is room for their PCM.  Input that does not
+     * parse as frames still gives one frame of PCM.
+     */
+    do {
+        frameLen = inBuf->bufSize - offset;
+        if (frameLen > 0) {
+            i = sphdec1FrameBytes(h, in[offset]);
+            if (i >= 0 && i < frameLen) {
+                frameLen = i + 1;
+            }
+            else if (offset > 0) {
+                break;
+            }
+        }
+
+        seed = 0;
+        for (i = 0; i < frameLen; i++) {
+            seed = seed * 31 + in[offset + i];
+        }
+        for (i = 0; i < samples; i++) {
+            *pcm++ = (Int16) ((Int) (lcgNext(&seed) & 0x3ff) - 512);
+        }
+        outArgs->dataSize += samples * 2;
+        offset += frameLen;
+    } while (offset < inBuf->bufSize &&
+             outBuf->bufSize >= outArgs->dataSize + samples * 2);
+
+    return SPHDEC1_EOK;
+}
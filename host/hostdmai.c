@@ -0,0 +1,619 @@
+/*
+ * Host stand-in for the parts of DMAI used by the bundle: Buffer, BufTab,
+ * BufferGfx, ColorSpace, and the Sdec1 speech decoder module (the bundle
+ * carries its own Senc1, Venc1 and Vdec2 but uses Sdec1 from DMAI).
+ *
+ * Buffers are aligned heap allocations.  The useMask/BufTab semantics
+ * follow DMAI: BufTab_getFreeBuf() hands out a buffer whose useMask is 0
+ * and sets it to the useMask of the creation attributes, the buffer is
+ * free again once every bit was cleared with Buffer_freeUseMask().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/osal/Memory.h>
+#include <ti/sdo/ce/speech1/sphdec1.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufTab.h>
+#include <ti/sdo/dmai/BufferGfx.h>
+#include <ti/sdo/dmai/ColorSpace.h>
+#include <ti/sdo/dmai/ce/Sdec1.h>
+
+#define MODULE_NAME         "HostDmai"
+
+#define BUFFER_ALIGN        128
+
+typedef struct _Buffer_Object {
+    Int8               *userPtr;
+    Int8               *allocPtr;
+    Int32               size;
+    Int32               origSize;
+    Int32               numBytesUsed;
+    Buffer_Type         type;
+    UInt16              useMask;
+    UInt16              origUseMask;
+    Bool                reference;
+    Int                 id;
+    BufTab_Handle       hBufTab;
+
+    /* Buffer_Type_GRAPHICS only */
+    ColorSpace_Type     colorSpace;
+    BufferGfx_Dimensions dim;
+    BufferGfx_Dimensions origDim;
+    Int                 frameType;
+} _Buffer_Object;
+
+typedef struct _BufTab_Object {
+    Int                 numBufs;
+    Buffer_Handle      *bufs;
+} _BufTab_Object;
+
+Int Dmai_debugLevel = 0;
+
+Memory_AllocParams Memory_DEFAULTPARAMS = {
+    Memory_CONTIGPOOL,
+    Memory_NONCACHED,
+    Memory_DEFAULTALIGNMENT,
+    0
+};
+
+const Buffer_Attrs Buffer_Attrs_DEFAULT = {
+    { Memory_CONTIGPOOL, Memory_NONCACHED, Memory_DEFAULTALIGNMENT, 0 },
+    Buffer_Type_BASIC,
+    1,
+    FALSE
+};
+
+const BufferGfx_Attrs BufferGfx_Attrs_DEFAULT = {
+    {
+        { Memory_CONTIGPOOL, Memory_NONCACHED, Memory_DEFAULTALIGNMENT, 0 },
+        Buffer_Type_GRAPHICS,
+        1,
+        FALSE
+    },
+    ColorSpace_UYVY,
+    { 0, 0, 0, 0, 0 }
+};
+
+/******************************************************************************
+ * Dmai_init
+ ******************************************************************************/
+Void Dmai_init(Void)
+{
+    const Char *env = getenv("DMAI_DEBUG");
+
+    if (env != NULL) {
+        Dmai_debugLevel = atoi(env);
+    }
+}
+
+/******************************************************************************
+ * ColorSpace
+ ******************************************************************************/
+Int ColorSpace_getBpp(ColorSpace_Type colorSpace)
+{
+    switch (colorSpace) {
+    case ColorSpace_UYVY:
+    case ColorSpace_RGB565:
+    case ColorSpace_YUV422PSEMI:
+    case ColorSpace_YUV422P:
+        return 16;
+    case ColorSpace_RGB888:
+        return 24;
+    case ColorSpace_YUV420PSEMI:
+    case ColorSpace_YUV420P:
+    case ColorSpace_YUV444P:
+    case ColorSpace_GRAY:
+        return 8;
+    default:
+        return -1;
+    }
+}
+
+/******************************************************************************
+ * Buffer
+ ******************************************************************************/
+Buffer_Handle Buffer_create(Int32 size, Buffer_Attrs *attrs)
+{
+    Buffer_Handle hBuf;
+
+    if (attrs == NULL || size < 0) {
+        Dmai_err0("Bad buffer size or attributes\n");
+        return NULL;
+    }
+
+    hBuf = calloc(1, sizeof(_Buffer_Object));
+    if (hBuf == NULL) {
+        Dmai_err0("Failed to allocate space for Buffer Object\n");
+        return NULL;
+    }
+
+    if (!attrs->reference && size > 0) {
+        if (posix_memalign((void **) &hBuf->allocPtr, BUFFER_ALIGN,
+                           size) != 0) {
+            Dmai_err1("Failed to allocate %d bytes\n", (Int) size);
+            free(hBuf);
+            return NULL;
+        }
+        hBuf->userPtr = hBuf->allocPtr;
+    }
+
+    hBuf->size = size;
+    hBuf->origSize = size;
+    hBuf->type = attrs->type;
+    hBuf->origUseMask = attrs->useMask;
+    hBuf->reference = attrs->reference;
+    hBuf->frameType = IVIDEO_NA_FRAME;
+
+    if (attrs->type == Buffer_Type_GRAPHICS) {
+        BufferGfx_Attrs *gfxAttrs = (BufferGfx_Attrs *) attrs;
+
+        hBuf->colorSpace = gfxAttrs->colorSpace;
+        hBuf->dim = gfxAttrs->dim;
+        hBuf->origDim = gfxAttrs->dim;
+    }
+
+    return hBuf;
+}
+
+Int Buffer_delete(Buffer_Handle hBuf)
+{
+    if (hBuf) {
+        free(hBuf->allocPtr);
+        free(hBuf);
+    }
+
+    return Dmai_EOK;
+}
+
+Int8 *Buffer_getUserPtr(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->userPtr;
+}
+
+Int32 Buffer_getPhysicalPtr(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return (Int32) (long) hBuf->userPtr;
+}
+
+Int32 Buffer_getSize(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->size;
+}
+
+Buffer_Type Buffer_getType(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->type;
+}
+
+Int32 Buffer_getNumBytesUsed(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->numBytesUsed;
+}
+
+Void Buffer_setNumBytesUsed(Buffer_Handle hBuf, Int32 numBytes)
+{
+    assert(hBuf);
+    assert(numBytes <= hBuf->size);
+
+    hBuf->numBytesUsed = numBytes;
+}
+
+Int Buffer_setUserPtr(Buffer_Handle hBuf, Int8 *ptr)
+{
+    assert(hBuf);
+
+    if (!hBuf->reference) {
+        Dmai_err0("Only reference buffers can have their pointer set\n");
+        return Dmai_EINVAL;
+    }
+    hBuf->userPtr = ptr;
+
+    return Dmai_EOK;
+}
+
+Void Buffer_setSize(Buffer_Handle hBuf, Int32 size)
+{
+    assert(hBuf);
+
+    hBuf->size = size;
+}
+
+Int Buffer_getId(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->id;
+}
+
+UInt16 Buffer_getUseMask(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->useMask;
+}
+
+Void Buffer_setUseMask(Buffer_Handle hBuf, UInt16 useMask)
+{
+    assert(hBuf);
+
+    hBuf->useMask = useMask;
+}
+
+Void Buffer_freeUseMask(Buffer_Handle hBuf, UInt16 useMask)
+{
+    assert(hBuf);
+
+    hBuf->useMask &= ~useMask;
+}
+
+Void Buffer_resetUseMask(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    hBuf->useMask = hBuf->origUseMask;
+}
+
+Bool Buffer_isReference(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->reference;
+}
+
+BufTab_Handle Buffer_getBufTab(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->hBufTab;
+}
+
+/******************************************************************************
+ * BufTab
+ ******************************************************************************/
+BufTab_Handle BufTab_create(Int numBufs, Int32 size, Buffer_Attrs *attrs)
+{
+    BufTab_Handle   hBufTab;
+    Int             i;
+
+    if (numBufs <= 0) {
+        Dmai_err0("Need at least one buffer\n");
+        return NULL;
+    }
+
+    hBufTab = calloc(1, sizeof(_BufTab_Object));
+    if (hBufTab == NULL) {
+        Dmai_err0("Failed to allocate space for BufTab Object\n");
+        return NULL;
+    }
+
+    hBufTab->bufs = calloc(numBufs, sizeof(Buffer_Handle));
+    if (hBufTab->bufs == NULL) {
+        free(hBufTab);
+        return NULL;
+    }
+    hBufTab->numBufs = numBufs;
+
+    for (i = 0; i < numBufs; i++) {
+        hBufTab->bufs[i] = Buffer_create(size, attrs);
+        if (hBufTab->bufs[i] == NULL) {
+            BufTab_delete(hBufTab);
+            return NULL;
+        }
+        hBufTab->bufs[i]->id = i;
+        hBufTab->bufs[i]->hBufTab = hBufTab;
+    }
+
+    return hBufTab;
+}
+
+Int BufTab_delete(BufTab_Handle hBufTab)
+{
+    Int i;
+
+    if (hBufTab) {
+        for (i = 0; i < hBufTab->numBufs; i++) {
+            Buffer_delete(hBufTab->bufs[i]);
+        }
+        free(hBufTab->bufs);
+        free(hBufTab);
+    }
+
+    return Dmai_EOK;
+}
+
+Buffer_Handle BufTab_getFreeBuf(BufTab_Handle hBufTab)
+{
+    Int i;
+
+    assert(hBufTab);
+
+    for (i = 0; i < hBufTab->numBufs; i++) {
+        if (hBufTab->bufs[i]->useMask == 0) {
+            Buffer_resetUseMask(hBufTab->bufs[i]);
+            return hBufTab->bufs[i];
+        }
+    }
+
+    Dmai_dbg0("No free buffer found in BufTab\n");
+
+    return NULL;
+}
+
+Void BufTab_freeBuf(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    hBuf->useMask = 0;
+}
+
+Void BufTab_freeAll(BufTab_Handle hBufTab)
+{
+    Int i;
+
+    assert(hBufTab);
+
+    for (i = 0; i < hBufTab->numBufs; i++) {
+        hBufTab->bufs[i]->useMask = 0;
+    }
+}
+
+Buffer_Handle BufTab_getBuf(BufTab_Handle hBufTab, Int bufIdx)
+{
+    assert(hBufTab);
+
+    if (bufIdx < 0 || bufIdx >= hBufTab->numBufs) {
+        return NULL;
+    }
+
+    return hBufTab->bufs[bufIdx];
+}
+
+Int BufTab_getNumBufs(BufTab_Handle hBufTab)
+{
+    assert(hBufTab);
+
+    return hBufTab->numBufs;
+}
+
+/******************************************************************************
+ * BufferGfx
+ ******************************************************************************/
+Int32 BufferGfx_calcLineLength(Int32 width, ColorSpace_Type colorSpace)
+{
+    Int bpp = ColorSpace_getBpp(colorSpace);
+
+    if (bpp < 0) {
+        return Dmai_EINVAL;
+    }
+
+    return width * bpp / 8;
+}
+
+Int BufferGfx_getDimensions(Buffer_Handle hBuf, BufferGfx_Dimensions *dimPtr)
+{
+    assert(hBuf);
+    assert(dimPtr);
+
+    if (hBuf->type != Buffer_Type_GRAPHICS) {
+        return Dmai_EINVAL;
+    }
+    *dimPtr = hBuf->dim;
+
+    return Dmai_EOK;
+}
+
+Int BufferGfx_setDimensions(Buffer_Handle hBuf, BufferGfx_Dimensions *dimPtr)
+{
+    assert(hBuf);
+    assert(dimPtr);
+
+    if (hBuf->type != Buffer_Type_GRAPHICS ||
+        dimPtr->lineLength * (dimPtr->y + dimPtr->height) > hBuf->size) {
+        return Dmai_EINVAL;
+    }
+    hBuf->dim = *dimPtr;
+
+    return Dmai_EOK;
+}
+
+Int BufferGfx_resetDimensions(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    if (hBuf->type != Buffer_Type_GRAPHICS) {
+        return Dmai_EINVAL;
+    }
+    hBuf->dim = hBuf->origDim;
+
+    return Dmai_EOK;
+}
+
+ColorSpace_Type BufferGfx_getColorSpace(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->type == Buffer_Type_GRAPHICS ? hBuf->colorSpace
+                                              : ColorSpace_NOTSET;
+}
+
+Void BufferGfx_setColorSpace(Buffer_Handle hBuf, ColorSpace_Type colorSpace)
+{
+    assert(hBuf);
+
+    hBuf->colorSpace = colorSpace;
+}
+
+Void BufferGfx_setFrameType(Buffer_Handle hBuf, Int frameType)
+{
+    assert(hBuf);
+
+    hBuf->frameType = frameType;
+}
+
+Int BufferGfx_getFrameType(Buffer_Handle hBuf)
+{
+    assert(hBuf);
+
+    return hBuf->frameType;
+}
+
+/******************************************************************************
+ * Sdec1
+ ******************************************************************************/
+typedef struct Sdec1_Object {
+    SPHDEC1_Handle  hDecode;
+    Int32           minInBufSize;
+    Int32           minOutBufSize;
+} Sdec1_Object;
+
+const SPHDEC1_Params Sdec1_Params_DEFAULT = {
+    sizeof(SPHDEC1_Params),
+    0,
+    0,
+    0,
+    0,
+    0,
+    NULL,
+};
+
+const SPHDEC1_DynamicParams Sdec1_DynamicParams_DEFAULT = {
+    sizeof(SPHDEC1_DynamicParams),
+    0,
+};
+
+Sdec1_Handle Sdec1_create(Engine_Handle hEngine, Char *codecName,
+                          SPHDEC1_Params *params,
+                          SPHDEC1_DynamicParams *dynParams)
+{
+    Sdec1_Handle    hSd;
+    SPHDEC1_Status  decStatus;
+    XDAS_Int32      status;
+
+    if (hEngine == NULL || codecName == NULL ||
+        params == NULL || dynParams == NULL) {
+        Dmai_err0("Cannot pass null for engine, codec name, params or "
+                  "dynamic params\n");
+        return NULL;
+    }
+
+    hSd = calloc(1, sizeof(Sdec1_Object));
+    if (hSd == NULL) {
+        Dmai_err0("Failed to allocate space for Sdec1 Object\n");
+        return NULL;
+    }
+
+    hSd->hDecode = SPHDEC1_create(hEngine, codecName, params);
+    if (hSd->hDecode == NULL) {
+        Dmai_err0("Can't open speech decode algorithm\n");
+        free(hSd);
+        return NULL;
+    }
+
+    decStatus.size = sizeof(SPHDEC1_Status);
+    decStatus.data.buf = NULL;
+    status = SPHDEC1_control(hSd->hDecode, XDM_SETPARAMS, dynParams,
+                             &decStatus);
+    if (status == SPHDEC1_EOK) {
+        status = SPHDEC1_control(hSd->hDecode, XDM_GETBUFINFO, dynParams,
+                                 &decStatus);
+    }
+    if (status != SPHDEC1_EOK) {
+        Dmai_err1("XDM_SETPARAMS/XDM_GETBUFINFO failed, status=%d\n",
+                  status);
+        SPHDEC1_delete(hSd->hDecode);
+        free(hSd);
+        return NULL;
+    }
+
+    hSd->minInBufSize = decStatus.bufInfo.minInBufSize[0];
+    hSd->minOutBufSize = decStatus.bufInfo.minOutBufSize[0];
+
+    return hSd;
+}
+
+Int Sdec1_process(Sdec1_Handle hSd, Buffer_Handle hInBuf,
+                  Buffer_Handle hOutBuf)
+{
+    XDM1_SingleBufDesc  inBufDesc;
+    XDM1_SingleBufDesc  outBufDesc;
+    SPHDEC1_InArgs      inArgs;
+    SPHDEC1_OutArgs     outArgs;
+    XDAS_Int32          status;
+
+    assert(hSd);
+    assert(hInBuf);
+    assert(hOutBuf);
+
+    inBufDesc.buf = Buffer_getUserPtr(hInBuf);
+    inBufDesc.bufSize = Buffer_getNumBytesUsed(hInBuf);
+    outBufDesc.buf = Buffer_getUserPtr(hOutBuf);
+    outBufDesc.bufSize = Buffer_getSize(hOutBuf);
+
+    inArgs.size = sizeof(SPHDEC1_InArgs);
+    inArgs.frameType = ISPEECH1_FTYPE_SPEECHGOOD;
+    inArgs.data.buf = NULL;
+    inArgs.data.bufSize = 0;
+    outArgs.size = sizeof(SPHDEC1_OutArgs);
+
+    status = SPHDEC1_process(hSd->hDecode, &inBufDesc, &outBufDesc,
+                             &inArgs, &outArgs);
+    if (status != SPHDEC1_EOK) {
+        Dmai_err2("SPHDEC1_process() failed with error (%d ext: 0x%x)\n",
+                  (Int) status, (Uns) outArgs.extendedError);
+        return Dmai_EFAIL;
+    }
+
+    Buffer_setNumBytesUsed(hOutBuf, outArgs.dataSize);
+
+    return Dmai_EOK;
+}
+
+Int Sdec1_delete(Sdec1_Handle hSd)
+{
+    if (hSd) {
+        if (hSd->hDecode) {
+            SPHDEC1_delete(hSd->hDecode);
+        }
+        free(hSd);
+    }
+
+    return Dmai_EOK;
+}
+
+SPHDEC1_Handle Sdec1_getVisaHandle(Sdec1_Handle hSd)
+{
+    assert(hSd);
+
+    return hSd->hDecode;
+}
+
+Int32 Sdec1_getInBufSize(Sdec1_Handle hSd)
+{
+    assert(hSd);
+
+    return hSd->minInBufSize;
+}
+
+Int32 Sdec1_getOutBufSize(Sdec1_Handle hSd)
+{
+    assert(hSd);
+
+    return hSd->minOutBufSize;
+}
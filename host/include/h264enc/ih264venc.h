@@ -0,0 +1,30 @@
+/*
+ * Host stand-in for the interface header of the h264enc codec package.
+ *
+ * Only the part of IH264VENC_DynamicParams that hostce.c models is
+ * declared; the real header has more fields after sliceSize, which the
+ * stand-in codec tells apart by the size field all the same.
+ */
+
+#ifndef h264enc_IH264VENC_
+#define h264enc_IH264VENC_
+
+#include <ti/xdais/dm/xdm.h>
+#include <ti/sdo/ce/video1/videnc1.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IH264VENC_DynamicParams {
+    IVIDENC1_DynamicParams videncDynamicParams;
+    XDAS_Int32      sliceSize;      /* macroblock rows per slice, 0: one */
+} IH264VENC_DynamicParams;
+
+extern const IH264VENC_DynamicParams IH264VENC_DYNAMICPARAMS;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+/*
+ * Controls of the host stand-in Codec Engine/DMAI backend.
+ *
+ * Every call that would cross to the DSP on a DM6446 can be given a fixed
+ * latency, and is counted.  Latencies are read from HOSTCE_LATENCY at
+ * CERuntime_init() time, as a comma separated list of name=usecs pairs
+ * using the names of HostCE_callName(), e.g.
+ *
+ *     HOSTCE_LATENCY=open=150000,venc=20000,vdec=8000
+ *
+ * "open" is the cost of loading the codec server: it is only paid by an
+ * Engine_open() while no other handle is open.
+ *
+ * HOSTCE_LATENCY=dm6446 selects rough DM6446 figures for the 480x320
+ * H.264 and narrowband speech codecs of the bundle.  Without the
+ * variable every call is free, which keeps tests fast and deterministic.
+ */
+
+#ifndef HOSTCE_H
+#define HOSTCE_H
+
+#include <xdc/std.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    HostCE_Call_ENGINE_OPEN = 0,
+    HostCE_Call_CREATE,
+    HostCE_Call_CONTROL,
+    HostCE_Call_VIDENC1_PROCESS,
+    HostCE_Call_VIDDEC2_PROCESS,
+    HostCE_Call_SPHENC1_PROCESS,
+    HostCE_Call_SPHDEC1_PROCESS,
+    HostCE_Call_COUNT
+} HostCE_Call;
+
+extern Void     HostCE_setLatency(HostCE_Call call, UInt32 usecs);
+extern UInt32   HostCE_getLatency(HostCE_Call call);
+extern Int      HostCE_parseLatency(const Char *spec);
+extern UInt32   HostCE_getCallCount(HostCE_Call call);
+extern Void     HostCE_resetCallCounts(Void);
+extern const Char *HostCE_callName(HostCE_Call call);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
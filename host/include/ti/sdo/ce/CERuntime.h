@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the Codec Engine runtime.
+ */
+
+#ifndef ti_sdo_ce_CERuntime_
+#define ti_sdo_ce_CERuntime_
+
+#include <xdc/std.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Void     CERuntime_init(Void);
+extern Void     CERuntime_exit(Void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
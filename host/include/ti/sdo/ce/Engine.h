@@ -0,0 +1,43 @@
+/*
+ * Host stand-in for the Codec Engine Engine module.
+ */
+
+#ifndef ti_sdo_ce_Engine_
+#define ti_sdo_ce_Engine_
+
+#include <xdc/std.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct Engine_Obj *Engine_Handle;
+
+typedef Int Engine_Error;
+
+#define Engine_EOK          0
+#define Engine_EEXIST       1
+#define Engine_ENOMEM       2
+#define Engine_EDSPLOAD     3
+#define Engine_ENOCOMM      4
+#define Engine_ENOSERVER    5
+#define Engine_ECOMALLOC    6
+#define Engine_ERUNTIME     7
+#define Engine_ECODECCREATE 8
+#define Engine_ECODECSTART  9
+#define Engine_EINVAL       10
+
+typedef struct Engine_Attrs {
+    String          procId;
+} Engine_Attrs;
+
+extern Engine_Handle Engine_open(String name, Engine_Attrs *attrs,
+                                 Engine_Error *ec);
+extern Void     Engine_close(Engine_Handle engine);
+extern Engine_Error Engine_getLastError(Engine_Handle engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for the Codec Engine OSAL memory module.  On the host
+ * "contiguous" memory is plain heap memory and physical addresses are
+ * the virtual ones.
+ */
+
+#ifndef ti_sdo_ce_osal_Memory_
+#define ti_sdo_ce_osal_Memory_
+
+#include <xdc/std.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    Memory_MALLOC = 0,
+    Memory_SEG = 1,
+    Memory_CONTIGPOOL = 2,
+    Memory_CONTIGHEAP = 3
+} Memory_type;
+
+#define Memory_CACHED       0x0000
+#define Memory_NONCACHED    0x0001
+#define Memory_DEFAULTALIGNMENT ((UInt)(-1))
+
+typedef struct Memory_AllocParams {
+    Memory_type     type;
+    UInt            flags;
+    UInt            align;
+    UInt            seg;
+} Memory_AllocParams;
+
+extern Memory_AllocParams Memory_DEFAULTPARAMS;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
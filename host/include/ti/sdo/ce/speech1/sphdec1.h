@@ -0,0 +1,89 @@
+/*
+ * Host stand-in for the SPHDEC1 VISA interface.
+ */
+
+#ifndef ti_sdo_ce_speech1_SPHDEC1_
+#define ti_sdo_ce_speech1_SPHDEC1_
+
+#include <ti/xdais/dm/xdm.h>
+#include <ti/sdo/ce/Engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPHDEC1_EOK             0
+#define SPHDEC1_EFAIL           (-1)
+#define SPHDEC1_ERUNTIME        (-2)
+#define SPHDEC1_EUNSUPPORTED    (-3)
+
+#define ISPEECH1_FTYPE_SPEECHGOOD   0
+#define ISPEECH1_FTYPE_SIDFRAME     1
+#define ISPEECH1_FTYPE_NODATA       2
+
+typedef Int     SPHDEC1_Cmd;
+
+typedef struct SPHDEC1_Obj *SPHDEC1_Handle;
+
+typedef struct ISPHDEC1_Params {
+    XDAS_Int16      size;
+    XDAS_Int16      compandingLaw;
+    XDAS_Int16      packingType;
+    XDAS_Int16      codecSelection;
+    XDAS_Int16      bitRate;
+    XDAS_Int16      reserved;
+    XDAS_Int8     **tablesPtr;
+} ISPHDEC1_Params;
+
+typedef struct ISPHDEC1_DynamicParams {
+    XDAS_Int16      size;
+    XDAS_Int16      postFilter;
+} ISPHDEC1_DynamicParams;
+
+typedef struct ISPHDEC1_InArgs {
+    XDAS_Int16      size;
+    XDAS_Int16      frameType;
+    XDM1_SingleBufDesc data;
+} ISPHDEC1_InArgs;
+
+typedef struct ISPHDEC1_OutArgs {
+    XDAS_Int16      size;
+    XDAS_Int16      dataSize;
+    XDAS_Int32      extendedError;
+} ISPHDEC1_OutArgs;
+
+typedef struct ISPHDEC1_Status {
+    XDAS_Int16      size;
+    XDAS_Int32      extendedError;
+    XDM1_SingleBufDesc data;
+    XDAS_Int16      postFilter;
+    XDAS_Int16      compandingLaw;
+    XDAS_Int16      packingType;
+    XDAS_Int16      codecSelection;
+    XDAS_Int16      bitRate;
+    XDM_AlgBufInfo  bufInfo;
+} ISPHDEC1_Status;
+
+typedef ISPHDEC1_Params SPHDEC1_Params;
+typedef ISPHDEC1_DynamicParams SPHDEC1_DynamicParams;
+typedef ISPHDEC1_InArgs SPHDEC1_InArgs;
+typedef ISPHDEC1_OutArgs SPHDEC1_OutArgs;
+typedef ISPHDEC1_Status SPHDEC1_Status;
+
+extern SPHDEC1_Handle SPHDEC1_create(Engine_Handle e, String name,
+                                     SPHDEC1_Params *params);
+extern Void     SPHDEC1_delete(SPHDEC1_Handle handle);
+extern XDAS_Int32 SPHDEC1_process(SPHDEC1_Handle handle,
+                                  XDM1_SingleBufDesc *inBuf,
+                                  XDM1_SingleBufDesc *outBuf,
+                                  SPHDEC1_InArgs *inArgs,
+                                  SPHDEC1_OutArgs *outArgs);
+extern XDAS_Int32 SPHDEC1_control(SPHDEC1_Handle handle, SPHDEC1_Cmd id,
+                                  SPHDEC1_DynamicParams *params,
+                                  SPHDEC1_Status *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
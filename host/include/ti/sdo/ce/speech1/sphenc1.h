@@ -0,0 +1,100 @@
+/*
+ * Host stand-in for the SPHENC1 VISA interface.
+ */
+
+#ifndef ti_sdo_ce_speech1_SPHENC1_
+#define ti_sdo_ce_speech1_SPHENC1_
+
+#include <ti/xdais/dm/xdm.h>
+#include <ti/sdo/ce/Engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPHENC1_EOK             0
+#define SPHENC1_EFAIL           (-1)
+#define SPHENC1_ERUNTIME        (-2)
+#define SPHENC1_EUNSUPPORTED    (-3)
+
+typedef Int     SPHENC1_Cmd;
+
+typedef struct SPHENC1_Obj *SPHENC1_Handle;
+
+typedef struct ISPHENC1_Params {
+    XDAS_Int16      size;
+    XDAS_Int16      frameSize;
+    XDAS_Int16      compandingLaw;
+    XDAS_Int16      packingType;
+    XDAS_Int16      vadSelection;
+    XDAS_Int16      codecSelection;
+    XDAS_Int16      bitRate;
+    XDAS_Int16      reserved;
+    XDAS_Int8     **tablesPtr;
+} ISPHENC1_Params;
+
+typedef struct ISPHENC1_DynamicParams {
+    XDAS_Int16      size;
+    XDAS_Int16      frameSize;
+    XDAS_Int16      bitRate;
+    XDAS_Int16      mode;
+    XDAS_Int16      vadFlag;
+    XDAS_Int16      noiseSuppressionMode;
+    XDAS_Int16      ttyTddMode;
+    XDAS_Int16      dtmfMode;
+    XDAS_Int16      dataTransmit;
+    XDAS_Int16      reserved;
+} ISPHENC1_DynamicParams;
+
+typedef struct ISPHENC1_InArgs {
+    XDAS_Int16      size;
+    XDM1_SingleBufDesc data;
+} ISPHENC1_InArgs;
+
+typedef struct ISPHENC1_OutArgs {
+    XDAS_Int16      size;
+    XDAS_Int32      extendedError;
+} ISPHENC1_OutArgs;
+
+typedef struct ISPHENC1_Status {
+    XDAS_Int16      size;
+    XDAS_Int32      extendedError;
+    XDM1_SingleBufDesc data;
+    XDAS_Int16      frameSize;
+    XDAS_Int16      bitRate;
+    XDAS_Int16      mode;
+    XDAS_Int16      vadFlag;
+    XDAS_Int16      noiseSuppressionMode;
+    XDAS_Int16      ttyTddMode;
+    XDAS_Int16      dtmfMode;
+    XDAS_Int16      dataTransmit;
+    XDAS_Int16      compandingLaw;
+    XDAS_Int16      packingType;
+    XDAS_Int16      vadSelection;
+    XDAS_Int16      codecSelection;
+    XDM_AlgBufInfo  bufInfo;
+} ISPHENC1_Status;
+
+typedef ISPHENC1_Params SPHENC1_Params;
+typedef ISPHENC1_DynamicParams SPHENC1_DynamicParams;
+typedef ISPHENC1_InArgs SPHENC1_InArgs;
+typedef ISPHENC1_OutArgs SPHENC1_OutArgs;
+typedef ISPHENC1_Status SPHENC1_Status;
+
+extern SPHENC1_Handle SPHENC1_create(Engine_Handle e, String name,
+                                     SPHENC1_Params *params);
+extern Void     SPHENC1_delete(SPHENC1_Handle handle);
+extern XDAS_Int32 SPHENC1_process(SPHENC1_Handle handle,
+                                  XDM1_SingleBufDesc *inBuf,
+                                  XDM1_SingleBufDesc *outBuf,
+                                  SPHENC1_InArgs *inArgs,
+                                  SPHENC1_OutArgs *outArgs);
+extern XDAS_Int32 SPHENC1_control(SPHENC1_Handle handle, SPHENC1_Cmd id,
+                                  SPHENC1_DynamicParams *params,
+                                  SPHENC1_Status *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
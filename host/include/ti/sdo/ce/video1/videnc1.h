@@ -0,0 +1,100 @@
+/*
+ * Host stand-in for the VIDENC1 VISA interface.
+ */
+
+#ifndef ti_sdo_ce_video1_VIDENC1_
+#define ti_sdo_ce_video1_VIDENC1_
+
+#include <ti/xdais/dm/xdm.h>
+#include <ti/sdo/ce/Engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDENC1_EOK             0
+#define VIDENC1_EFAIL           (-1)
+#define VIDENC1_ERUNTIME        (-2)
+#define VIDENC1_EUNSUPPORTED    (-3)
+
+typedef Int     VIDENC1_Cmd;
+
+typedef struct VIDENC1_Obj *VIDENC1_Handle;
+
+typedef struct IVIDENC1_Params {
+    XDAS_Int32      size;
+    XDAS_Int32      encodingPreset;
+    XDAS_Int32      rateControlPreset;
+    XDAS_Int32      maxHeight;
+    XDAS_Int32      maxWidth;
+    XDAS_Int32      maxFrameRate;
+    XDAS_Int32      maxBitRate;
+    XDAS_Int32      dataEndianness;
+    XDAS_Int32      maxInterFrameInterval;
+    XDAS_Int32      inputChromaFormat;
+    XDAS_Int32      inputContentType;
+    XDAS_Int32      reconChromaFormat;
+} IVIDENC1_Params;
+
+typedef struct IVIDENC1_DynamicParams {
+    XDAS_Int32      size;
+    XDAS_Int32      inputHeight;
+    XDAS_Int32      inputWidth;
+    XDAS_Int32      refFrameRate;
+    XDAS_Int32      targetFrameRate;
+    XDAS_Int32      targetBitRate;
+    XDAS_Int32      intraFrameInterval;
+    XDAS_Int32      generateHeader;
+    XDAS_Int32      captureWidth;
+    XDAS_Int32      forceFrame;
+    XDAS_Int32      interFrameInterval;
+    XDAS_Int32      mbDataFlag;
+} IVIDENC1_DynamicParams;
+
+typedef struct IVIDENC1_InArgs {
+    XDAS_Int32      size;
+    XDAS_Int32      inputID;
+    XDAS_Int32      topFieldFirstFlag;
+} IVIDENC1_InArgs;
+
+typedef struct IVIDENC1_OutArgs {
+    XDAS_Int32      size;
+    XDAS_Int32      extendedError;
+    XDAS_Int32      bytesGenerated;
+    XDAS_Int32      encodedFrameType;
+    XDAS_Int32      inputFrameSkip;
+    XDAS_Int32      outputID;
+    XDM1_SingleBufDesc encodedBuf;
+    IVIDEO1_BufDesc reconBufs;
+} IVIDENC1_OutArgs;
+
+typedef struct IVIDENC1_Status {
+    XDAS_Int32      size;
+    XDAS_Int32      extendedError;
+    XDM1_SingleBufDesc data;
+    XDM_AlgBufInfo  bufInfo;
+} IVIDENC1_Status;
+
+typedef IVIDENC1_Params VIDENC1_Params;
+typedef IVIDENC1_DynamicParams VIDENC1_DynamicParams;
+typedef IVIDENC1_InArgs VIDENC1_InArgs;
+typedef IVIDENC1_OutArgs VIDENC1_OutArgs;
+typedef IVIDENC1_Status VIDENC1_Status;
+
+extern VIDENC1_Handle VIDENC1_create(Engine_Handle e, String name,
+                                     VIDENC1_Params *params);
+extern Void     VIDENC1_delete(VIDENC1_Handle handle);
+extern XDAS_Int32 VIDENC1_process(VIDENC1_Handle handle,
+                                  IVIDEO1_BufDescIn *inBufs,
+                                  XDM_BufDesc *outBufs,
+                                  VIDENC1_InArgs *inArgs,
+                                  VIDENC1_OutArgs *outArgs);
+extern XDAS_Int32 VIDENC1_control(VIDENC1_Handle handle, VIDENC1_Cmd id,
+                                  VIDENC1_DynamicParams *params,
+                                  VIDENC1_Status *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
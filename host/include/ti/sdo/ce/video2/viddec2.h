@@ -0,0 +1,103 @@
+/*
+ * Host stand-in for the VIDDEC2 VISA interface.
+ */
+
+#ifndef ti_sdo_ce_video2_VIDDEC2_
+#define ti_sdo_ce_video2_VIDDEC2_
+
+#include <ti/xdais/dm/xdm.h>
+#include <ti/sdo/ce/Engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VIDDEC2_EOK             0
+#define VIDDEC2_EFAIL           (-1)
+#define VIDDEC2_ERUNTIME        (-2)
+#define VIDDEC2_EUNSUPPORTED    (-3)
+
+#define IVIDDEC2_MAX_IO_BUFFERS 20
+
+#define IVIDDEC2_DISPLAY_ORDER  0
+#define IVIDDEC2_DECODE_ORDER   1
+
+typedef Int     VIDDEC2_Cmd;
+
+typedef struct VIDDEC2_Obj *VIDDEC2_Handle;
+
+typedef struct IVIDDEC2_Params {
+    XDAS_Int32      size;
+    XDAS_Int32      maxHeight;
+    XDAS_Int32      maxWidth;
+    XDAS_Int32      maxFrameRate;
+    XDAS_Int32      maxBitRate;
+    XDAS_Int32      dataEndianness;
+    XDAS_Int32      forceChromaFormat;
+} IVIDDEC2_Params;
+
+typedef struct IVIDDEC2_DynamicParams {
+    XDAS_Int32      size;
+    XDAS_Int32      decodeHeader;
+    XDAS_Int32      displayWidth;
+    XDAS_Int32      frameSkipMode;
+    XDAS_Int32      frameOrder;
+    XDAS_Int32      newFrameFlag;
+    XDAS_Int32      mbDataFlag;
+} IVIDDEC2_DynamicParams;
+
+typedef struct IVIDDEC2_InArgs {
+    XDAS_Int32      size;
+    XDAS_Int32      numBytes;
+    XDAS_Int32      inputID;
+} IVIDDEC2_InArgs;
+
+typedef struct IVIDDEC2_OutArgs {
+    XDAS_Int32      size;
+    XDAS_Int32      bytesConsumed;
+    XDAS_Int32      outputID[IVIDDEC2_MAX_IO_BUFFERS];
+    IVIDEO1_BufDesc decodedBufs;
+    IVIDEO1_BufDesc displayBufs[IVIDDEC2_MAX_IO_BUFFERS];
+    XDAS_Int32      outputMbDataID;
+    XDM1_SingleBufDesc mbDataBuf;
+    XDAS_Int32      freeBufID[IVIDDEC2_MAX_IO_BUFFERS];
+    XDAS_Int32      outBufsInUseFlag;
+} IVIDDEC2_OutArgs;
+
+typedef struct IVIDDEC2_Status {
+    XDAS_Int32      size;
+    XDAS_Int32      extendedError;
+    XDM1_SingleBufDesc data;
+    XDAS_Int32      maxNumDisplayBufs;
+    XDAS_Int32      outputHeight;
+    XDAS_Int32      outputWidth;
+    XDAS_Int32      frameRate;
+    XDAS_Int32      bitRate;
+    XDAS_Int32      contentType;
+    XDAS_Int32      outputChromaFormat;
+    XDM_AlgBufInfo  bufInfo;
+} IVIDDEC2_Status;
+
+typedef IVIDDEC2_Params VIDDEC2_Params;
+typedef IVIDDEC2_DynamicParams VIDDEC2_DynamicParams;
+typedef IVIDDEC2_InArgs VIDDEC2_InArgs;
+typedef IVIDDEC2_OutArgs VIDDEC2_OutArgs;
+typedef IVIDDEC2_Status VIDDEC2_Status;
+
+extern VIDDEC2_Handle VIDDEC2_create(Engine_Handle e, String name,
+                                     VIDDEC2_Params *params);
+extern Void     VIDDEC2_delete(VIDDEC2_Handle handle);
+extern XDAS_Int32 VIDDEC2_process(VIDDEC2_Handle handle,
+                                  XDM1_BufDesc *inBufs,
+                                  XDM_BufDesc *outBufs,
+                                  VIDDEC2_InArgs *inArgs,
+                                  VIDDEC2_OutArgs *outArgs);
+extern XDAS_Int32 VIDDEC2_control(VIDDEC2_Handle handle, VIDDEC2_Cmd id,
+                                  VIDDEC2_DynamicParams *params,
+                                  VIDDEC2_Status *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/BufTab.h>.
+ */
+
+#ifndef ti_sdo_dmai_BufTab_h_
+#define ti_sdo_dmai_BufTab_h_
+
+#include <xdc/std.h>
+#include <ti/sdo/dmai/Buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern BufTab_Handle BufTab_create(Int numBufs, Int32 size,
+                                   Buffer_Attrs *attrs);
+extern Int      BufTab_delete(BufTab_Handle hBufTab);
+extern Buffer_Handle BufTab_getFreeBuf(BufTab_Handle hBufTab);
+extern Void     BufTab_freeBuf(Buffer_Handle hBuf);
+extern Void     BufTab_freeAll(BufTab_Handle hBufTab);
+extern Buffer_Handle BufTab_getBuf(BufTab_Handle hBufTab, Int bufIdx);
+extern Int      BufTab_getNumBufs(BufTab_Handle hBufTab);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/Buffer.h>.  Buffers live on the heap;
+ * Buffer_getPhysicalPtr() returns the user pointer.
+ */
+
+#ifndef ti_sdo_dmai_Buffer_h_
+#define ti_sdo_dmai_Buffer_h_
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/osal/Memory.h>
+
+typedef struct _Buffer_Object *Buffer_Handle;
+typedef struct _BufTab_Object *BufTab_Handle;
+
+typedef enum {
+    Buffer_Type_BASIC = 0,
+    Buffer_Type_GRAPHICS,
+    Buffer_Type_COUNT
+} Buffer_Type;
+
+typedef struct Buffer_Attrs {
+    Memory_AllocParams memParams;
+    Buffer_Type     type;
+    Int16           useMask;
+    Bool            reference;
+} Buffer_Attrs;
+
+extern const Buffer_Attrs Buffer_Attrs_DEFAULT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Buffer_Handle Buffer_create(Int32 size, Buffer_Attrs *attrs);
+extern Int      Buffer_delete(Buffer_Handle hBuf);
+extern Int8    *Buffer_getUserPtr(Buffer_Handle hBuf);
+extern Int32    Buffer_getPhysicalPtr(Buffer_Handle hBuf);
+extern Int32    Buffer_getSize(Buffer_Handle hBuf);
+extern Buffer_Type Buffer_getType(Buffer_Handle hBuf);
+extern Int32    Buffer_getNumBytesUsed(Buffer_Handle hBuf);
+extern Void     Buffer_setNumBytesUsed(Buffer_Handle hBuf,
+                                       Int32 numBytes);
+extern Int      Buffer_setUserPtr(Buffer_Handle hBuf, Int8 *ptr);
+extern Void     Buffer_setSize(Buffer_Handle hBuf, Int32 size);
+extern Int      Buffer_getId(Buffer_Handle hBuf);
+extern UInt16   Buffer_getUseMask(Buffer_Handle hBuf);
+extern Void     Buffer_setUseMask(Buffer_Handle hBuf, UInt16 useMask);
+extern Void     Buffer_freeUseMask(Buffer_Handle hBuf, UInt16 useMask);
+extern Void     Buffer_resetUseMask(Buffer_Handle hBuf);
+extern Bool     Buffer_isReference(Buffer_Handle hBuf);
+extern BufTab_Handle Buffer_getBufTab(Buffer_Handle hBuf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
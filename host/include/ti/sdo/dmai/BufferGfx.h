@@ -0,0 +1,52 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/BufferGfx.h>.
+ */
+
+#ifndef ti_sdo_dmai_BufferGfx_h_
+#define ti_sdo_dmai_BufferGfx_h_
+
+#include <xdc/std.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufTab.h>
+#include <ti/sdo/dmai/ColorSpace.h>
+
+typedef struct BufferGfx_Dimensions {
+    Int32           x;
+    Int32           y;
+    Int32           width;
+    Int32           height;
+    Int32           lineLength;
+} BufferGfx_Dimensions;
+
+typedef struct BufferGfx_Attrs {
+    Buffer_Attrs    bAttrs;
+    ColorSpace_Type colorSpace;
+    BufferGfx_Dimensions dim;
+} BufferGfx_Attrs;
+
+extern const BufferGfx_Attrs BufferGfx_Attrs_DEFAULT;
+
+#define BufferGfx_getBufferAttrs(gfxAttrs) (&(gfxAttrs)->bAttrs)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Int32    BufferGfx_calcLineLength(Int32 width,
+                                         ColorSpace_Type colorSpace);
+extern Int      BufferGfx_getDimensions(Buffer_Handle hBuf,
+                                        BufferGfx_Dimensions *dimPtr);
+extern Int      BufferGfx_setDimensions(Buffer_Handle hBuf,
+                                        BufferGfx_Dimensions *dimPtr);
+extern Int      BufferGfx_resetDimensions(Buffer_Handle hBuf);
+extern ColorSpace_Type BufferGfx_getColorSpace(Buffer_Handle hBuf);
+extern Void     BufferGfx_setColorSpace(Buffer_Handle hBuf,
+                                        ColorSpace_Type colorSpace);
+extern Void     BufferGfx_setFrameType(Buffer_Handle hBuf, Int frameType);
+extern Int      BufferGfx_getFrameType(Buffer_Handle hBuf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/ColorSpace.h>.
+ */
+
+#ifndef ti_sdo_dmai_ColorSpace_h_
+#define ti_sdo_dmai_ColorSpace_h_
+
+#include <xdc/std.h>
+
+typedef enum {
+    ColorSpace_NOTSET = -1,
+    ColorSpace_YUV422PSEMI = 0,
+    ColorSpace_YUV420PSEMI,
+    ColorSpace_UYVY,
+    ColorSpace_RGB565,
+    ColorSpace_RGB888,
+    ColorSpace_YUV420P,
+    ColorSpace_YUV422P,
+    ColorSpace_YUV444P,
+    ColorSpace_GRAY,
+    ColorSpace_COUNT
+} ColorSpace_Type;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Int      ColorSpace_getBpp(ColorSpace_Type colorSpace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/Dmai.h>.
+ */
+
+#ifndef ti_sdo_dmai_Dmai_h_
+#define ti_sdo_dmai_Dmai_h_
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <xdc/std.h>
+
+#define Dmai_EOK            0
+#define Dmai_ENOMEM         (-1)
+#define Dmai_EIO            (-2)
+#define Dmai_ENOTIMPL       (-3)
+#define Dmai_EFAIL          (-4)
+#define Dmai_EINVAL         (-5)
+#define Dmai_EEOF           (-6)
+#define Dmai_EBUSY          (-7)
+#define Dmai_EINTERRUPTED   (-8)
+#define Dmai_EBITERROR      (-9)
+#define Dmai_EFIRSTFIELD    (-10)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Void     Dmai_init(Void);
+extern Int      Dmai_debugLevel;
+
+#ifdef __cplusplus
+}
+#endif
+
+#define Dmai_err0(fmt) \
+    fprintf(stderr, "Error: %s: " fmt, MODULE_NAME)
+#define Dmai_err1(fmt, a1) \
+    fprintf(stderr, "Error: %s: " fmt, MODULE_NAME, a1)
+#define Dmai_err2(fmt, a1, a2) \
+    fprintf(stderr, "Error: %s: " fmt, MODULE_NAME, a1, a2)
+#define Dmai_err3(fmt, a1, a2, a3) \
+    fprintf(stderr, "Error: %s: " fmt, MODULE_NAME, a1, a2, a3)
+
+#define Dmai_dbg(fmt, ...) \
+    do { if (Dmai_debugLevel > 1) \
+        fprintf(stderr, "@0x%08x: [T:0x%08x] %s - " fmt, 0, 0, \
+                MODULE_NAME, __VA_ARGS__); } while (0)
+#define Dmai_dbg0(fmt)                      Dmai_dbg(fmt "%s", "")
+#define Dmai_dbg1(fmt, a1)                  Dmai_dbg(fmt, a1)
+#define Dmai_dbg2(fmt, a1, a2)              Dmai_dbg(fmt, a1, a2)
+#define Dmai_dbg3(fmt, a1, a2, a3)          Dmai_dbg(fmt, a1, a2, a3)
+#define Dmai_dbg4(fmt, a1, a2, a3, a4)      Dmai_dbg(fmt, a1, a2, a3, a4)
+#define Dmai_dbg5(fmt, a1, a2, a3, a4, a5)  Dmai_dbg(fmt, a1, a2, a3, a4, a5)
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/Rendezvous.h>.  The bundle includes it but
+ * does not use the module.
+ */
+
+#ifndef ti_sdo_dmai_Rendezvous_h_
+#define ti_sdo_dmai_Rendezvous_h_
+
+#include <xdc/std.h>
+
+#endif
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/VideoStd.h>.  The bundle includes it but
+ * does not use the module.
+ */
+
+#ifndef ti_sdo_dmai_VideoStd_h_
+#define ti_sdo_dmai_VideoStd_h_
+
+#include <xdc/std.h>
+
+#endif
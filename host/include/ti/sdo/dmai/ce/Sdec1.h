@@ -0,0 +1,38 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/ce/Sdec1.h>.
+ */
+
+#ifndef ti_sdo_dmai_ce_Sdec1_h_
+#define ti_sdo_dmai_ce_Sdec1_h_
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/speech1/sphdec1.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+
+typedef struct Sdec1_Object *Sdec1_Handle;
+
+extern const SPHDEC1_Params Sdec1_Params_DEFAULT;
+extern const SPHDEC1_DynamicParams Sdec1_DynamicParams_DEFAULT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Sdec1_Handle Sdec1_create(Engine_Handle hEngine, Char *codecName,
+                                 SPHDEC1_Params *params,
+                                 SPHDEC1_DynamicParams *dynParams);
+extern Int      Sdec1_process(Sdec1_Handle hSd, Buffer_Handle hInBuf,
+                              Buffer_Handle hOutBuf);
+extern Int      Sdec1_delete(Sdec1_Handle hSd);
+extern SPHDEC1_Handle Sdec1_getVisaHandle(Sdec1_Handle hSd);
+extern Int32    Sdec1_getInBufSize(Sdec1_Handle hSd);
+extern Int32    Sdec1_getOutBufSize(Sdec1_Handle hSd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
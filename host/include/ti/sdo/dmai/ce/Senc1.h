@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/ce/Senc1.h>: the bundle carries its own
+ * copy of the Senc1 module, use its header.
+ */
+
+#include <Senc1.h>
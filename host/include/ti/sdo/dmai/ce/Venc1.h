@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for <ti/sdo/dmai/ce/Venc1.h>.  The module itself is
+ * Venc1.c at the top of the bundle.
+ */
+
+#ifndef ti_sdo_dmai_ce_Venc1_h_
+#define ti_sdo_dmai_ce_Venc1_h_
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video1/videnc1.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+
+typedef struct Venc1_Object *Venc1_Handle;
+
+extern const VIDENC1_Params Venc1_Params_DEFAULT;
+extern const VIDENC1_DynamicParams Venc1_DynamicParams_DEFAULT;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern Venc1_Handle Venc1_create(Engine_Handle hEngine, Char *codecName,
+                                 VIDENC1_Params *params,
+                                 VIDENC1_DynamicParams *dynParams);
+extern Int      Venc1_process(Venc1_Handle hVe, Buffer_Handle hInBuf,
+                              Buffer_Handle hOutBuf);
+extern Int      Venc1_delete(Venc1_Handle hVe);
+extern VIDENC1_Handle Venc1_getVisaHandle(Venc1_Handle hVe);
+extern IVIDEO1_BufDesc *Venc1_getReconBufs(Venc1_Handle hVe);
+extern Int32    Venc1_getInBufSize(Venc1_Handle hVe);
+extern Int32    Venc1_getOutBufSize(Venc1_Handle hVe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Host stand-in for the XDAIS/XDM definitions shared by the VISA
+ * interfaces used in the bundle.
+ */
+
+#ifndef ti_xdais_dm_XDM_
+#define ti_xdais_dm_XDM_
+
+#include <xdc/std.h>
+
+typedef Void    XDAS_Void;
+typedef UInt8   XDAS_Bool;
+typedef Int8    XDAS_Int8;
+typedef UInt8   XDAS_UInt8;
+typedef Int16   XDAS_Int16;
+typedef UInt16  XDAS_UInt16;
+typedef Int32   XDAS_Int32;
+typedef UInt32  XDAS_UInt32;
+
+#define XDM_MAX_IO_BUFFERS      16
+
+#define XDM_DEFAULT             0
+#define XDM_HIGH_QUALITY        1
+#define XDM_HIGH_SPEED          2
+#define XDM_USER_DEFINED        3
+
+#define XDM_BYTE                1
+#define XDM_LE_16               2
+#define XDM_LE_32               3
+
+#define XDM_CHROMA_NA           (-1)
+#define XDM_YUV_420P            1
+#define XDM_YUV_422P            2
+#define XDM_YUV_422IBE          3
+#define XDM_YUV_422ILE          4
+#define XDM_YUV_444P            5
+#define XDM_YUV_411P            6
+#define XDM_GRAY                7
+#define XDM_RGB                 8
+#define XDM_YUV_420SP           9
+
+/* control commands */
+#define XDM_GETSTATUS           0
+#define XDM_SETPARAMS           1
+#define XDM_RESET               2
+#define XDM_SETDEFAULT          3
+#define XDM_FLUSH               4
+#define XDM_GETBUFINFO          5
+#define XDM_GETVERSION          6
+
+/* decodeHeader / generateHeader */
+#define XDM_DECODE_AU           0
+#define XDM_PARSE_HEADER        1
+#define XDM_ENCODE_AU           0
+#define XDM_GENERATE_HEADER     1
+
+/* extended error bits */
+#define XDM_PARAMSCHANGE        8
+#define XDM_APPLIEDCONCEALMENT  9
+#define XDM_INSUFFICIENTDATA    10
+#define XDM_CORRUPTEDDATA       11
+#define XDM_CORRUPTEDHEADER     12
+#define XDM_UNSUPPORTEDINPUT    13
+#define XDM_UNSUPPORTEDPARAM    14
+#define XDM_FATALERROR          15
+
+#define XDM_ISFATALERROR(x)     (((x) >> XDM_FATALERROR) & 0x1)
+#define XDM_ISCORRUPTEDDATA(x)  (((x) >> XDM_CORRUPTEDDATA) & 0x1)
+#define XDM_SETFATALERROR(x)    ((x) |= (0x1 << XDM_FATALERROR))
+#define XDM_SETCORRUPTEDDATA(x) ((x) |= (0x1 << XDM_CORRUPTEDDATA))
+
+typedef struct XDM_BufDesc {
+    XDAS_Int8     **bufs;
+    XDAS_Int32      numBufs;
+    XDAS_Int32     *bufSizes;
+} XDM_BufDesc;
+
+typedef struct XDM1_SingleBufDesc {
+    XDAS_Int8      *buf;
+    XDAS_Int32      bufSize;
+    XDAS_Int32      accessMask;
+} XDM1_SingleBufDesc;
+
+typedef struct XDM1_BufDesc {
+    XDAS_Int32      numBufs;
+    XDM1_SingleBufDesc descs[XDM_MAX_IO_BUFFERS];
+} XDM1_BufDesc;
+
+typedef struct XDM_AlgBufInfo {
+    XDAS_Int32      minNumInBufs;
+    XDAS_Int32      minNumOutBufs;
+    XDAS_Int32      minInBufSize[XDM_MAX_IO_BUFFERS];
+    XDAS_Int32      minOutBufSize[XDM_MAX_IO_BUFFERS];
+} XDM_AlgBufInfo;
+
+/* IVIDEO definitions */
+#define IVIDEO_NONE             0
+#define IVIDEO_LOW_DELAY        1
+#define IVIDEO_STORAGE          2
+#define IVIDEO_TWOPASS          3
+#define IVIDEO_USER_DEFINED     5
+
+#define IVIDEO_CONTENTTYPE_NA   (-1)
+#define IVIDEO_PROGRESSIVE      0
+#define IVIDEO_INTERLACED       1
+
+#define IVIDEO_NA_FRAME         (-1)
+#define IVIDEO_I_FRAME          0
+#define IVIDEO_P_FRAME          1
+#define IVIDEO_B_FRAME          2
+#define IVIDEO_IDR_FRAME        3
+
+#define IVIDEO_NO_SKIP          0
+#define IVIDEO_SKIP_P           1
+#define IVIDEO_SKIP_B           2
+#define IVIDEO_SKIP_I           3
+#define IVIDEO_SKIP_IP          4
+#define IVIDEO_SKIP_IB          5
+#define IVIDEO_SKIP_PB          6
+#define IVIDEO_SKIP_IPB         7
+#define IVIDEO_SKIP_IDR         8
+#define IVIDEO_SKIP_DEFAULT     IVIDEO_NO_SKIP
+
+typedef struct IVIDEO1_BufDescIn {
+    XDAS_Int32      numBufs;
+    XDAS_Int32      frameWidth;
+    XDAS_Int32      frameHeight;
+    XDAS_Int32      framePitch;
+    XDM1_SingleBufDesc bufDesc[XDM_MAX_IO_BUFFERS];
+} IVIDEO1_BufDescIn;
+
+typedef struct IVIDEO1_BufDesc {
+    XDAS_Int32      numBufs;
+    XDAS_Int32      frameWidth;
+    XDAS_Int32      frameHeight;
+    XDAS_Int32      framePitch;
+    XDM1_SingleBufDesc bufDesc[3];
+    XDAS_Int32      extendedError;
+    XDAS_Int32      frameType;
+    XDAS_Int32      topFieldFirstFlag;
+    XDAS_Int32      repeatFirstFieldFlag;
+    XDAS_Int32      frameStatus;
+    XDAS_Int32      repeatFrame;
+    XDAS_Int32      contentType;
+    XDAS_Int32      chromaFormat;
+} IVIDEO1_BufDesc;
+
+/* ISPEECH1 definitions */
+#define ISPEECH1_VADFLAG_DEFAULT    0
+#define ISPEECH1_VADFLAG_OFF        0
+#define ISPEECH1_VADFLAG_ON         1
+
+#endif
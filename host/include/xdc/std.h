@@ -0,0 +1,52 @@
+/*
+ * Host stand-in for <xdc/std.h>.
+ *
+ * Only the XDC base types used by the bundle and the DMAI modules it
+ * carries are provided.
+ */
+
+#ifndef xdc_std__include
+#define xdc_std__include
+
+#include <stddef.h>
+
+typedef char    Char;
+typedef unsigned char UChar;
+typedef short   Short;
+typedef unsigned short UShort;
+typedef int     Int;
+typedef unsigned int UInt;
+typedef long    Long;
+typedef unsigned long ULong;
+typedef float   Float;
+typedef double  Double;
+typedef void    Void;
+typedef void   *Ptr;
+typedef char   *String;
+typedef const char *CString;
+typedef long    Arg;
+typedef unsigned short Bool;
+
+typedef signed char Int8;
+typedef short   Int16;
+typedef int     Int32;
+typedef unsigned char UInt8;
+typedef unsigned short UInt16;
+typedef unsigned int UInt32;
+typedef long long Int64;
+typedef unsigned long long UInt64;
+
+/* legacy spellings still used by DMAI */
+typedef unsigned int Uns;
+typedef unsigned int Uint32;
+typedef unsigned short Uint16;
+typedef unsigned char Uint8;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#endif
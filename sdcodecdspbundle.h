@@ -0,0 +1,184 @@
+/*
+ * Public interface of the sdcodecdspbundle mediastreamer2 plugin.
+ *
+ * The bundle runs six filters on the DM6446 DSP through Codec Engine:
+ * SDH264Enc and SDH264Dec (H.264, RFC 3984), HJLAmrEnc and HJLAmrDec
+ * (AMR-NB, RFC 4867 without crc, robust-sorting or interleaving) and
+ * HJLG729Enc and HJLG729Dec (G.729, RFC 3551, with Annex B DTX unless
+ * the fmtp says annexb=no).  Besides the standard methods they answer
+ * the SD_FILTER_* methods below, whose contracts are given next to each,
+ * and raise the SD_FILTER_EVENT_* events.
+ *
+ * The speech encoders send the frames of ptime (fmtp of
+ * MS_FILTER_ADD_FMTP, 20 ms by default) in each packet, coded with a
+ * single DSP call when the codec takes that many frames per call, and
+ * the decoders decode a whole packet at once and output its PCM as a
+ * single buffer.  SDH264Dec sizes itself after the SPS of the stream, the one
+ * of sprop-parameter-sets or else the first received, and drops what it
+ * cannot decode until the next IDR, which it asks for
+ * (SD_FILTER_EVENT_SEND_VFU).
+ */
+
+#ifndef SDCODECDSPBUNDLE_H
+#define SDCODECDSPBUNDLE_H
+
+#include "mediastreamer2/msfilter.h"
+#include "mediastreamer2/msqueue.h"
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct _SDCodecStats {
+	uint64_t        frames_in;	/* frames or packets consumed */
+	uint64_t        frames_out;	/* frames or packets produced */
+	uint64_t        dsp_calls;	/* *_process() calls sent to the DSP */
+	uint64_t        bytes_copied;	/* bytes memcpy'ed by the ARM */
+	uint64_t        codec_usecs;	/* time spent in *_process() calls */
+	uint64_t        codec_max_usecs;	/* longest *_process() call */
+	uint64_t        stall_usecs;	/* time the ticker waited on the DSP */
+	uint64_t        out_waits;	/* decodes put off, no output buffer free */
+	uint64_t        skipped_fps;	/* frames dropped over the frame rate */
+	uint64_t        skipped_backlog;	/* frames dropped for a newer one */
+	uint64_t        skipped_no_idr;	/* pictures dropped before an IDR */
+	uint64_t        first_frame_usecs;	/* first input to first output */
+	uint64_t        skipped_damaged;	/* pictures that lost packets */
+	uint64_t        decode_errors;	/* *_process() calls that failed */
+	uint64_t        vfu_requests;	/* SD_FILTER_EVENT_SEND_VFU sent */
+	uint64_t        skipped_load;	/* non-reference pictures shed */
+    } SDCodecStats;
+
+    typedef struct _SDReceptionReport {
+	int             fraction_lost;	/* in 1/256, as in the report block */
+	int             jitter_ms;	/* interarrival jitter */
+	int             rtt_ms;	/* round trip time, -1 if unknown */
+    } SDReceptionReport;
+
+    typedef struct FramePool_Object *FramePool_Handle;
+
+/*
+ * All filters: the counters above, so that applications and the
+ * benchmark in bench/ can see how much work a filter did.  Counters only
+ * grow until SD_FILTER_RESET_STATS sets them back to zero.
+ */
+#define SD_FILTER_GET_STATS \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 0, SDCodecStats)
+#define SD_FILTER_RESET_STATS \
+	MS_FILTER_METHOD_NO_ARG(MS_FILTER_PLUGIN_ID, 1)
+
+/*
+ * Video filters, before preprocess: move the DSP calls to a worker
+ * thread with that pipeline depth; 0 or 1 keeps them on the ticker.
+ */
+#define SD_FILTER_SET_ASYNC \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 2, int)
+
+/*
+ * Video filters: frames still in the worker pipeline.
+ */
+#define SD_FILTER_GET_PENDING \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 3, int)
+
+/*
+ * SDH264Enc: a pool of contiguous I420 frames of its input size.  Frames
+ * filled from FramePool_getFrame() instead of allocb() are encoded
+ * without any copy; NULL means the pool is exhausted.  Each successful
+ * call gives the caller a reference, valid across size changes and the
+ * destruction of the encoder until dropped with FramePool_release().
+ */
+#define SD_FILTER_GET_FRAME_POOL \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 4, FramePool_Handle)
+
+/*
+ * SDH264Enc: seconds between IDRs, 10 by default, 0 for none.  An IDR is
+ * also sent on MS_FILTER_REQ_VFU, at most one per second.
+ */
+#define SD_FILTER_SET_KEYFRAME_INTERVAL \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 5, int)
+
+/*
+ * SDH264Enc: slices of about that many bytes, capped to the RTP payload
+ * size, so that each goes out as a single NAL unit packet; 0, the
+ * default, is one slice per frame.  The codec cuts slices by macroblock
+ * rows, sized on the average frame, so the slices of bigger frames
+ * (IDRs) may still need FU-A.
+ */
+#define SD_FILTER_SET_SLICE_SIZE \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 6, int)
+
+/*
+ * SDH264Enc: send the SPS and PPS before the next frame.  Otherwise they
+ * only go before IDRs, in one STAP-A packet in packetization-mode 1.
+ */
+#define SD_FILTER_SEND_PARAM_SETS \
+	MS_FILTER_METHOD_NO_ARG(MS_FILTER_PLUGIN_ID, 7)
+
+/*
+ * SDH264Enc: what the far end says in its RTCP receiver reports, copied
+ * by the application from the report block of its RTP session.  From the
+ * first report on, the encoder follows the estimated bandwidth (see
+ * bw_estimator.h) with its bit rate, never above MS_FILTER_SET_BITRATE,
+ * and its frame rate, never above MS_FILTER_SET_FPS;
+ * MS_FILTER_GET_BITRATE tells the estimate.
+ */
+#define SD_FILTER_SET_RECEPTION_REPORT \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 8, SDReceptionReport)
+
+/*
+ * SDH264Dec: 1 to shed load, off by default.  When pictures queue up on
+ * the input or decoding takes most of the time between two pictures,
+ * the codec then skips B pictures and the pictures with nal_ref_idc 0
+ * are dropped before the DSP (skipped_load); a backlog too long to catch
+ * up with is dropped up to the next IDR.
+ */
+#define SD_FILTER_SET_LOAD_SHEDDING \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 9, int)
+
+/*
+ * HJLAmrEnc: the mode the far end requests, as raised by its HJLAmrDec
+ * with SD_FILTER_EVENT_AMR_CMR, within the mode-set of the fmtp.
+ */
+#define SD_FILTER_SET_AMR_CMR \
+	MS_FILTER_METHOD(MS_FILTER_PLUGIN_ID, 10, int)
+
+/*
+ * SDH264Enc: the video size the bandwidth estimate calls for, lower when
+ * it is too low for the current one, the original one when it is back.
+ * The application reconfigures its capture and calls
+ * MS_FILTER_SET_VIDEO_SIZE.
+ */
+#define SD_FILTER_EVENT_VIDEO_SIZE \
+	MS_FILTER_EVENT(MS_FILTER_PLUGIN_ID, 0, MSVideoSize)
+
+/*
+ * SDH264Dec: send the sender a VFU request (RTCP FIR or PLI).  Raised
+ * while waiting for an IDR, at once and then every second: before the
+ * first one (skipped_no_idr), and after a loss or a failed decode broke
+ * the reference chain (skipped_damaged, decode_errors).
+ */
+#define SD_FILTER_EVENT_SEND_VFU \
+	MS_FILTER_EVENT_NO_ARG(MS_FILTER_PLUGIN_ID, 1)
+
+/*
+ * HJLAmrDec: the mode request (CMR) of the received packets changed, for
+ * the application to hand it to its HJLAmrEnc with SD_FILTER_SET_AMR_CMR.
+ */
+#define SD_FILTER_EVENT_AMR_CMR \
+	MS_FILTER_EVENT(MS_FILTER_PLUGIN_ID, 2, int)
+
+    mblk_t         *FramePool_getFrame(FramePool_Handle hPool);
+    void            FramePool_release(FramePool_Handle hPool);
+
+    void            libsdcodecdspbundle_init(void);
+
+/*
+ * Delete the codecs the filters parked for reuse, which closes the codec
+ * server once no filter is left.  To be called before the plugin is
+ * unloaded, or ms_exit().
+ */
+    void            libsdcodecdspbundle_uninit(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
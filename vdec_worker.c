@@ -0,0 +1,260 @@
+/*
+ * Pipelined H.264 decode for the SDH264Dec filter.
+ *
+ * Same ring as the encoder's VencWorker: each slot goes FREE -> QUEUED
+ * (ticker) -> DONE (worker) -> FREE (ticker), with one index per stage.
+ * Besides the DSP call the worker wraps the display buffers and returns
+ * the released ones to the pool, so that this work overlaps the
+ * depacketization of the next access unit as well.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufferGfx.h>
+#include <ti/sdo/dmai/BufTab.h>
+#include <ti/sdo/dmai/ce/Vdec2.h>
+
+#include "engine_mgr.h"
+#include "vdec_worker.h"
+
+enum {
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_DONE
+};
+
+typedef struct VdecWorker_Object {
+    Engine_Handle   hEngine;	/* the handle hVd2 was created from */
+    Vdec2_Handle    hVd2;
+    FramePool_Handle hFramePool;
+    VdecWorker_Slot slots[VDEC_WORKER_MAX_SLOTS];
+    Int             state[VDEC_WORKER_MAX_SLOTS];
+    Int             numSlots;
+    Int             submitIdx;	/* next slot the ticker fills */
+    Int             workIdx;	/* next slot the worker decodes */
+    Int             collectIdx;	/* next slot the ticker outputs */
+    Bool            quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       thread;
+} VdecWorker_Object;
+
+static unsigned long long
+now_usecs(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void
+decode_slot(VdecWorker_Handle hW, VdecWorker_Slot * slot)
+{
+    Buffer_Handle   hDispBuf,
+		    hFreeBuf;
+    unsigned long long start;
+    mblk_t         *m;
+
+    start = now_usecs();
+    EngineMgr_lock(hW->hEngine);
+    slot->ret = Vdec2_process(hW->hVd2, slot->hInBuf, slot->hOutBuf);
+    EngineMgr_unlock(hW->hEngine);
+    slot->decodeUsecs = now_usecs() - start;
+
+    /*
+     * Send the display frames downstream, they go back to the pool
+     * when the last reference is freed
+     */
+    hDispBuf = Vdec2_getDisplayBuf(hW->hVd2);
+    while (hDispBuf) {
+	m = FramePool_wrapBuffer(hW->hFramePool, hDispBuf,
+				 VDEC_DISPLAY_FREE);
+	if (m != NULL)
+	    ms_queue_put(&slot->frames, m);
+	else
+	    FramePool_freeUseMask(hW->hFramePool, hDispBuf,
+				  VDEC_DISPLAY_FREE);
+	hDispBuf = Vdec2_getDisplayBuf(hW->hVd2);
+    }
+
+    /*
+     * Free up released frames 
+     */
+    hFreeBuf = Vdec2_getFreeBuf(hW->hVd2);
+    while (hFreeBuf) {
+	FramePool_freeUseMask(hW->hFramePool, hFreeBuf, VDEC_CODEC_FREE);
+	hFreeBuf = Vdec2_getFreeBuf(hW->hVd2);
+    }
+}
+
+static void    *
+worker_thread(void *arg)
+{
+    VdecWorker_Handle hW = (VdecWorker_Handle) arg;
+    Int             idx;
+
+    pthread_mutex_lock(&hW->mutex);
+    for (;;) {
+	idx = hW->workIdx;
+	while (hW->state[idx] != SLOT_QUEUED && !hW->quit)
+	    pthread_cond_wait(&hW->cond, &hW->mutex);
+	if (hW->state[idx] != SLOT_QUEUED)
+	    break;
+	pthread_mutex_unlock(&hW->mutex);
+
+	decode_slot(hW, &hW->slots[idx]);
+
+	pthread_mutex_lock(&hW->mutex);
+	hW->state[idx] = SLOT_DONE;
+	hW->workIdx = (idx + 1) % hW->numSlots;
+	pthread_cond_broadcast(&hW->cond);
+    }
+    pthread_mutex_unlock(&hW->mutex);
+
+    return NULL;
+}
+
+VdecWorker_Handle
+VdecWorker_create(Engine_Handle hEngine, Vdec2_Handle hVd2,
+		  FramePool_Handle hFramePool, Buffer_Handle * hInBufs,
+		  Int numSlots)
+{
+    VdecWorker_Handle hW;
+    Int             i;
+
+    if (numSlots < 1 || numSlots > VDEC_WORKER_MAX_SLOTS) {
+	ms_error("VdecWorker: %d slots requested, 1..%d supported",
+		 numSlots, VDEC_WORKER_MAX_SLOTS);
+	return NULL;
+    }
+
+    hW = (VdecWorker_Handle) calloc(1, sizeof(VdecWorker_Object));
+    if (hW == NULL) {
+	ms_error("VdecWorker: failed to allocate worker");
+	return NULL;
+    }
+
+    hW->hEngine = hEngine;
+    hW->hVd2 = hVd2;
+    hW->hFramePool = hFramePool;
+    hW->numSlots = numSlots;
+    for (i = 0; i < numSlots; i++) {
+	hW->slots[i].hInBuf = hInBufs[i];
+	ms_queue_init(&hW->slots[i].frames);
+	hW->state[i] = SLOT_FREE;
+    }
+    pthread_mutex_init(&hW->mutex, NULL);
+    pthread_cond_init(&hW->cond, NULL);
+
+    if (pthread_create(&hW->thread, NULL, worker_thread, hW) != 0) {
+	ms_error("VdecWorker: failed to start decode thread");
+	pthread_cond_destroy(&hW->cond);
+	pthread_mutex_destroy(&hW->mutex);
+	free(hW);
+	return NULL;
+    }
+
+    return hW;
+}
+
+VdecWorker_Slot *
+VdecWorker_getFreeSlot(VdecWorker_Handle hW)
+{
+    VdecWorker_Slot *slot = NULL;
+
+    pthread_mutex_lock(&hW->mutex);
+    if (hW->state[hW->submitIdx] == SLOT_FREE)
+	slot = &hW->slots[hW->submitIdx];
+    pthread_mutex_unlock(&hW->mutex);
+
+    return slot;
+}
+
+Void
+VdecWorker_submit(VdecWorker_Handle hW, VdecWorker_Slot * slot)
+{
+    pthread_mutex_lock(&hW->mutex);
+    if (slot != &hW->slots[hW->submitIdx]) {
+	ms_error("VdecWorker: slot submitted out of order");
+    } else {
+	hW->state[hW->submitIdx] = SLOT_QUEUED;
+	hW->submitIdx = (hW->submitIdx + 1) % hW->numSlots;
+	pthread_cond_broadcast(&hW->cond);
+    }
+    pthread_mutex_unlock(&hW->mutex);
+}
+
+VdecWorker_Slot *
+VdecWorker_getDoneSlot(VdecWorker_Handle hW, Bool wait)
+{
+    VdecWorker_Slot *slot = NULL;
+    Int             idx;
+
+    pthread_mutex_lock(&hW->mutex);
+    idx = hW->collectIdx;
+    if (wait) {
+	/*
+	 * Only wait when there is something in flight, or we would block
+	 * the ticker forever
+	 */
+	while (hW->state[idx] == SLOT_QUEUED)
+	    pthread_cond_wait(&hW->cond, &hW->mutex);
+    }
+    if (hW->state[idx] == SLOT_DONE)
+	slot = &hW->slots[idx];
+    pthread_mutex_unlock(&hW->mutex);
+
+    return slot;
+}
+
+Void
+VdecWorker_releaseSlot(VdecWorker_Handle hW, VdecWorker_Slot * slot)
+{
+    ms_queue_flush(&slot->frames);
+
+    pthread_mutex_lock(&hW->mutex);
+    if (slot != &hW->slots[hW->collectIdx]) {
+	ms_error("VdecWorker: slot released out of order");
+    } else {
+	hW->state[hW->collectIdx] = SLOT_FREE;
+	hW->collectIdx = (hW->collectIdx + 1) % hW->numSlots;
+    }
+    pthread_mutex_unlock(&hW->mutex);
+}
+
+Void
+VdecWorker_delete(VdecWorker_Handle hW)
+{
+    Int             i;
+
+    if (hW == NULL)
+	return;
+
+    /*
+     * The worker decodes whatever is still queued before it exits, so
+     * that the reference frames of the codec stay consistent; the
+     * pictures are dropped
+     */
+    pthread_mutex_lock(&hW->mutex);
+    hW->quit = TRUE;
+    pthread_cond_broadcast(&hW->cond);
+    pthread_mutex_unlock(&hW->mutex);
+
+    pthread_join(hW->thread, NULL);
+    for (i = 0; i < hW->numSlots; i++)
+	ms_queue_flush(&hW->slots[i].frames);
+    pthread_cond_destroy(&hW->cond);
+    pthread_mutex_destroy(&hW->mutex);
+    free(hW);
+}
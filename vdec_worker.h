@@ -0,0 +1,78 @@
+/*
+ * Pipelined H.264 decode for the SDH264Dec filter.
+ *
+ * A VdecWorker owns a thread that runs Vdec2_process() on a bounded ring
+ * of input buffers (slots).  The ticker thread depacketizes and assembles
+ * the next access unit into a free slot, together with the output buffer
+ * it got from the frame pool, while the DSP decodes the previous one.
+ * It then collects the decoded pictures in submission order:
+ *
+ *     VdecWorker_getFreeSlot()   next slot, NULL while the ring is full
+ *     VdecWorker_submit()        queue the filled slot for decoding
+ *     VdecWorker_getDoneSlot()   oldest decoded slot, optionally waiting
+ *     VdecWorker_releaseSlot()   give the slot back once its frames are out
+ *
+ * Display buffers come out as FramePool_wrapBuffer() mblks and buffers
+ * released by the codec are freed, both through the frame pool laid
+ * over the decoder's BufTab.  The worker only takes the lock of the
+ * decoder's own engine handle around each Vdec2_process() call, so the
+ * codecs of other filters, speech on the ticker included, keep running
+ * meanwhile.
+ */
+
+#ifndef SDCODEC_VDEC_WORKER_H
+#define SDCODEC_VDEC_WORKER_H
+
+#include "mediastreamer2/msqueue.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/BufTab.h>
+#include <ti/sdo/dmai/ce/Vdec2.h>
+
+#include "frame_pool.h"
+
+#define VDEC_WORKER_MAX_SLOTS   4
+
+/*
+ * Use-mask bits of the decoder's output buffers 
+ */
+#define VDEC_CODEC_FREE         0x1
+#define VDEC_DISPLAY_FREE       0x2
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct VdecWorker_Object *VdecWorker_Handle;
+
+    typedef struct VdecWorker_Slot {
+	Buffer_Handle   hInBuf;
+	Buffer_Handle   hOutBuf;	/* set by the ticker for each frame */
+	Bool            reference;	/* the frame is a reference picture */
+	Int             ret;	/* Vdec2_process() result */
+	unsigned long long decodeUsecs;	/* time spent in Vdec2_process() */
+	MSQueue         frames;	/* decoded YUV frames, in display order */
+    } VdecWorker_Slot;
+
+    VdecWorker_Handle VdecWorker_create(Engine_Handle hEngine,
+					Vdec2_Handle hVd2,
+					FramePool_Handle hFramePool,
+					Buffer_Handle * hInBufs,
+					Int numSlots);
+    VdecWorker_Slot *VdecWorker_getFreeSlot(VdecWorker_Handle hW);
+    Void            VdecWorker_submit(VdecWorker_Handle hW,
+				      VdecWorker_Slot * slot);
+    VdecWorker_Slot *VdecWorker_getDoneSlot(VdecWorker_Handle hW,
+					    Bool wait);
+    Void            VdecWorker_releaseSlot(VdecWorker_Handle hW,
+					   VdecWorker_Slot * slot);
+    Void            VdecWorker_delete(VdecWorker_Handle hW);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
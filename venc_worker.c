@@ -0,0 +1,239 @@
+/*
+ * Asynchronous H.264 encode for the SDH264Enc filter.
+ *
+ * Each slot goes FREE -> QUEUED (ticker) -> DONE (worker) -> FREE
+ * (ticker).  The ticker submits and collects in ring order and so does
+ * the worker, hence three ring indexes and a single mutex/condition pair
+ * are all that is needed.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "mediastreamer2/mscommon.h"
+#include "mediastreamer2/msqueue.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Dmai.h>
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/ce/Venc1.h>
+
+#include "engine_mgr.h"
+#include "venc_worker.h"
+#include "h264enc_ext.h"
+
+enum {
+    SLOT_FREE,
+    SLOT_QUEUED,
+    SLOT_DONE
+};
+
+typedef struct VencWorker_Object {
+    Engine_Handle   hEngine;	/* the handle hVe1 was created from */
+    Venc1_Handle    hVe1;
+    VencWorker_Slot slots[VENC_WORKER_MAX_SLOTS];
+    Int             state[VENC_WORKER_MAX_SLOTS];
+    Int             numSlots;
+    Int             submitIdx;	/* next slot the ticker fills */
+    Int             workIdx;	/* next slot the worker encodes */
+    Int             collectIdx;	/* next slot the ticker packetizes */
+    Bool            quit;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       thread;
+} VencWorker_Object;
+
+static unsigned long long
+now_usecs(void)
+{
+    struct timeval  tv;
+    gettimeofday(&tv, NULL);
+    return (unsigned long long) tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void    *
+worker_thread(void *arg)
+{
+    VencWorker_Handle hW = (VencWorker_Handle) arg;
+    VencWorker_Slot *slot;
+    unsigned long long start;
+    Int             idx;
+
+    pthread_mutex_lock(&hW->mutex);
+    for (;;) {
+	idx = hW->workIdx;
+	while (hW->state[idx] != SLOT_QUEUED && !hW->quit)
+	    pthread_cond_wait(&hW->cond, &hW->mutex);
+	if (hW->state[idx] != SLOT_QUEUED)
+	    break;
+	slot = &hW->slots[idx];
+	pthread_mutex_unlock(&hW->mutex);
+
+	start = now_usecs();
+	EngineMgr_lock(hW->hEngine);
+	if (slot->setParams)
+	    slot->sliceRejected =
+		!H264Enc_setDynamicParams(hW->hEngine, hW->hVe1,
+					  &slot->dynParams,
+					  slot->sliceBytes);
+	slot->ret = Venc1_process(hW->hVe1,
+				  slot->hFrameBuf ? slot->hFrameBuf :
+				  slot->hInBuf, slot->hOutBuf);
+	EngineMgr_unlock(hW->hEngine);
+	slot->encodeUsecs = now_usecs() - start;
+
+	pthread_mutex_lock(&hW->mutex);
+	hW->state[idx] = SLOT_DONE;
+	hW->workIdx = (idx + 1) % hW->numSlots;
+	pthread_cond_broadcast(&hW->cond);
+    }
+    pthread_mutex_unlock(&hW->mutex);
+
+    return NULL;
+}
+
+VencWorker_Handle
+VencWorker_create(Engine_Handle hEngine, Venc1_Handle hVe1,
+		  Buffer_Handle * hInBufs, Buffer_Handle * hOutBufs,
+		  Int numSlots)
+{
+    VencWorker_Handle hW;
+    Int             i;
+
+    if (numSlots < 1 || numSlots > VENC_WORKER_MAX_SLOTS) {
+	ms_error("VencWorker: %d slots requested, 1..%d supported",
+		 numSlots, VENC_WORKER_MAX_SLOTS);
+	return NULL;
+    }
+
+    hW = (VencWorker_Handle) calloc(1, sizeof(VencWorker_Object));
+    if (hW == NULL) {
+	ms_error("VencWorker: failed to allocate worker");
+	return NULL;
+    }
+
+    hW->hEngine = hEngine;
+    hW->hVe1 = hVe1;
+    hW->numSlots = numSlots;
+    for (i = 0; i < numSlots; i++) {
+	hW->slots[i].hInBuf = hInBufs[i];
+	hW->slots[i].hOutBuf = hOutBufs[i];
+	hW->state[i] = SLOT_FREE;
+    }
+    pthread_mutex_init(&hW->mutex, NULL);
+    pthread_cond_init(&hW->cond, NULL);
+
+    if (pthread_create(&hW->thread, NULL, worker_thread, hW) != 0) {
+	ms_error("VencWorker: failed to start encode thread");
+	pthread_cond_destroy(&hW->cond);
+	pthread_mutex_destroy(&hW->mutex);
+	free(hW);
+	return NULL;
+    }
+
+    return hW;
+}
+
+VencWorker_Slot *
+VencWorker_getFreeSlot(VencWorker_Handle hW)
+{
+    VencWorker_Slot *slot = NULL;
+
+    pthread_mutex_lock(&hW->mutex);
+    if (hW->state[hW->submitIdx] == SLOT_FREE)
+	slot = &hW->slots[hW->submitIdx];
+    pthread_mutex_unlock(&hW->mutex);
+
+    return slot;
+}
+
+Void
+VencWorker_submit(VencWorker_Handle hW, VencWorker_Slot * slot)
+{
+    pthread_mutex_lock(&hW->mutex);
+    if (slot != &hW->slots[hW->submitIdx]) {
+	ms_error("VencWorker: slot submitted out of order");
+    } else {
+	hW->state[hW->submitIdx] = SLOT_QUEUED;
+	hW->submitIdx = (hW->submitIdx + 1) % hW->numSlots;
+	pthread_cond_broadcast(&hW->cond);
+    }
+    pthread_mutex_unlock(&hW->mutex);
+}
+
+VencWorker_Slot *
+VencWorker_getDoneSlot(VencWorker_Handle hW, Bool wait)
+{
+    VencWorker_Slot *slot = NULL;
+    Int             idx;
+
+    pthread_mutex_lock(&hW->mutex);
+    idx = hW->collectIdx;
+    if (wait) {
+	/*
+	 * Only wait when there is something in flight, or we would block
+	 * the ticker forever
+	 */
+	while (hW->state[idx] == SLOT_QUEUED)
+	    pthread_cond_wait(&hW->cond, &hW->mutex);
+    }
+    if (hW->state[idx] == SLOT_DONE)
+	slot = &hW->slots[idx];
+    pthread_mutex_unlock(&hW->mutex);
+
+    return slot;
+}
+
+static void
+free_frame(VencWorker_Slot * slot)
+{
+    if (slot->frame != NULL)
+	freemsg(slot->frame);
+    slot->frame = NULL;
+    slot->hFrameBuf = NULL;
+    slot->setParams = FALSE;
+}
+
+Void
+VencWorker_releaseSlot(VencWorker_Handle hW, VencWorker_Slot * slot)
+{
+    free_frame(slot);
+
+    pthread_mutex_lock(&hW->mutex);
+    if (slot != &hW->slots[hW->collectIdx]) {
+	ms_error("VencWorker: slot released out of order");
+    } else {
+	hW->state[hW->collectIdx] = SLOT_FREE;
+	hW->collectIdx = (hW->collectIdx + 1) % hW->numSlots;
+    }
+    pthread_mutex_unlock(&hW->mutex);
+}
+
+Void
+VencWorker_delete(VencWorker_Handle hW)
+{
+    Int             i;
+
+    if (hW == NULL)
+	return;
+
+    /*
+     * The worker encodes whatever is still queued before it exits, so
+     * that the codec is left in a consistent state for the next user
+     */
+    pthread_mutex_lock(&hW->mutex);
+    hW->quit = TRUE;
+    pthread_cond_broadcast(&hW->cond);
+    pthread_mutex_unlock(&hW->mutex);
+
+    pthread_join(hW->thread, NULL);
+    for (i = 0; i < hW->numSlots; i++)
+	free_frame(&hW->slots[i]);
+    pthread_cond_destroy(&hW->cond);
+    pthread_mutex_destroy(&hW->mutex);
+    free(hW);
+}
@@ -0,0 +1,76 @@
+/*
+ * Asynchronous H.264 encode for the SDH264Enc filter.
+ *
+ * A VencWorker owns a thread that runs Venc1_process() on a ring of
+ * input/output buffer pairs (slots), so that the ticker thread only
+ * copies a frame in, submits it and goes on.  Slots are used in ring
+ * order and encoded frames are collected in submission order:
+ *
+ *     VencWorker_getFreeSlot()   next slot, NULL while it is in flight
+ *     VencWorker_submit()        queue the filled slot for encoding
+ *     VencWorker_getDoneSlot()   oldest encoded slot, optionally waiting
+ *     VencWorker_releaseSlot()   give the slot back once packetized
+ *
+ * A slot can carry a pool frame (see frame_pool.h) that is encoded in
+ * place of its own input buffer; the frame is freed when the slot is
+ * released.  It can also carry dynamic params, set with
+ * H264Enc_setDynamicParams() right before its frame is encoded, so
+ * that a change (a forced IDR, a new bit rate) applies to exactly that
+ * frame and the following ones whatever is still in the pipeline.  The
+ * worker only takes the lock of the encoder's own engine handle around
+ * each Venc1_process() call, so the codecs of other filters, speech on
+ * the ticker included, keep running meanwhile.
+ */
+
+#ifndef SDCODEC_VENC_WORKER_H
+#define SDCODEC_VENC_WORKER_H
+
+#include "mediastreamer2/msqueue.h"
+
+#include <xdc/std.h>
+
+#include <ti/sdo/ce/Engine.h>
+
+#include <ti/sdo/dmai/Buffer.h>
+#include <ti/sdo/dmai/ce/Venc1.h>
+
+#define VENC_WORKER_MAX_SLOTS   4
+
+#ifdef __cplusplus
+extern          "C" {
+#endif
+
+    typedef struct VencWorker_Object *VencWorker_Handle;
+
+    typedef struct VencWorker_Slot {
+	Buffer_Handle   hInBuf;
+	Buffer_Handle   hOutBuf;
+	mblk_t         *frame;	/* zero-copy input frame, or NULL */
+	Buffer_Handle   hFrameBuf;	/* its buffer, encoded instead of hInBuf */
+	Bool            setParams;	/* apply dynParams before encoding */
+	VIDENC1_DynamicParams dynParams;
+	XDAS_Int32      sliceBytes;	/* slice budget set with them, 0: none */
+	Bool            sliceRejected;	/* the codec refused the budget */
+	UInt32          ts;	/* RTP timestamp of the frame */
+	Int             ret;	/* Venc1_process() result */
+	unsigned long long encodeUsecs;	/* time spent in Venc1_process() */
+    } VencWorker_Slot;
+
+    VencWorker_Handle VencWorker_create(Engine_Handle hEngine,
+					Venc1_Handle hVe1,
+					Buffer_Handle * hInBufs,
+					Buffer_Handle * hOutBufs,
+					Int numSlots);
+    VencWorker_Slot *VencWorker_getFreeSlot(VencWorker_Handle hW);
+    Void            VencWorker_submit(VencWorker_Handle hW,
+				      VencWorker_Slot * slot);
+    VencWorker_Slot *VencWorker_getDoneSlot(VencWorker_Handle hW,
+					    Bool wait);
+    Void            VencWorker_releaseSlot(VencWorker_Handle hW,
+					   VencWorker_Slot * slot);
+    Void            VencWorker_delete(VencWorker_Handle hW);
+
+#ifdef __cplusplus
+}
+#endif
+#endif